@@ -0,0 +1,53 @@
+/*
+ * bench/gen.cc
+ * writes a synthetic source program to stdout, see bench/workload.hh
+ *
+ * usage: bench/gen [--functions n] [--statements n] [--depth n] [--globals n]
+ *                  [--string-length n] [--loops n] [--seed n]
+ */
+
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+#include "workload.hh"
+
+int main(int argc, char** argv) {
+    bench::Workload w = bench::default_workload();
+
+    struct {
+        const char* flag;
+        int* value;
+    } knobs[] = {
+        {"--functions", &w.functions},
+        {"--statements", &w.statements},
+        {"--depth", &w.depth},
+        {"--globals", &w.globals},
+        {"--string-length", &w.string_length},
+        {"--loops", &w.loops},
+    };
+
+    for (int i = 1; i < argc; ++i) {
+        bool found = false;
+
+        if (i + 1 < argc && !strcmp(argv[i], "--seed")) {
+            w.seed = strtoul(argv[++i], NULL, 10);
+            continue;
+        }
+
+        for (auto& k : knobs) {
+            if (i + 1 < argc && !strcmp(argv[i], k.flag) && atoi(argv[i + 1]) >= 0) {
+                *k.value = atoi(argv[++i]);
+                found = true;
+            }
+        }
+
+        if (!found) {
+            std::cerr << "usage: " << *argv << " [--functions n] [--statements n] [--depth n] [--globals n] [--string-length n] [--loops n] [--seed n]\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    std::cout << bench::generate_workload(w);
+    return 0;
+}
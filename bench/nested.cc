@@ -0,0 +1,79 @@
+/*
+ * bench/nested.cc
+ * benchmark for type checking and code generation of deeply nested conditional expressions
+ *
+ * usage: bench/nested [max_depth]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <unistd.h>
+
+#include "../src/driver.hh"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsed_ms(bench_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+/* ((!(...)) ? x : x), nested 'depth' levels deep */
+static std::string nested_conditional(int depth) {
+    std::string expr = "x";
+
+    for (int i = 0; i < depth; ++i) {
+        expr = "((!(" + expr + ")) ? x : x)";
+    }
+
+    return expr;
+}
+
+int main(int argc, char** argv) {
+    int max_depth = (argc > 1) ? atoi(argv[1]) : 2000;
+
+    char path[] = "/tmp/bench-nested-XXXXXX";
+    int fd = mkstemp(path);
+
+    if (fd < 0) {
+        std::cerr << "error: cannot create temporary file\n";
+        return EXIT_FAILURE;
+    }
+
+    close(fd);
+
+    std::cout << "  depth   check (ms)   codegen (ms)   codegen (ns/level)\n";
+
+    for (int depth = 250; depth <= max_depth; depth *= 2) {
+        std::string expr = nested_conditional(depth);
+
+        {
+            std::ofstream src(path);
+            src << "int f(int x) {\n";
+            src << "    if (" << expr << ") x = 1;\n";
+            src << "    while (" << expr << ") x = 2;\n";
+            src << "    return x;\n";
+            src << "}\n";
+        }
+
+        driver d;
+        if (d.parse(path)) return EXIT_FAILURE;
+
+        auto start = bench_clock::now();
+        if (d.check_types(false)) return EXIT_FAILURE;
+        double check_ms = elapsed_ms(start);
+
+        start = bench_clock::now();
+        std::ostringstream ir;
+        if (d.generate_ir(ir)) return EXIT_FAILURE;
+        double gen_ms = elapsed_ms(start);
+
+        printf("%7d   %10.2f   %12.2f   %18.1f\n", depth, check_ms, gen_ms, gen_ms * 1e6 / (2.0 * depth));
+    }
+
+    unlink(path);
+    return 0;
+}
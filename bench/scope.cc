@@ -0,0 +1,61 @@
+/*
+ * bench/scope.cc
+ * microbenchmark for AST::Scope declaration and lookup as the symbol count grows
+ *
+ * usage: bench/scope [max_symbols]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+
+#include "../src/ast.hh"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsed_ns(bench_clock::time_point start) {
+    return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count();
+}
+
+int main(int argc, char** argv) {
+    int max_symbols = (argc > 1) ? atoi(argv[1]) : 64000;
+    location loc;
+
+    std::cout << "symbols   declare (ns/sym)   lookup (ns/op)\n";
+
+    for (int n = 1000; n <= max_symbols; n *= 2) {
+        /* half of the symbols are globals, half are functions */
+        std::vector<util::Atom> names;
+        for (int i = 0; i < n; ++i) names.push_back(util::intern("sym" + std::to_string(i)));
+
+        AST::Scope* scope = new AST::Scope(loc);
+
+        auto start = bench_clock::now();
+        for (int i = 0; i < n; i += 2) {
+            scope->push_variable(new AST::Variable(loc, AST::types::INT, new AST::VariableName(loc, names[i])));
+            scope->push_function(new AST::Function(loc, AST::types::INT, names[i + 1], new AST::Scope(loc)));
+        }
+        double declare_ns = elapsed_ns(start) / n;
+
+        /* look every symbol up a few times, like identifier references during type checking */
+        int found = 0;
+        start = bench_clock::now();
+        for (int r = 0; r < 4; ++r) {
+            for (int i = 0; i < n; i += 2) {
+                found += scope->get_variable(names[i]) != NULL;
+                found += scope->get_function(names[i + 1]) != NULL;
+            }
+        }
+        double lookup_ns = elapsed_ns(start) / (4.0 * n);
+
+        if (found != 4 * n) {
+            std::cerr << "error: lookup failed\n";
+            return EXIT_FAILURE;
+        }
+
+        printf("%7d   %16.1f   %14.1f\n", n, declare_ns, lookup_ns);
+    }
+
+    return 0;
+}
@@ -0,0 +1,239 @@
+/*
+ * bench/suite.cc
+ * times every compiler mode over a set of generated workloads
+ *
+ * each workload stresses one part of the compiler: many functions, deep
+ * expressions, long bodies, many globals, long string literals or deep loop
+ * nests. the report has one line per workload and mode with the median and
+ * best time of the repeats, and can be saved with -o and compared against
+ * an earlier report with -b, which adds the speedup of every median.
+ *
+ * usage: bench/suite [-s scale] [-r repeats] [-o report] [-b baseline]
+ */
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <unistd.h>
+#include <vector>
+
+#include "workload.hh"
+#include "../src/driver.hh"
+#include "../src/version.hh"
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsed_ms(bench_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+}
+
+/* swallows the compiler output, so only the compiler is timed */
+class NullBuffer : public std::streambuf {
+protected:
+    int overflow(int c) { return c; }
+    std::streamsize xsputn(const char*, std::streamsize n) { return n; }
+};
+
+static NullBuffer null_buffer;
+static std::ostream null_stream(&null_buffer);
+
+/* the workloads at scale 1, each one grows linearly with the scale */
+static std::vector<bench::Workload> workloads(int scale) {
+    std::vector<bench::Workload> out;
+    bench::Workload w;
+
+    w = bench::default_workload();
+    w.name = "functions";
+    w.functions = 2000 * scale;
+    w.statements = 4;
+    out.push_back(w);
+
+    w = bench::default_workload();
+    w.name = "nesting";
+    w.functions = 4;
+    w.statements = 4;
+    w.depth = 500 * scale;
+    out.push_back(w);
+
+    w = bench::default_workload();
+    w.name = "straight";
+    w.functions = 4;
+    w.statements = 2000 * scale;
+    out.push_back(w);
+
+    w = bench::default_workload();
+    w.name = "globals";
+    w.globals = 20000 * scale;
+    w.functions = 100;
+    out.push_back(w);
+
+    w = bench::default_workload();
+    w.name = "strings";
+    w.functions = 50;
+    w.string_length = 4000 * scale;
+    out.push_back(w);
+
+    w = bench::default_workload();
+    w.name = "loops";
+    w.functions = 50 * scale;
+    w.loops = 10;
+    out.push_back(w);
+
+    return out;
+}
+
+/* run one mode the way main.cc does, false if the compiler failed */
+static bool run_mode(const std::string& mode, const std::string& path, const std::string& bin_path) {
+    driver d;
+    d.out = &null_stream;
+    d.err = &std::cerr;
+
+    if (mode == "lex") return !d.scan(path);
+    if (mode == "disasm") return !d.disassemble(bin_path);
+    if (d.parse(path)) return false;
+
+    if (mode == "parse") {
+        d.result->write(*d.out);
+        return true;
+    }
+
+    if (d.check_types(mode == "types")) return false;
+    if (mode == "types") return true;
+    if (d.optimize()) return false;
+    if (mode == "ir") return !d.generate_ir(*d.out);
+
+    return !d.run_ir();
+}
+
+/* write the workload as binary IR for the disasm mode */
+static bool write_binary(const std::string& path, const std::string& bin_path) {
+    driver d;
+    std::ofstream bin(bin_path, std::ios::binary);
+
+    d.emit = "bin";
+    return !d.parse(path) && !d.check_types(false) && !d.optimize() && !d.generate_ir(bin);
+}
+
+/* median ms per workload and mode from an earlier report */
+static std::map<std::string, double> read_report(const std::string& path) {
+    std::map<std::string, double> out;
+    std::ifstream in(path);
+    std::string line;
+
+    while (std::getline(in, line)) {
+        if (line.empty() || line[0] == '#') continue;
+
+        std::istringstream fields(line);
+        std::string workload, mode;
+        long bytes;
+        double median;
+
+        if (fields >> workload >> bytes >> mode >> median) out[workload + " " + mode] = median;
+    }
+
+    return out;
+}
+
+int main(int argc, char** argv) {
+    int scale = 1, repeats = 3;
+    std::string report_path, baseline_path;
+
+    for (int i = 1; i < argc; ++i) {
+        if (i + 1 < argc && !strcmp(argv[i], "-s")) scale = atoi(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "-r")) repeats = atoi(argv[++i]);
+        else if (i + 1 < argc && !strcmp(argv[i], "-o")) report_path = argv[++i];
+        else if (i + 1 < argc && !strcmp(argv[i], "-b")) baseline_path = argv[++i];
+        else {
+            std::cerr << "usage: " << *argv << " [-s scale] [-r repeats] [-o report] [-b baseline]\n";
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (scale < 1 || repeats < 1) {
+        std::cerr << "error: scale and repeats must be positive\n";
+        return EXIT_FAILURE;
+    }
+
+    std::map<std::string, double> baseline;
+    if (!baseline_path.empty()) baseline = read_report(baseline_path);
+
+    char path[] = "/tmp/bench-suite-XXXXXX";
+    int fd = mkstemp(path);
+
+    if (fd < 0) {
+        std::cerr << "error: cannot create temporary file\n";
+        return EXIT_FAILURE;
+    }
+
+    close(fd);
+    std::string bin_path = std::string(path) + ".bin";
+
+    static const char* modes[] = {"lex", "parse", "types", "ir", "run", "disasm"};
+    std::ostringstream report;
+    char line[160];
+
+    report << "# compiler version " COMPILER_VERSION ", scale " << scale << ", " << repeats << " repeats\n";
+    report << "# workload       bytes  mode     median (ms)    best (ms)    MB/s";
+    if (!baseline.empty()) report << "   vs base";
+    report << "\n";
+    std::cout << report.str() << std::flush;
+
+    for (auto& w : workloads(scale)) {
+        std::string source = bench::generate_workload(w);
+
+        {
+            std::ofstream src(path);
+            src << source;
+        }
+
+        if (!write_binary(path, bin_path)) return EXIT_FAILURE;
+
+        for (auto mode : modes) {
+            std::vector<double> times;
+
+            for (int r = 0; r < repeats; ++r) {
+                auto start = bench_clock::now();
+
+                if (!run_mode(mode, path, bin_path)) {
+                    std::cerr << "error: " << w.name << " failed in mode " << mode << "\n";
+                    return EXIT_FAILURE;
+                }
+
+                times.push_back(elapsed_ms(start));
+            }
+
+            std::sort(times.begin(), times.end());
+            double median = times[times.size() / 2];
+
+            snprintf(line, sizeof line, "%-10s %11zu  %-6s %13.3f %12.3f %7.1f", w.name.c_str(), source.size(), mode,
+                     median, times[0], source.size() / median / 1e3);
+
+            std::string entry = line;
+            auto base = baseline.find(w.name + " " + mode);
+
+            if (base != baseline.end() && median > 0) {
+                snprintf(line, sizeof line, "   %6.2fx", base->second / median);
+                entry += line;
+            }
+
+            report << entry << "\n";
+            std::cout << entry << std::endl;
+        }
+    }
+
+    unlink(path);
+    unlink(bin_path.c_str());
+
+    if (!report_path.empty()) {
+        std::ofstream out(report_path);
+        out << report.str();
+    }
+
+    return 0;
+}
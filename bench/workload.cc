@@ -0,0 +1,157 @@
+#include "workload.hh"
+
+#include <random>
+#include <sstream>
+
+namespace {
+    /* locals of every generated function besides the loop counters */
+    const int NUM_LOCALS = 4;
+
+    /* words in the global array */
+    const int ARRAY_SIZE = 64;
+
+    class Generator {
+    public:
+        Generator(const bench::Workload& w) : w(w), rng(w.seed) {}
+
+        std::string program();
+
+    private:
+        int pick(int n) {
+            return std::uniform_int_distribution<int>(0, n - 1)(rng);
+        }
+
+        std::string leaf();
+        std::string expression(int depth);
+        void function(int n);
+
+        const bench::Workload& w;
+        std::mt19937 rng;
+        std::ostringstream out;
+    };
+}
+
+std::string Generator::leaf() {
+    switch (pick(6)) {
+    case 0: return std::to_string(pick(100));
+    case 1: return (pick(2)) ? "a" : "b";
+    case 2: return "x" + std::to_string(pick(NUM_LOCALS));
+    case 3: if (w.globals) return "g" + std::to_string(pick(w.globals));
+            return "x0";
+    case 4: return "garr[" + std::to_string(pick(ARRAY_SIZE)) + "]";
+    default: return "mix(x" + std::to_string(pick(NUM_LOCALS)) + ", " + std::to_string(pick(10)) + ")";
+    }
+}
+
+/*
+ * a chain of 'depth' binary operations. + and - only grow the value by a
+ * leaf per level and & and | keep it bounded, so nothing overflows
+ */
+std::string Generator::expression(int depth) {
+    static const char* ops[] = {" + ", " - ", " & ", " | "};
+    std::string e = leaf();
+
+    for (int i = 0; i < depth; ++i) {
+        switch (pick(6)) {
+        case 0: e = "((" + leaf() + " * 3) + (" + e + "))"; break;
+        case 1: e = "((" + e + ") / 7)"; break;
+        default: e = "(" + leaf() + ops[pick(4)] + "(" + e + "))"; break;
+        }
+    }
+
+    return e;
+}
+
+void Generator::function(int n) {
+    out << "int f" << n << "(int a, int b) {\n";
+    out << "    int x0, x1, x2, x3";
+    for (int i = 0; i < w.loops; ++i) out << ", i" << i;
+    out << ";\n";
+
+    for (int i = 0; i < NUM_LOCALS; ++i) out << "    x" << i << " = a + " << i << ";\n";
+
+    /* keep every value small, so long bodies never overflow */
+    for (int i = 0; i < w.statements; ++i) {
+        int x = pick(NUM_LOCALS);
+        out << "    x" << x << " = (" << expression(w.depth) << ") & 1023;\n";
+
+        if (i % 8 == 7) out << "    if (x" << x << " > b) garr[x" << x << " & " << ARRAY_SIZE - 1 << "] = x" << x << "; else x" << x << " = x" << x << " + 1;\n";
+        if (w.globals && i % 4 == 3) out << "    g" << pick(w.globals) << " = x" << x << ";\n";
+    }
+
+    if (w.loops) {
+        std::string indent = "    ";
+
+        for (int i = 0; i < w.loops; ++i) {
+            out << indent << "for (i" << i << " = 0; i" << i << " < 2; i" << i << "++) {\n";
+            indent += "    ";
+        }
+
+        out << indent << "x0 = (x0 + " << expression(w.depth / 4) << ") & 1023;\n";
+
+        for (int i = w.loops; i > 0; --i) {
+            indent.resize(4 * i);
+            out << indent << "}\n";
+        }
+    }
+
+    if (w.string_length) {
+        out << "    x1 = x1 + length(\"";
+        for (int i = 0; i < w.string_length; ++i) out << (char) ('a' + pick(26));
+        out << "\");\n";
+    }
+
+    out << "    return (x0 + x1 + x2 + x3) & 1023;\n";
+    out << "}\n\n";
+}
+
+std::string Generator::program() {
+    out << "/* generated workload " << w.name << " */\n";
+
+    if (w.globals) {
+        out << "int g0";
+        for (int i = 1; i < w.globals; ++i) out << ((i % 16) ? ", " : ",\n    ") << "g" << i;
+        out << ";\n";
+    }
+
+    out << "int garr[" << ARRAY_SIZE << "];\n\n";
+
+    out << "int mix(int a, int b) {\n";
+    out << "    return (a + b) & 1023;\n";
+    out << "}\n\n";
+
+    out << "int length(char s[]) {\n";
+    out << "    int n;\n";
+    out << "    n = 0;\n";
+    out << "    while (s[n] != (char) 0) n++;\n";
+    out << "    return n;\n";
+    out << "}\n\n";
+
+    for (int i = 0; i < w.functions; ++i) function(i);
+
+    out << "int main() {\n";
+    out << "    int sum;\n";
+    out << "    sum = 0;\n";
+    for (int i = 0; i < w.functions; ++i) out << "    sum = (sum + f" << i << "(" << i % 1000 << ", " << pick(1000) << ")) & 65535;\n";
+    out << "    return sum;\n";
+    out << "}\n";
+
+    return out.str();
+}
+
+bench::Workload bench::default_workload() {
+    Workload w;
+    w.name = "default";
+    w.functions = 10;
+    w.statements = 10;
+    w.depth = 4;
+    w.globals = 10;
+    w.string_length = 0;
+    w.loops = 0;
+    w.seed = 1;
+    return w;
+}
+
+std::string bench::generate_workload(const Workload& w) {
+    return Generator(w).program();
+}
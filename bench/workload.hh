@@ -0,0 +1,32 @@
+#pragma once
+
+/*
+ * bench/workload.hh
+ * declares the generator for synthetic source programs used by the benchmarks
+ *
+ * every program is valid input for the compiler in every mode: it type
+ * checks, and main() terminates without reading stdin or writing stdout.
+ * expressions are fully parenthesized and only divide by constants, so the
+ * same knobs always give the same program.
+ */
+
+#include <string>
+
+namespace bench {
+    struct Workload {
+        std::string name;
+        int functions;     /* functions besides main and the helpers, each called once from main */
+        int statements;    /* straight-line statements per function body */
+        int depth;         /* nesting depth of each expression */
+        int globals;       /* global int variables */
+        int string_length; /* characters in the string literal each function passes to a helper */
+        int loops;         /* depth of the for loop nest around one statement in each function */
+        unsigned seed;
+    };
+
+    /* knobs for a small program, to be adjusted by the caller */
+    Workload default_workload();
+
+    /* the source text of the program described by w */
+    std::string generate_workload(const Workload& w);
+}
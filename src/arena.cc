@@ -0,0 +1,79 @@
+#include "arena.hh"
+
+#include <cstdint>
+#include <cstdlib>
+#include <cxxabi.h>
+#include <mutex>
+
+/* classes in type_number() order, shared by every arena */
+static std::mutex type_lock;
+static std::vector<const std::type_info*> type_table;
+
+util::Arena::Arena(size_t block_size) : block_size(block_size), used(0), reserved(0), count(0), cur(NULL), end(NULL) {}
+
+util::Arena::~Arena() {
+    /* destroy in reverse order of construction, children were usually built first */
+    for (auto i = finalizers.rbegin(); i != finalizers.rend(); ++i) {
+        i->fn(i->obj);
+    }
+
+    for (auto i : blocks) {
+        delete[] i;
+    }
+}
+
+void* util::Arena::allocate(size_t size, size_t align) {
+    uintptr_t p = ((uintptr_t) cur + align - 1) & ~(uintptr_t) (align - 1);
+
+    if (!cur || p + size > (uintptr_t) end) {
+        /* start a new block. oversized requests get a block of their own */
+        size_t n = (size + align > block_size) ? size + align : block_size;
+        cur = new char[n];
+        end = cur + n;
+        blocks.push_back(cur);
+        reserved += n;
+
+        p = ((uintptr_t) cur + align - 1) & ~(uintptr_t) (align - 1);
+    }
+
+    cur = (char*) (p + size);
+    used += size;
+    ++count;
+
+    return (void*) p;
+}
+
+size_t util::Arena::bytes_used() const {
+    return used;
+}
+
+size_t util::Arena::bytes_reserved() const {
+    return reserved;
+}
+
+size_t util::Arena::objects() const {
+    return count;
+}
+
+std::vector<std::pair<std::string, size_t>> util::Arena::objects_by_type() const {
+    std::vector<std::pair<std::string, size_t>> out;
+    std::lock_guard<std::mutex> lock(type_lock);
+
+    for (size_t i = 0; i < type_counts.size(); ++i) {
+        if (!type_counts[i]) continue;
+
+        int status;
+        char* name = abi::__cxa_demangle(type_table[i]->name(), NULL, NULL, &status);
+        out.push_back({status ? type_table[i]->name() : name, type_counts[i]});
+        free(name);
+    }
+
+    return out;
+}
+
+size_t util::Arena::register_type(const std::type_info& t) {
+    std::lock_guard<std::mutex> lock(type_lock);
+
+    type_table.push_back(&t);
+    return type_table.size() - 1;
+}
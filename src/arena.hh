@@ -0,0 +1,81 @@
+#pragma once
+
+/*
+ * arena.hh
+ * declares a bump allocator which owns every AST object built by a driver
+ *
+ * objects are carved out of large blocks and are never freed individually.
+ * destroying the arena runs the destructors of everything it built and
+ * releases all of the blocks at once.
+ */
+
+#include <cstddef>
+#include <new>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <utility>
+#include <vector>
+
+namespace util {
+    class Arena {
+    public:
+        Arena(size_t block_size = 64 * 1024);
+        ~Arena();
+
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        /* construct a T in the arena. the arena owns the result */
+        template <typename T, typename... Args>
+        T* make(Args&&... args) {
+            T* obj = new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+
+            if (!std::is_trivially_destructible<T>::value) {
+                finalizers.push_back({obj, &destroy<T>});
+            }
+
+            size_t t = type_number<T>();
+            if (t >= type_counts.size()) type_counts.resize(t + 1);
+            ++type_counts[t];
+
+            return obj;
+        }
+
+        /* raw aligned storage, valid until the arena is destroyed */
+        void* allocate(size_t size, size_t align);
+
+        size_t bytes_used() const;
+        size_t bytes_reserved() const;
+        size_t objects() const;
+
+        /* objects made of each class, by readable class name */
+        std::vector<std::pair<std::string, size_t>> objects_by_type() const;
+
+    private:
+        /* a small number per class made by any arena, for type_counts */
+        template <typename T>
+        static size_t type_number() {
+            static const size_t n = register_type(typeid(T));
+            return n;
+        }
+
+        static size_t register_type(const std::type_info& t);
+
+        template <typename T>
+        static void destroy(void* p) {
+            static_cast<T*>(p)->~T();
+        }
+
+        struct Finalizer {
+            void* obj;
+            void (*fn)(void*);
+        };
+
+        size_t block_size, used, reserved, count;
+        char* cur, *end;
+        std::vector<char*> blocks;
+        std::vector<Finalizer> finalizers;
+        std::vector<size_t> type_counts;
+    };
+}
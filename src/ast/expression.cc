@@ -1,25 +1,199 @@
 #include "expression.hh"
 #include "../parser.hh"
 
+#include <cstring>
+
 /* Expression base */
 AST::Expression::Expression(location loc) : Node(loc) {}
 
-std::string AST::Expression::type(Scope* global_scope, Function* func) { return "NOTYPE"; }
+AST::Type AST::Expression::type(Scope* global_scope, Function* func) {
+    if (!typed) {
+        result_type = infer_type(global_scope, func);
+        typed = true;
+    }
+
+    return result_type;
+}
+
+AST::Type AST::Expression::infer_type(Scope* global_scope, Function* func) { return types::NOTYPE; }
+
+void AST::Expression::reserve(IR::ConstPool& pool) {}
+
+void AST::Expression::gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result) {}
+
+AST::Expression* AST::Expression::fold(FoldContext& ctx) { return this; }
+bool AST::Expression::constant_bits(uint32_t& bits) { return false; }
+bool AST::Expression::is_pure() { return false; }
+bool AST::Expression::is_boolean() { return false; }
+AST::Expression* AST::Expression::negate(FoldContext& ctx) { return NULL; }
+AST::Variable* AST::Expression::named_variable() { return NULL; }
+
+/*
+ * constant folding helpers
+ *
+ * values are handled as the 32-bit words the VM works on: chars and ints are
+ * both full words in two's complement, floats are single precision. casting
+ * to char does not truncate at runtime, so it doesn't here either.
+ */
+
+static float word_to_float(uint32_t w) {
+    float f;
+    memcpy(&f, &w, sizeof f);
+    return f;
+}
+
+static uint32_t float_to_word(float f) {
+    uint32_t w;
+    memcpy(&w, &f, sizeof w);
+    return w;
+}
+
+static bool is_zero(AST::Type type, uint32_t w) {
+    return (type == AST::types::FLOAT) ? word_to_float(w) == 0.0f : w == 0;
+}
+
+/* count a replacement made by the folder */
+static AST::Expression* replace(AST::FoldContext& ctx, AST::Expression* e) {
+    ++ctx.folded;
+    return e;
+}
+
+static AST::Expression* new_constant(AST::FoldContext& ctx, location loc, AST::Type type, uint32_t w) {
+    AST::Expression* e;
+    int32_t v = (int32_t) w;
+
+    if (type == AST::types::FLOAT) {
+        e = ctx.arena.make<AST::RealConst>(loc, word_to_float(w));
+    } else if (type == AST::types::CHAR && v == (signed char) v) {
+        e = ctx.arena.make<AST::CharConst>(loc, (char) v);
+    } else {
+        /* chars outside the char range are still full words, so they stay IntConst nodes */
+        e = ctx.arena.make<AST::IntConst>(loc, v);
+    }
+
+    e->result_type = type;
+    e->typed = true;
+    return e;
+}
+
+static AST::Expression* make_constant(AST::FoldContext& ctx, location loc, AST::Type type, uint32_t w) {
+    return replace(ctx, new_constant(ctx, loc, type, w));
+}
+
+/* an expression which is 1 when 'e' is nonzero and 0 otherwise */
+static AST::Expression* make_truth(AST::FoldContext& ctx, AST::Expression* e) {
+    uint32_t w;
+    if (e->constant_bits(w)) return new_constant(ctx, e->loc, AST::types::CHAR, !is_zero(e->result_type, w));
+    if (e->is_boolean()) return e;
+
+    AST::Expression* zero = new_constant(ctx, e->loc, e->result_type, 0);
+    AST::BinaryOpExpression* cmp = ctx.arena.make<AST::BinaryOpExpression>(e->loc, e, zero, AST::BinaryOpExpression::Type::NEQUAL);
+
+    cmp->operand_type = e->result_type;
+    cmp->result_type = AST::types::CHAR;
+    cmp->typed = true;
+    return cmp;
+}
 
-void AST::Expression::reserve(AST::Program* prg) {}
+/* evaluate a binary operator on two constant words. returns false if the result must be left to runtime */
+static bool eval_binary(AST::BinaryOpExpression::Type t, AST::Type type, uint32_t a, uint32_t b, uint32_t& r) {
+    typedef AST::BinaryOpExpression::Type Op;
 
-std::string AST::Expression::gen_code(Scope* global_scope, Function* func, bool keep_result) { return "    ; default Expression gen_code()?\n"; }
+    if (t == Op::DAMP) { r = !is_zero(type, a) && !is_zero(type, b); return true; }
+    if (t == Op::DPIPE) { r = !is_zero(type, a) || !is_zero(type, b); return true; }
+
+    if (type == AST::types::FLOAT) {
+        float x = word_to_float(a), y = word_to_float(b);
+
+        switch (t) {
+        case Op::EQUALS: r = x == y; return true;
+        case Op::NEQUAL: r = x != y; return true;
+        case Op::GT:     r = x > y; return true;
+        case Op::GE:     r = x >= y; return true;
+        case Op::LT:     r = x < y; return true;
+        case Op::LE:     r = x <= y; return true;
+        case Op::PLUS:   r = float_to_word(x + y); return true;
+        case Op::MINUS:  r = float_to_word(x - y); return true;
+        case Op::STAR:   r = float_to_word(x * y); return true;
+        case Op::SLASH:
+            if (y == 0.0f) return false;
+            r = float_to_word(x / y);
+            return true;
+        default:
+            /* float '%', '&' and '|' are left to the VM */
+            return false;
+        }
+    }
+
+    int32_t x = (int32_t) a, y = (int32_t) b;
+
+    switch (t) {
+    case Op::EQUALS: r = x == y; return true;
+    case Op::NEQUAL: r = x != y; return true;
+    case Op::GT:     r = x > y; return true;
+    case Op::GE:     r = x >= y; return true;
+    case Op::LT:     r = x < y; return true;
+    case Op::LE:     r = x <= y; return true;
+    case Op::PLUS:   r = a + b; return true;
+    case Op::MINUS:  r = a - b; return true;
+    case Op::STAR:   r = a * b; return true;
+    case Op::AMP:    r = a & b; return true;
+    case Op::PIPE:   r = a | b; return true;
+    case Op::SLASH:
+    case Op::MOD:
+        /* division by zero and INT_MIN / -1 trap, keep them at runtime */
+        if (y == 0 || (x == INT32_MIN && y == -1)) return false;
+        r = (t == Op::SLASH) ? x / y : x % y;
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* branch code generation */
+void AST::Expression::gen_branch(IR::Buffer& out, Scope* global_scope, Function* func, int true_label, int false_label) {
+    /* a constant condition is just a jump, or nothing at all */
+    uint32_t bits;
+    if (constant_bits(bits)) {
+        int target = is_zero(result_type, bits) ? false_label : true_label;
+        if (target != FALL_THROUGH) out.emit_jump(IR::Op::GOTO, target);
+        return;
+    }
+
+    /* anything else is evaluated and tested against zero */
+    gen_code(out, global_scope, func, true);
+
+    if (true_label == FALL_THROUGH) {
+        out.emit_jump(IR::Op::BEQZ, false_label, result_type.suffix());
+        return;
+    }
+
+    out.emit_jump(IR::Op::BNEZ, true_label, result_type.suffix());
+    if (false_label != FALL_THROUGH) out.emit_jump(IR::Op::GOTO, false_label);
+}
+
+/* push 1 if 'e' holds and 0 otherwise, for conditions whose value is actually used */
+static void gen_truth_value(AST::Expression* e, IR::Buffer& out, AST::Scope* global_scope, AST::Function* func) {
+    int false_label = func->make_label(), post_label = func->make_label();
+
+    e->gen_branch(out, global_scope, func, AST::FALL_THROUGH, false_label);
+    out.emit_value(IR::Op::PUSHV, 1);
+    out.emit_jump(IR::Op::GOTO, post_label);
+    out.emit_label(false_label);
+    out.emit_value(IR::Op::PUSHV, 0);
+    out.emit_label(post_label);
+}
 
 /* LValue */
-AST::LValue::LValue(location loc, std::string name, Expression* expr) : Node(loc), name(name), expr(expr) {}
+AST::LValue::LValue(location loc, util::Atom name, Expression* expr) : Node(loc), name(name), expr(expr) {}
 
-void AST::LValue::write() {
-    std::cout << "<LValue name=" << name << ">\n";
-    if (expr) expr->write();
-    std::cout << "</LValue>\n";
+void AST::LValue::write(std::ostream& out) {
+    out << "<LValue name=" << name << ">\n";
+    if (expr) expr->write(out);
+    out << "</LValue>\n";
 }
 
-std::string AST::LValue::type(Scope* global_scope, Function* func) {
+AST::Type AST::LValue::type(Scope* global_scope, Function* func) {
     var = func->scope->get_variable(name);
     if (!var) var = global_scope->get_variable(name);
 
@@ -32,122 +206,162 @@ std::string AST::LValue::type(Scope* global_scope, Function* func) {
             throw yy::parser::syntax_error(loc, "cannot index into non-array type '" + var->base_type + "'");
         }
 
-        std::string ind_type = expr->type(global_scope, func);
-        if (ind_type != "int") {
+        AST::Type ind_type = expr->type(global_scope, func);
+        if (ind_type != types::INT) {
             throw yy::parser::syntax_error(loc, "invalid index type '" + ind_type + "'");
         }
 
         return var->base_type;
     }
 
-    return var->base_type + (var->name->is_array ? "[]" : "");
+    return var->type();
 }
 
-void AST::LValue::reserve(AST::Program* prg) {
-    if (expr) expr->reserve(prg);
+void AST::LValue::reserve(IR::ConstPool& pool) {
+    if (expr) expr->reserve(pool);
 }
 
-std::string AST::LValue::gen_store_code(Scope* global_scope, Function* func, bool keep_result) {
+void AST::LValue::fold(FoldContext& ctx) {
+    if (expr) expr = expr->fold(ctx);
+}
+
+void AST::LValue::gen_store_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result) {
     /* this code gen assumes we have the dest value on the top of the stack. */
 
     /* are we indexing into an array? then we need to compute the index */
-    std::string out;
-
     if (expr) {
-        if (keep_result) out += "    copy\n";
-        out += expr->gen_code(global_scope, func, true);
-        out += std::string("    ptrto ") + var->code_location + "\n";
-        out += std::string("    move 2\n    move 2\n"); /* we have to shift around the order of the stack for pop[] */
-        out += std::string("    pop") + var->base_type[0] + "[]\n";
+        if (keep_result) out.emit(IR::Op::COPY);
+        expr->gen_code(out, global_scope, func, true);
+        out.emit(IR::Op::PTRTO, var->code_location);
+
+        /* we have to shift around the order of the stack for pop[] */
+        out.emit_value(IR::Op::MOVE, 2);
+        out.emit_value(IR::Op::MOVE, 2);
+        out.emit(IR::Op::POP_INDEX, var->base_type.suffix());
     } else {
-        if (keep_result) out += "    copy\n";
-        out += std::string("    pop ") + var->code_location + "\n";
+        if (keep_result) out.emit(IR::Op::COPY);
+        out.emit(IR::Op::POP, var->code_location);
     }
-
-    return out;
 }
 
-std::string AST::LValue::gen_retrieve_code(Scope* global_scope, Function* func, bool keep_result) {
-    /* keep_result will never be false here.. */
-    std::string out;
-
-    if (expr) out += expr->gen_code(global_scope, func, keep_result);
-    if (!keep_result) return out;
-
+void AST::LValue::gen_address_code(IR::Buffer& out, Scope* global_scope, Function* func) {
+    /* the index is all we keep, ptrto is cheap to repeat */
+    if (expr) expr->gen_code(out, global_scope, func, true);
+}
+void AST::LValue::gen_load_code(IR::Buffer& out) {
     if (expr) {
-        /* index into the array */
-        out += std::string("    ptrto ") + var->code_location + "\n";
-        out += std::string("    push") + var->base_type[0] + "[]\n";
+        /* index into the array, keeping a copy of the index for the store */
+        out.emit(IR::Op::COPY);
+        out.emit(IR::Op::PTRTO, var->code_location);
+        out.emit(IR::Op::PUSH_INDEX, var->base_type.suffix());
     } else {
-        out += std::string("    push ") + var->code_location + "\n";
+        out.emit(IR::Op::PUSH, var->code_location);
     }
+}
+void AST::LValue::gen_save_code(IR::Buffer& out) {
+    out.emit(IR::Op::COPY);
+    if (expr) out.emit_value(IR::Op::MOVE, 2);
+}
+void AST::LValue::gen_update_code(IR::Buffer& out, bool keep_result) {
+    if (keep_result) gen_save_code(out);
 
-    return out;
+    if (expr) {
+        /* index, value -> index, pointer, value for pop[] */
+        out.emit(IR::Op::PTRTO, var->code_location);
+        out.emit_value(IR::Op::MOVE, 1);
+        out.emit(IR::Op::POP_INDEX, var->base_type.suffix());
+    } else {
+        out.emit(IR::Op::POP, var->code_location);
+    }
 }
 
 /* Constants */
 AST::IntConst::IntConst(location loc, int n) : Expression(loc), n(n) {}
-void AST::IntConst::write() { std::cout << "<IntConst n=" << n << ">\n"; }
-std::string AST::IntConst::type(Scope* global_scope, Function* func) { return "int"; }
+void AST::IntConst::write(std::ostream& out) { out << "<IntConst n=" << n << ">\n"; }
+AST::Type AST::IntConst::infer_type(Scope* global_scope, Function* func) { return types::INT; }
 
-void AST::IntConst::reserve(AST::Program* prg) {
-    code_location = prg->make_const_int(n);
+void AST::IntConst::reserve(IR::ConstPool& pool) {
+    code_location = pool.make_int(n);
 }
 
-std::string AST::IntConst::gen_code(Scope* global_scope, Function* func, bool keep_result) {
-    if (!keep_result) return ""; /* not actually using this */
+void AST::IntConst::gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result) {
+    if (!keep_result) return; /* not actually using this */
 
     /* need to push the constant onto the stack */
-    return "    push " + code_location + "\n";
+    out.emit(IR::Op::PUSH, code_location);
+}
+
+bool AST::IntConst::constant_bits(uint32_t& bits) {
+    bits = n;
+    return true;
 }
 
+bool AST::IntConst::is_pure() { return true; }
+
 AST::RealConst::RealConst(location loc, double n) : Expression(loc), n(n) {}
-void AST::RealConst::write() { std::cout << "<RealConst n=" << n << ">\n"; }
-std::string AST::RealConst::type(Scope* global_scope, Function* func) { return "float"; }
+void AST::RealConst::write(std::ostream& out) { out << "<RealConst n=" << n << ">\n"; }
+AST::Type AST::RealConst::infer_type(Scope* global_scope, Function* func) { return types::FLOAT; }
 
-void AST::RealConst::reserve(AST::Program* prg) {
-    code_location = prg->make_const_real(n);
+void AST::RealConst::reserve(IR::ConstPool& pool) {
+    code_location = pool.make_real(n);
 }
 
-std::string AST::RealConst::gen_code(Scope* global_scope, Function* func, bool keep_result) {
-    if (!keep_result) return ""; /* not actually using this */
-    return "    push " + code_location + "\n";
+void AST::RealConst::gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result) {
+    if (!keep_result) return; /* not actually using this */
+    out.emit(IR::Op::PUSH, code_location);
 }
 
+bool AST::RealConst::constant_bits(uint32_t& bits) {
+    /* the pool stores single precision, so that is the value the program sees */
+    bits = float_to_word(n);
+    return true;
+}
+
+bool AST::RealConst::is_pure() { return true; }
+
 AST::StrConst::StrConst(location loc, std::string val) : Expression(loc), val(val) {}
-void AST::StrConst::write() { std::cout << "<StrConst val=\"" << val << "\">\n"; }
-std::string AST::StrConst::type(Scope* global_scope, Function* func) { return "char[]"; }
+void AST::StrConst::write(std::ostream& out) { out << "<StrConst val=\"" << val << "\">\n"; }
+AST::Type AST::StrConst::infer_type(Scope* global_scope, Function* func) { return types::array_of(types::CHAR); }
 
-std::string AST::StrConst::gen_code(Scope* global_scope, Function* func, bool keep_result) {
-    if (!keep_result) return "";
-    return "    ptrto " + code_location + "\n";
+void AST::StrConst::gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result) {
+    if (!keep_result) return;
+    out.emit(IR::Op::PTRTO, code_location);
 }
 
-void AST::StrConst::reserve(AST::Program* prg) {
-    code_location = prg->make_const_string(val);
+void AST::StrConst::reserve(IR::ConstPool& pool) {
+    code_location = pool.make_string(val);
 }
 
+bool AST::StrConst::is_pure() { return true; }
+
 AST::CharConst::CharConst(location loc, char val) : Expression(loc), val(val) {}
-void AST::CharConst::write() { std::cout << "<CharConst val='" << val << "'>\n"; }
-std::string AST::CharConst::type(Scope* global_scope, Function* func) { return "char"; }
+void AST::CharConst::write(std::ostream& out) { out << "<CharConst val='" << val << "'>\n"; }
+AST::Type AST::CharConst::infer_type(Scope* global_scope, Function* func) { return types::CHAR; }
 
-void AST::CharConst::reserve(AST::Program* prg) {
-    code_location = prg->make_const_int(val);
+void AST::CharConst::reserve(IR::ConstPool& pool) {
+    code_location = pool.make_int(val);
 }
 
-std::string AST::CharConst::gen_code(Scope* global_scope, Function* func, bool keep_result) {
-    if (!keep_result) return ""; /* not actually using this */
-    return "    push " + code_location + "\n";
+void AST::CharConst::gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result) {
+    if (!keep_result) return; /* not actually using this */
+    out.emit(IR::Op::PUSH, code_location);
 }
 
+bool AST::CharConst::constant_bits(uint32_t& bits) {
+    bits = (int) val;
+    return true;
+}
+
+bool AST::CharConst::is_pure() { return true; }
+
 /* IdentifierExpression */
-AST::IdentifierExpression::IdentifierExpression(location loc, std::string name) : Expression(loc), name(name) {}
+AST::IdentifierExpression::IdentifierExpression(location loc, util::Atom name) : Expression(loc), name(name) {}
 
-void AST::IdentifierExpression::write() {
-    std::cout << "<IdentifierExpression name=\"" << name << "\" />\n";
+void AST::IdentifierExpression::write(std::ostream& out) {
+    out << "<IdentifierExpression name=\"" << name << "\" />\n";
 }
 
-std::string AST::IdentifierExpression::type(Scope* global_scope, Function* func) {
+AST::Type AST::IdentifierExpression::infer_type(Scope* global_scope, Function* func) {
     /* search the function scope for variables, then the global scope */
     var = func->scope->get_variable(name);
     if (!var) var = global_scope->get_variable(name);
@@ -156,27 +370,33 @@ std::string AST::IdentifierExpression::type(Scope* global_scope, Function* func)
         throw yy::parser::syntax_error(loc, "unknown variable name '" + name + "'");
     }
 
-    return var->base_type + (var->name->is_array ? "[]" : "");
+    return var->type();
 }
 
-std::string AST::IdentifierExpression::gen_code(Scope* global_scope, Function* func, bool keep_result) {
-    if (!keep_result) return "";
+void AST::IdentifierExpression::gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result) {
+    if (!keep_result) return;
 
     if (var->name->is_array) {
-        return "    ptrto " + var->code_location + "\n";
+        out.emit(IR::Op::PTRTO, var->code_location);
     } else {
-        return "    push " + var->code_location + "\n";
+        out.emit(IR::Op::PUSH, var->code_location);
     }
 }
 
+bool AST::IdentifierExpression::is_pure() { return true; }
+
+AST::Variable* AST::IdentifierExpression::named_variable() {
+    return var->name->is_array ? NULL : var;
+}
+
 /* AddressExpression */
-AST::AddressExpression::AddressExpression(location loc, std::string name) : Expression(loc), name(name) {}
+AST::AddressExpression::AddressExpression(location loc, util::Atom name) : Expression(loc), name(name) {}
 
-void AST::AddressExpression::write() {
-    std::cout << "<AddressExpression name=\"" << name << "\" />\n";
+void AST::AddressExpression::write(std::ostream& out) {
+    out << "<AddressExpression name=\"" << name << "\" />\n";
 }
 
-std::string AST::AddressExpression::type(Scope* global_scope, Function* func) {
+AST::Type AST::AddressExpression::infer_type(Scope* global_scope, Function* func) {
     var = func->scope->get_variable(name);
     if (!var) var = global_scope->get_variable(name);
 
@@ -188,24 +408,26 @@ std::string AST::AddressExpression::type(Scope* global_scope, Function* func) {
         throw yy::parser::syntax_error(loc, "cannot get address of array type '" + var->base_type + "[]'");
     }
 
-    return var->base_type + "[]";
+    return types::array_of(var->base_type);
 }
 
-std::string AST::AddressExpression::gen_code(Scope* global_scope, Function* func, bool keep_result) {
-    if (!keep_result) return "";
-    return "    ptrto " + var->code_location + "\n";
+void AST::AddressExpression::gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result) {
+    if (!keep_result) return;
+    out.emit(IR::Op::PTRTO, var->code_location);
 }
 
+bool AST::AddressExpression::is_pure() { return true; }
+
 /* IndexExpression */
-AST::IndexExpression::IndexExpression(location loc, std::string name, Expression* ind) : Expression(loc), name(name), ind(ind) {}
+AST::IndexExpression::IndexExpression(location loc, util::Atom name, Expression* ind) : Expression(loc), name(name), ind(ind) {}
 
-void AST::IndexExpression::write() {
-    std::cout << "<IndexExpression name=\"" << name << "\">\n";
-    ind->write();
-    std::cout << "</IndexExpression>\n";
+void AST::IndexExpression::write(std::ostream& out) {
+    out << "<IndexExpression name=\"" << name << "\">\n";
+    ind->write(out);
+    out << "</IndexExpression>\n";
 }
 
-std::string AST::IndexExpression::type(Scope* global_scope, Function* func) {
+AST::Type AST::IndexExpression::infer_type(Scope* global_scope, Function* func) {
     var = func->scope->get_variable(name);
     if (!var) var = global_scope->get_variable(name);
 
@@ -217,42 +439,49 @@ std::string AST::IndexExpression::type(Scope* global_scope, Function* func) {
         throw yy::parser::syntax_error(loc, "cannot index into non-array type '" + var->base_type + "'");
     }
 
-    std::string ind_type = ind->type(global_scope, func);
+    AST::Type ind_type = ind->type(global_scope, func);
 
-    if (ind_type != "int" && ind_type != "float") {
+    if (ind_type != types::INT && ind_type != types::FLOAT) {
         throw yy::parser::syntax_error(loc, "cannot index into array with non-integer type '" + ind_type + "'");
     }
 
     return var->base_type;
 }
 
-void AST::IndexExpression::reserve(AST::Program* prg) {
-    if (ind) ind->reserve(prg);
+void AST::IndexExpression::reserve(IR::ConstPool& pool) {
+    if (ind) ind->reserve(pool);
 }
 
-std::string AST::IndexExpression::gen_code(Scope* global_scope, Function* func, bool keep_result) {
+void AST::IndexExpression::gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result) {
     /* no matter what, we need to evaluate the index. */
 
-    std::string out = ind->gen_code(global_scope, func, keep_result);
-    if (!keep_result) return out;
+    ind->gen_code(out, global_scope, func, keep_result);
+    if (!keep_result) return;
 
     /* we need the result, actually index the array */
-    out += std::string("    ptrto ") + var->code_location + "\n";
-    out += std::string("    push") + var->base_type[0] + "[]\n";
+    out.emit(IR::Op::PTRTO, var->code_location);
+    out.emit(IR::Op::PUSH_INDEX, var->base_type.suffix());
+}
+
+AST::Expression* AST::IndexExpression::fold(FoldContext& ctx) {
+    ind = ind->fold(ctx);
+    return this;
+}
 
-    return out;
+bool AST::IndexExpression::is_pure() {
+    return ind->is_pure();
 }
 
 /* CallExpression */
-AST::CallExpression::CallExpression(location loc, std::string name, std::vector<Expression*> args) : Expression(loc), name(name), args(args) {}
+AST::CallExpression::CallExpression(location loc, util::Atom name, std::vector<Expression*> args) : Expression(loc), name(name), args(args) {}
 
-void AST::CallExpression::write() {
-    std::cout << "<CallExpression name=\"" << name << "\">\n";
-    for (auto i : args) i->write();
-    std::cout << "</CallExpression>\n";
+void AST::CallExpression::write(std::ostream& out) {
+    out << "<CallExpression name=\"" << name << "\">\n";
+    for (auto i : args) i->write(out);
+    out << "</CallExpression>\n";
 }
 
-std::string AST::CallExpression::type(Scope* global_scope, Function* func) {
+AST::Type AST::CallExpression::infer_type(Scope* global_scope, Function* func) {
     /* find function reference */
     f = global_scope->get_function(name);
 
@@ -261,15 +490,15 @@ std::string AST::CallExpression::type(Scope* global_scope, Function* func) {
     }
 
     /* check parameters match up */
-    std::vector<AST::Variable*> params = f->params->variables;
+    const std::vector<AST::Variable*>& params = f->params->variables;
 
     if (args.size() != params.size()) {
         throw yy::parser::syntax_error(loc, "incorrect number of arguments to '" + name + "'; expected " + std::to_string(params.size()) + ", got " + std::to_string(args.size()));
     }
 
     for (int i = 0; i < (int) args.size(); ++i) {
-        std::string atype = args[i]->type(global_scope, func);
-        std::string ptype = params[i]->base_type + (params[i]->name->is_array ? "[]" : "");
+        AST::Type atype = args[i]->type(global_scope, func);
+        AST::Type ptype = params[i]->type();
 
         if (atype != ptype) {
             ++i;
@@ -280,55 +509,59 @@ std::string AST::CallExpression::type(Scope* global_scope, Function* func) {
     return f->ret_type;
 }
 
-void AST::CallExpression::reserve(AST::Program* prg) {
+void AST::CallExpression::reserve(IR::ConstPool& pool) {
     for (auto i : args) {
-        i->reserve(prg);
+        i->reserve(pool);
     }
 }
 
-std::string AST::CallExpression::gen_code(Scope* global_scope, Function* func, bool keep_result) {
+void AST::CallExpression::gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result) {
     /* push arguments in order, then call the function */
     /* return value is automatically pushed for us! */
 
-    std::string out;
-
     for (auto i : args) {
-        out += i->gen_code(global_scope, func, true);
+        i->gen_code(out, global_scope, func, true);
     }
 
-    out += "    call " + std::to_string(f->function_number) + "\n";
+    out.emit_value(IR::Op::CALL, f->function_number);
 
     /* if the function returned, and we're not keeping it,
      * we need to pop the retval. off the stack */
-    if (f->ret_type != "void" && !keep_result) {
-        out += "    popx\n";
+    if (f->ret_type != types::VOID && !keep_result) {
+        out.emit(IR::Op::POPX);
+    }
+}
+
+AST::Expression* AST::CallExpression::fold(FoldContext& ctx) {
+    for (auto& i : args) {
+        i = i->fold(ctx);
     }
 
-    return out;
+    return this;
 }
 
 /* AssignmentExpression */
 AST::AssignmentExpression::AssignmentExpression(location loc, LValue* lhs, Type t, Expression* rhs)
     : Expression(loc), lhs(lhs), t(t), rhs(rhs) {}
 
-void AST::AssignmentExpression::write() {
-    std::cout << "<AssignmentExpression op=" << (int) t << ">\n";
-    std::cout << "(lhs)\n";
-    lhs->write();
-    std::cout << "(rhs)\n";
-    rhs->write();
-    std::cout << "</AssignmentExpression>\n";
+void AST::AssignmentExpression::write(std::ostream& out) {
+    out << "<AssignmentExpression op=" << (int) t << ">\n";
+    out << "(lhs)\n";
+    lhs->write(out);
+    out << "(rhs)\n";
+    rhs->write(out);
+    out << "</AssignmentExpression>\n";
 }
 
-std::string AST::AssignmentExpression::type(Scope* global_scope, Function* func) {
-    std::string lhs_type = lhs->type(global_scope, func);
-    std::string rhs_type = rhs->type(global_scope, func);
+AST::Type AST::AssignmentExpression::infer_type(Scope* global_scope, Function* func) {
+    AST::Type lhs_type = lhs->type(global_scope, func);
+    AST::Type rhs_type = rhs->type(global_scope, func);
 
     if (lhs_type != rhs_type) {
         throw yy::parser::syntax_error(loc, "cannot assign " + rhs_type + " to " + lhs_type + " lvalue");
     }
 
-    if (lhs_type != "char" && lhs_type != "int" && lhs_type != "float") {
+    if (lhs_type != types::CHAR && lhs_type != types::INT && lhs_type != types::FLOAT) {
         throw yy::parser::syntax_error(loc, "invalid assignment type " + lhs_type);
     }
 
@@ -336,114 +569,122 @@ std::string AST::AssignmentExpression::type(Scope* global_scope, Function* func)
     return lhs_type;
 }
 
-std::string AST::AssignmentExpression::gen_code(Scope* global_scope, Function* func, bool keep_result) {
+void AST::AssignmentExpression::gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result) {
     /* in any assignment we always have to evaluate everything */
     /* if we're updating an existing value we want to get that first */
     /* first, get the right-hand value */
 
-    std::string out;
-
-    /* get the value to update if we need it */
-    if (t != Type::ASSIGN) {
-        out += lhs->gen_retrieve_code(global_scope, func, true);
+    if (t == Type::ASSIGN) {
+        /* perform basic assignment, no need to alter the rhs */
+        rhs->gen_code(out, global_scope, func, true);
+        lhs->gen_store_code(out, global_scope, func, keep_result);
+        return;
     }
 
-    out += rhs->gen_code(global_scope, func, true);
+    /* get the value to update, the index stays under it for the store */
+    lhs->gen_address_code(out, global_scope, func);
+    lhs->gen_load_code(out);
+
+    rhs->gen_code(out, global_scope, func, true);
 
     switch (t) {
     case Type::ASSIGN:
-        /* perform basic assignment, no need to alter the rhs */
         break;
     case Type::PLUSASSIGN:
         /* updating assignments, operate on the retrieved value */
-        out += std::string("    +") + operand_type[0] + "\n";
+        out.emit(IR::Op::ADD, operand_type.suffix());
         break;
     case Type::MINUSASSIGN:
-        out += std::string("    -") + operand_type[0] + "\n";
+        out.emit(IR::Op::SUB, operand_type.suffix());
         break;
     case Type::STARASSIGN:
-        out += std::string("    *") + operand_type[0] + "\n";
+        out.emit(IR::Op::MUL, operand_type.suffix());
         break;
     case Type::SLASHASSIGN:
-        out += std::string("    /") + operand_type[0] + "\n";
+        out.emit(IR::Op::DIV, operand_type.suffix());
         break;
     }
 
-    out += lhs->gen_store_code(global_scope, func, keep_result);
-    return out;
+    lhs->gen_update_code(out, keep_result);
+}
+
+void AST::AssignmentExpression::reserve(IR::ConstPool& pool) {
+    lhs->reserve(pool);
+    rhs->reserve(pool);
 }
 
-void AST::AssignmentExpression::reserve(AST::Program* prg) {
-    lhs->reserve(prg);
-    rhs->reserve(prg);
+AST::Expression* AST::AssignmentExpression::fold(FoldContext& ctx) {
+    lhs->fold(ctx);
+    rhs = rhs->fold(ctx);
+    return this;
 }
 
 /* IncDecExpresion */
 AST::IncDecExpression::IncDecExpression(location loc, LValue* operand, Type t, bool is_pre)
     : Expression(loc), operand(operand), t(t), is_pre(is_pre) {}
 
-void AST::IncDecExpression::write() {
-    std::cout << "<IncDecExpression type=" << (int) t << " is_pre=" << is_pre << ">\n";
-    operand->write();
-    std::cout << "</IncDecExpression>\n";
+void AST::IncDecExpression::write(std::ostream& out) {
+    out << "<IncDecExpression type=" << (int) t << " is_pre=" << is_pre << ">\n";
+    operand->write(out);
+    out << "</IncDecExpression>\n";
 }
 
-std::string AST::IncDecExpression::type(Scope* global_scope, Function* func) {
-    std::string operand_type = operand->type(global_scope, func);
+AST::Type AST::IncDecExpression::infer_type(Scope* global_scope, Function* func) {
+    AST::Type operand_type = operand->type(global_scope, func);
 
-    if (operand_type != "char" && operand_type != "int" && operand_type != "float") {
+    if (operand_type != types::CHAR && operand_type != types::INT && operand_type != types::FLOAT) {
         throw yy::parser::syntax_error(loc, "invalid type to increment/decrement: " + operand_type);
     }
 
     return operand_type;
 }
 
-void AST::IncDecExpression::reserve(AST::Program* prg) {
-    operand->reserve(prg);
+void AST::IncDecExpression::reserve(IR::ConstPool& pool) {
+    operand->reserve(pool);
 }
 
-std::string AST::IncDecExpression::gen_code(Scope* global_scope, Function* func, bool keep_result) {
+void AST::IncDecExpression::gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result) {
     /* increment / decrement operation */
     /* we will always update the lvalue, so, first we retrieve the contents */
-    std::string out = operand->gen_retrieve_code(global_scope, func, true);
+    operand->gen_address_code(out, global_scope, func);
+    operand->gen_load_code(out);
 
-    /* now, the stack contains the value to be modified. */
+    /* now, the stack contains the value to be modified, above its index if it has one. */
 
-    /* if we're keeping the returned value then we'll copy it before performing the store
-     * if it's a pre-operation then we copy after the op
-     * it it's a post-operation then we copy before the op */
+    /* if we're keeping the returned value then we'll save it under the index
+     * if it's a pre-operation then we save after the op
+     * it it's a post-operation then we save before the op */
 
     if (keep_result && !is_pre) {
-        out += "    copy\n";
+        operand->gen_save_code(out);
     }
 
     /* perform the operation */
-    out += std::string("    ") + ((t == Type::INCR) ? "++" : "--") + operand->var->base_type[0] + "\n";
-
-    if (keep_result && is_pre) {
-        out += "    copy\n";
-    }
+    out.emit((t == Type::INCR) ? IR::Op::INC : IR::Op::DEC, operand->var->base_type.suffix());
 
     /* now, we store the top and then if there is a return value it will be under it. */
-    out += operand->gen_store_code(global_scope, func, false);
+    operand->gen_update_code(out, keep_result && is_pre);
+}
 
-    return out;
+AST::Expression* AST::IncDecExpression::fold(FoldContext& ctx) {
+    operand->fold(ctx);
+    return this;
 }
 
 /* UnaryOpExpresion */
 AST::UnaryOpExpression::UnaryOpExpression(location loc, Expression* operand, Type t)
     : Expression(loc), operand(operand), t(t) {}
 
-void AST::UnaryOpExpression::write() {
-    std::cout << "<UnaryOpExpression type=" << (int) t << ">\n";
-    operand->write();
-    std::cout << "</UnaryOpExpression>\n";
+void AST::UnaryOpExpression::write(std::ostream& out) {
+    out << "<UnaryOpExpression type=" << (int) t << ">\n";
+    operand->write(out);
+    out << "</UnaryOpExpression>\n";
 }
 
-std::string AST::UnaryOpExpression::type(Scope* global_scope, Function* func) {
-    std::string operand_type = operand->type(global_scope, func);
+AST::Type AST::UnaryOpExpression::infer_type(Scope* global_scope, Function* func) {
+    AST::Type operand_type = operand->type(global_scope, func);
 
-    if (operand_type != "char" && operand_type != "int" && operand_type != "float") {
+    if (operand_type != types::CHAR && operand_type != types::INT && operand_type != types::FLOAT) {
         throw yy::parser::syntax_error(loc, "invalid type '" + operand_type + "' to unary operator");
     }
 
@@ -451,73 +692,118 @@ std::string AST::UnaryOpExpression::type(Scope* global_scope, Function* func) {
     case Type::MINUS:
         return operand_type;
     case Type::BANG:
-        return "char";
+        return types::CHAR;
     case Type::TILDE:
-        if (operand_type == "float") {
+        if (operand_type == types::FLOAT) {
             throw yy::parser::syntax_error(loc, "unary '~' cannot be used on float types");
         }
         return operand_type;
     }
 
-    return "NOTYPE";
+    return types::NOTYPE;
 }
 
-void AST::UnaryOpExpression::reserve(AST::Program* prg) {
-    operand->reserve(prg);
+void AST::UnaryOpExpression::reserve(IR::ConstPool& pool) {
+    operand->reserve(pool);
 }
 
-std::string AST::UnaryOpExpression::gen_code(Scope* global_scope, Function* func, bool keep_result) {
+void AST::UnaryOpExpression::gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result) {
     /* we MUST evaluate the operand. */
     /* if we stop too early, then ~(foo(2)) will never call foo() */
 
-    std::string out = operand->gen_code(global_scope, func, keep_result);
-
-    /* 
+    /*
      * however we can do some funky logic.
      * we only need the result from the operand code if we need a result from our operation.
      */
 
-    std::string tmp_label, tmp_label2; /* for unary ! */
-    std::string operand_type = operand->type(global_scope, func);
+    AST::Type operand_type = operand->result_type;
 
-    if (!keep_result) return out;
+    if (!keep_result) {
+        operand->gen_code(out, global_scope, func, false);
+        return;
+    }
 
     switch (t) {
     case Type::MINUS:
-        out += std::string("    neg") + operand_type[0] + "\n";
+        operand->gen_code(out, global_scope, func, true);
+        out.emit(IR::Op::NEG, operand_type.suffix());
         break;
     case Type::BANG:
-        tmp_label = func->make_label();
-        tmp_label2 = func->make_label();
-        out += std::string("    ==0") + operand_type[0] + " " + tmp_label + "\n";
-        out += "    pushv 0x0\n    goto " + tmp_label2 + "\n";
-        out += tmp_label + ":    pushv 0x1\n";
-        out += tmp_label2 + ":";
+        gen_truth_value(this, out, global_scope, func);
         break;
     case Type::TILDE:
-        out += "    flip\n";
+        operand->gen_code(out, global_scope, func, true);
+        out.emit(IR::Op::FLIP);
         break;
     }
+}
+
+void AST::UnaryOpExpression::gen_branch(IR::Buffer& out, Scope* global_scope, Function* func, int true_label, int false_label) {
+    /* !x just swaps the targets */
+    if (t == Type::BANG) {
+        operand->gen_branch(out, global_scope, func, false_label, true_label);
+        return;
+    }
+
+    Expression::gen_branch(out, global_scope, func, true_label, false_label);
+}
+
+AST::Expression* AST::UnaryOpExpression::fold(FoldContext& ctx) {
+    operand = operand->fold(ctx);
+
+    AST::Type operand_type = operand->result_type;
+    uint32_t a;
+
+    if (operand->constant_bits(a)) {
+        switch (t) {
+        case Type::MINUS:
+            if (operand_type == types::FLOAT) return make_constant(ctx, loc, result_type, float_to_word(-word_to_float(a)));
+            return make_constant(ctx, loc, result_type, 0u - a);
+        case Type::BANG:
+            return make_constant(ctx, loc, result_type, is_zero(operand_type, a));
+        case Type::TILDE:
+            return make_constant(ctx, loc, result_type, ~a);
+        }
+    }
+
+    /* !!c becomes c, and !(a < b) becomes a >= b */
+    if (t == Type::BANG) {
+        AST::Expression* e = operand->negate(ctx);
+        if (e) return replace(ctx, e);
+    }
+
+    return this;
+}
+
+bool AST::UnaryOpExpression::is_pure() {
+    return operand->is_pure();
+}
+
+bool AST::UnaryOpExpression::is_boolean() {
+    return t == Type::BANG;
+}
 
-    return out;
+AST::Expression* AST::UnaryOpExpression::negate(FoldContext& ctx) {
+    if (t != Type::BANG) return NULL;
+    return make_truth(ctx, operand);
 }
 
 /* BinaryOpExpresion */
 AST::BinaryOpExpression::BinaryOpExpression(location loc, Expression* lhs, Expression* rhs, Type t)
     : Expression(loc), lhs(lhs), rhs(rhs), t(t) {}
 
-void AST::BinaryOpExpression::write() {
-    std::cout << "<BinaryOpExpression type=" << (int) t << ">\n";
-    std::cout << "(lhs)\n";
-    lhs->write();
-    std::cout << "(rhs)\n";
-    rhs->write();
-    std::cout << "</BinaryOpExpression>\n";
+void AST::BinaryOpExpression::write(std::ostream& out) {
+    out << "<BinaryOpExpression type=" << (int) t << ">\n";
+    out << "(lhs)\n";
+    lhs->write(out);
+    out << "(rhs)\n";
+    rhs->write(out);
+    out << "</BinaryOpExpression>\n";
 }
 
-std::string AST::BinaryOpExpression::type(Scope* global_scope, Function* func) {
-    std::string lhs_type = lhs->type(global_scope, func);
-    std::string rhs_type = rhs->type(global_scope, func);
+AST::Type AST::BinaryOpExpression::infer_type(Scope* global_scope, Function* func) {
+    AST::Type lhs_type = lhs->type(global_scope, func);
+    AST::Type rhs_type = rhs->type(global_scope, func);
 
     if (lhs_type != rhs_type) {
         throw yy::parser::syntax_error(loc, "left-hand binary operand type " + lhs_type + " does not match right-hand type " + rhs_type);
@@ -534,187 +820,285 @@ std::string AST::BinaryOpExpression::type(Scope* global_scope, Function* func) {
     case Type::LE:
     case Type::DPIPE:
     case Type::DAMP:
-        return "char";
+        return types::CHAR;
     default:
         return lhs_type;
     }
 }
 
-void AST::BinaryOpExpression::reserve(AST::Program* prg) {
-    lhs->reserve(prg);
-    rhs->reserve(prg);
+void AST::BinaryOpExpression::reserve(IR::ConstPool& pool) {
+    lhs->reserve(pool);
+    rhs->reserve(pool);
 }
 
-std::string AST::BinaryOpExpression::gen_code(Scope* global_scope, Function* func, bool keep_result) {
+/* the conditional jump for a comparison operator, and the one taken when it doesn't hold */
+static IR::Op compare_op(AST::BinaryOpExpression::Type t) {
+    typedef AST::BinaryOpExpression::Type Op;
+
+    switch (t) {
+    case Op::NEQUAL: return IR::Op::BNE;
+    case Op::GT:     return IR::Op::BGT;
+    case Op::GE:     return IR::Op::BGE;
+    case Op::LT:     return IR::Op::BLT;
+    case Op::LE:     return IR::Op::BLE;
+    default:         return IR::Op::BEQ;
+    }
+}
+
+static IR::Op inverse_compare_op(AST::BinaryOpExpression::Type t) {
+    typedef AST::BinaryOpExpression::Type Op;
+
+    switch (t) {
+    case Op::NEQUAL: return IR::Op::BEQ;
+    case Op::GT:     return IR::Op::BLE;
+    case Op::GE:     return IR::Op::BLT;
+    case Op::LT:     return IR::Op::BGE;
+    case Op::LE:     return IR::Op::BGT;
+    default:         return IR::Op::BNE;
+    }
+}
+
+void AST::BinaryOpExpression::gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result) {
     /*
-     * the logic for short-circuiting operations is so different from the others, we just
-     * make a seperate case for codegen and return early.
+     * comparisons and short-circuiting operations are generated as branches.
+     * their value is only computed when somebody uses it
      */
 
-    std::string out;
-    std::string tmp_label, tmp_label2; /* labels used by comparators */
-
     if (t == Type::DPIPE || t == Type::DAMP) {
-        /* specialized generation for shortcircuiting ops */
-        /* eval LHS no matter what */
-        out += lhs->gen_code(global_scope, func, true);
-
-        switch (t) {
-            case Type::DPIPE:
-                /* we need one label for positive results, and one label as a post-operation */
-                /* if lhs result is nonzero, we push 1 and stop. */
-                /* if lhs result is zero, we check the result of the rhs */
-                tmp_label = func->make_label(); /* post-expr label */
-                tmp_label2 = func->make_label();
-                out += std::string("    !=0") + operand_type[0] + " " + tmp_label + "\n";
-                out += rhs->gen_code(global_scope, func, true);
-                out += std::string("    !=0") + operand_type[0] + " " + tmp_label + "\n";
-                out += "    pushv 0x0\n";
-                out += std::string("    goto ") + tmp_label2 + "\n";
-                out += tmp_label + ":    pushv 0x1\n";
-                out += tmp_label2 + ":";
-                break;
-            case Type::DAMP:
-                /* short-circuiting AND works in the same way. we just flip the conditions */
-                tmp_label = func->make_label(); /* post-expr label */
-                tmp_label2 = func->make_label();
-                out += std::string("    ==0") + operand_type[0] + " " + tmp_label + "\n";
-                out += rhs->gen_code(global_scope, func, true);
-                out += std::string("    ==0") + operand_type[0] + " " + tmp_label + "\n";
-                out += "    pushv 0x1\n";
-                out += std::string("    goto ") + tmp_label2 + "\n";
-                out += tmp_label + ":    pushv 0x0\n";
-                out += tmp_label2 + ":";
-                break;
-            default:
-                break;
+        if (keep_result) {
+            gen_truth_value(this, out, global_scope, func);
+            return;
         }
 
-        return out;
+        /* only the side effects matter, both outcomes end up in the same place */
+        int post_label = func->make_label();
+        gen_branch(out, global_scope, func, post_label, FALL_THROUGH);
+        out.emit_label(post_label);
+        return;
     }
 
     /* non-shortcircuiting ops */
 
-    out = lhs->gen_code(global_scope, func, keep_result);
-    out += rhs->gen_code(global_scope, func, keep_result);
+    if (keep_result && is_boolean()) {
+        gen_truth_value(this, out, global_scope, func);
+        return;
+    }
 
-    if (!keep_result) return out;
+    lhs->gen_code(out, global_scope, func, keep_result);
+    rhs->gen_code(out, global_scope, func, keep_result);
 
-    /* 
-     * it would be nice to use the goto labels for expression directly, but
-     * we need to be able to evaluate binary comparisons to the correct value (char)
-     * so, we just make labels and push constants which looks ugly, but
-     * results in correct code
-     */
+    if (!keep_result) return;
 
     switch (t) {
-    case Type::EQUALS:
-        /* push a 1 if the operands are equal */
-        tmp_label = func->make_label();
-        tmp_label2 = func->make_label();
-        out += std::string("    ==") + operand_type[0] + " " + tmp_label + "\n";
-        out += "    pushv 0x0\n";
-        out += "    goto " + tmp_label2 + "\n";
-        out += tmp_label + ":    pushv 0x1\n";
-        out += tmp_label2 + ":";
+    case Type::PLUS:
+        out.emit(IR::Op::ADD, operand_type.suffix());
         break;
-    case Type::NEQUAL:
-        /* push a 1 if the operands are not equal */
-        /* same as equal, we just change the operator */
-        tmp_label = func->make_label();
-        tmp_label2 = func->make_label();
-        out += std::string("    !=") + operand_type[0] + " " + tmp_label + "\n";
-        out += "    pushv 0x0\n";
-        out += "    goto " + tmp_label2 + "\n";
-        out += tmp_label + ":    pushv 0x1\n";
-        out += tmp_label2 + ":";
+    case Type::MINUS:
+        out.emit(IR::Op::SUB, operand_type.suffix());
         break;
-    case Type::GT:
-        tmp_label = func->make_label();
-        tmp_label2 = func->make_label();
-        out += std::string("    >") + operand_type[0] + " " + tmp_label + "\n";
-        out += "    pushv 0x0\n";
-        out += "    goto " + tmp_label2 + "\n";
-        out += tmp_label + ":    pushv 0x1\n";
-        out += tmp_label2 + ":";
+    case Type::STAR:
+        out.emit(IR::Op::MUL, operand_type.suffix());
         break;
-    case Type::GE:
-        tmp_label = func->make_label();
-        tmp_label2 = func->make_label();
-        out += std::string("    >=") + operand_type[0] + " " + tmp_label + "\n";
-        out += "    pushv 0x0\n";
-        out += "    goto " + tmp_label2 + "\n";
-        out += tmp_label + ":    pushv 0x1\n";
-        out += tmp_label2 + ":";
+    case Type::SLASH:
+        out.emit(IR::Op::DIV, operand_type.suffix());
         break;
-    case Type::LT:
-        tmp_label = func->make_label();
-        tmp_label2 = func->make_label();
-        out += std::string("    <") + operand_type[0] + " " + tmp_label + "\n";
-        out += "    pushv 0x0\n";
-        out += "    goto " + tmp_label2 + "\n";
-        out += tmp_label + ":    pushv 0x1\n";
-        out += tmp_label2 + ":";
+    case Type::MOD:
+        out.emit(IR::Op::MOD, operand_type.suffix());
         break;
-    case Type::LE:
-        tmp_label = func->make_label();
-        tmp_label2 = func->make_label();
-        out += std::string("    <=") + operand_type[0] + " " + tmp_label + "\n";
-        out += "    pushv 0x0\n";
-        out += "    goto " + tmp_label2 + "\n";
-        out += tmp_label + ":    pushv 0x1\n";
-        out += tmp_label2 + ":";
+    case Type::AMP:
+        out.emit(IR::Op::AND);
         break;
-    case Type::DPIPE:
+    case Type::PIPE:
+        out.emit(IR::Op::OR);
+        break;
+    default:
+        throw yy::parser::syntax_error(loc, "unexpected codepath, value codegen for conditional operation");
+    }
+}
+
+void AST::BinaryOpExpression::gen_branch(IR::Buffer& out, Scope* global_scope, Function* func, int true_label, int false_label) {
+    int skip_label, taken_label;
+
+    switch (t) {
     case Type::DAMP:
-        throw yy::parser::syntax_error(loc, "unexpected codepath, standard codegen for shortcircuiting operation");
+        /* if the lhs fails we're done, otherwise the rhs decides */
+        skip_label = (false_label == FALL_THROUGH) ? func->make_label() : false_label;
+        lhs->gen_branch(out, global_scope, func, FALL_THROUGH, skip_label);
+        rhs->gen_branch(out, global_scope, func, true_label, false_label);
+        if (false_label == FALL_THROUGH) out.emit_label(skip_label);
+        break;
+    case Type::DPIPE:
+        /* if the lhs holds we're done, otherwise the rhs decides */
+        skip_label = (true_label == FALL_THROUGH) ? func->make_label() : true_label;
+        lhs->gen_branch(out, global_scope, func, skip_label, FALL_THROUGH);
+        rhs->gen_branch(out, global_scope, func, true_label, false_label);
+        if (true_label == FALL_THROUGH) out.emit_label(skip_label);
+        break;
+    case Type::EQUALS:
+    case Type::NEQUAL:
+    case Type::GT:
+    case Type::GE:
+    case Type::LT:
+    case Type::LE:
+        lhs->gen_code(out, global_scope, func, true);
+        rhs->gen_code(out, global_scope, func, true);
+
+        if (true_label != FALL_THROUGH) {
+            out.emit_jump(compare_op(t), true_label, operand_type.suffix());
+            if (false_label != FALL_THROUGH) out.emit_jump(IR::Op::GOTO, false_label);
+        } else if (operand_type != types::FLOAT) {
+            out.emit_jump(inverse_compare_op(t), false_label, operand_type.suffix());
+        } else {
+            /* comparisons with NaN are false both ways, so float comparisons can't be inverted */
+            taken_label = func->make_label();
+            out.emit_jump(compare_op(t), taken_label, operand_type.suffix());
+            out.emit_jump(IR::Op::GOTO, false_label);
+            out.emit_label(taken_label);
+        }
+        break;
+    default:
+        Expression::gen_branch(out, global_scope, func, true_label, false_label);
+        break;
+    }
+}
+
+AST::Expression* AST::BinaryOpExpression::fold(FoldContext& ctx) {
+    lhs = lhs->fold(ctx);
+    rhs = rhs->fold(ctx);
+
+    uint32_t a = 0, b = 0, r;
+    bool lconst = lhs->constant_bits(a), rconst = rhs->constant_bits(b);
+
+    if (lconst && rconst && eval_binary(t, operand_type, a, b, r)) {
+        return make_constant(ctx, loc, result_type, r);
+    }
+
+    /*
+     * algebraic identities. an operand may only be dropped if it is pure,
+     * and float identities must also hold for -0.0, infinities and NaN
+     */
+    bool is_float = (operand_type == types::FLOAT);
+    uint32_t one = is_float ? float_to_word(1.0f) : 1;
+
+    switch (t) {
     case Type::PLUS:
-        out += std::string("    +") + operand_type[0] + "\n";
+        if (is_float) break;
+        if (rconst && b == 0) return replace(ctx, lhs);
+        if (lconst && a == 0) return replace(ctx, rhs);
         break;
     case Type::MINUS:
-        out += std::string("    -") + operand_type[0] + "\n";
+        /* x - +0.0 is exact for every float, x + 0.0 is not */
+        if (rconst && b == 0) return replace(ctx, lhs);
+        if (!is_float && lhs->named_variable() && lhs->named_variable() == rhs->named_variable()) {
+            return make_constant(ctx, loc, result_type, 0);
+        }
         break;
     case Type::STAR:
-        out += std::string("    *") + operand_type[0] + "\n";
+        if (rconst && b == one) return replace(ctx, lhs);
+        if (lconst && a == one) return replace(ctx, rhs);
+        if (is_float) break;
+        if ((rconst && b == 0 && lhs->is_pure()) || (lconst && a == 0 && rhs->is_pure())) {
+            return make_constant(ctx, loc, result_type, 0);
+        }
         break;
     case Type::SLASH:
-        out += std::string("    /") + operand_type[0] + "\n";
-        break;
-    case Type::MOD:
-        out += std::string("    %") + operand_type[0] + "\n";
+        if (rconst && b == one) return replace(ctx, lhs);
         break;
     case Type::AMP:
-        out += std::string("    &\n");
+        if (is_float) break;
+        if (rconst && b == ~0u) return replace(ctx, lhs);
+        if (lconst && a == ~0u) return replace(ctx, rhs);
+        if ((rconst && b == 0 && lhs->is_pure()) || (lconst && a == 0 && rhs->is_pure())) {
+            return make_constant(ctx, loc, result_type, 0);
+        }
         break;
     case Type::PIPE:
-        out += std::string("    |\n");
+        if (is_float) break;
+        if (rconst && b == 0) return replace(ctx, lhs);
+        if (lconst && a == 0) return replace(ctx, rhs);
+        break;
+    case Type::DAMP:
+    case Type::DPIPE:
+        {
+            /* the operand value which decides the result without looking at the other one */
+            bool decisive = (t == Type::DPIPE);
+
+            if (lconst) {
+                if (!is_zero(operand_type, a) == decisive) return make_constant(ctx, loc, result_type, decisive);
+                return replace(ctx, make_truth(ctx, rhs));
+            }
+
+            if (rconst) {
+                if (!is_zero(operand_type, b) != decisive) return replace(ctx, make_truth(ctx, lhs));
+                if (lhs->is_pure()) return make_constant(ctx, loc, result_type, decisive);
+            }
+        }
+        break;
+    default:
         break;
     }
 
-    return out;
+    return this;
+}
+
+bool AST::BinaryOpExpression::is_pure() {
+    /* division may trap */
+    if (t == Type::SLASH || t == Type::MOD) return false;
+    return lhs->is_pure() && rhs->is_pure();
+}
+
+bool AST::BinaryOpExpression::is_boolean() {
+    switch (t) {
+    case Type::EQUALS:
+    case Type::NEQUAL:
+    case Type::GT:
+    case Type::GE:
+    case Type::LT:
+    case Type::LE:
+    case Type::DPIPE:
+    case Type::DAMP:
+        return true;
+    default:
+        return false;
+    }
+}
+
+AST::Expression* AST::BinaryOpExpression::negate(FoldContext& ctx) {
+    /* comparisons with NaN are false both ways, so float comparisons can't be flipped */
+    if (operand_type == types::FLOAT) return NULL;
+
+    switch (t) {
+    case Type::EQUALS: t = Type::NEQUAL; return this;
+    case Type::NEQUAL: t = Type::EQUALS; return this;
+    case Type::GT:     t = Type::LE; return this;
+    case Type::GE:     t = Type::LT; return this;
+    case Type::LT:     t = Type::GE; return this;
+    case Type::LE:     t = Type::GT; return this;
+    default:           return NULL;
+    }
 }
 
 /* TernaryOpExpresion */
 AST::TernaryOpExpression::TernaryOpExpression(location loc, Expression* cond, Expression* pos, Expression* neg)
     : Expression(loc), cond(cond), pos(pos), neg(neg) {}
 
-void AST::TernaryOpExpression::write() {
-    std::cout << "<TernaryOpExpression>\n";
-    std::cout << "(cond)\n";
-    cond->write();
-    std::cout << "(pos)\n";
-    pos->write();
-    std::cout << "(neg)\n";
-    neg->write();
-    std::cout << "</TernaryOpExpression>\n";
+void AST::TernaryOpExpression::write(std::ostream& out) {
+    out << "<TernaryOpExpression>\n";
+    out << "(cond)\n";
+    cond->write(out);
+    out << "(pos)\n";
+    pos->write(out);
+    out << "(neg)\n";
+    neg->write(out);
+    out << "</TernaryOpExpression>\n";
 }
 
-std::string AST::TernaryOpExpression::type(Scope* global_scope, Function* func) {
+AST::Type AST::TernaryOpExpression::infer_type(Scope* global_scope, Function* func) {
     cond_type = cond->type(global_scope, func);
-    std::string pos_type = pos->type(global_scope, func);
-    std::string neg_type = neg->type(global_scope, func);
+    AST::Type pos_type = pos->type(global_scope, func);
+    AST::Type neg_type = neg->type(global_scope, func);
 
-    if (cond_type != "char" && cond_type != "int" && cond_type != "float") {
+    if (cond_type != types::CHAR && cond_type != types::INT && cond_type != types::FLOAT) {
         throw yy::parser::syntax_error(loc, "invalid type " + cond_type + " for ternary operator condition");
     }
 
@@ -725,80 +1109,138 @@ std::string AST::TernaryOpExpression::type(Scope* global_scope, Function* func)
     return pos_type;
 }
 
-void AST::TernaryOpExpression::reserve(AST::Program* prg) {
-    cond->reserve(prg);
-    pos->reserve(prg);
-    neg->reserve(prg);
+void AST::TernaryOpExpression::reserve(IR::ConstPool& pool) {
+    cond->reserve(pool);
+    pos->reserve(pool);
+    neg->reserve(pool);
 }
 
-std::string AST::TernaryOpExpression::gen_code(Scope* scope, Function* func, bool keep_result) {
+void AST::TernaryOpExpression::gen_code(IR::Buffer& out, Scope* scope, Function* func, bool keep_result) {
     /* short-circuited ternary op implementation */
     /* eval the condition no matter what */
 
-    std::string output = cond->gen_code(scope, func, true);
-    std::string neg_label = func->make_label(), post_neg_label = func->make_label();
+    int neg_label = func->make_label(), post_neg_label = func->make_label();
+
+    cond->gen_branch(out, scope, func, FALL_THROUGH, neg_label);
+    pos->gen_code(out, scope, func, keep_result);
+    out.emit_jump(IR::Op::GOTO, post_neg_label);
+    out.emit_label(neg_label);
+    neg->gen_code(out, scope, func, keep_result);
+    out.emit_label(post_neg_label);
+}
+
+void AST::TernaryOpExpression::gen_branch(IR::Buffer& out, Scope* global_scope, Function* func, int true_label, int false_label) {
+    /* branch on whichever operand the condition selects */
+    int neg_label = func->make_label(), post_neg_label = FALL_THROUGH;
+
+    /* the positive side can't fall through into the negative side */
+    if (true_label == FALL_THROUGH || false_label == FALL_THROUGH) post_neg_label = func->make_label();
+
+    cond->gen_branch(out, global_scope, func, FALL_THROUGH, neg_label);
+    pos->gen_branch(out, global_scope, func,
+                    (true_label == FALL_THROUGH) ? post_neg_label : true_label,
+                    (false_label == FALL_THROUGH) ? post_neg_label : false_label);
+    out.emit_label(neg_label);
+    neg->gen_branch(out, global_scope, func, true_label, false_label);
+
+    if (post_neg_label != FALL_THROUGH) out.emit_label(post_neg_label);
+}
+
+AST::Expression* AST::TernaryOpExpression::fold(FoldContext& ctx) {
+    cond = cond->fold(ctx);
+    pos = pos->fold(ctx);
+    neg = neg->fold(ctx);
+
+    uint32_t c;
+    if (cond->constant_bits(c)) return replace(ctx, is_zero(cond_type, c) ? neg : pos);
 
-    output += std::string("    ==0") + cond_type[0] + " " + neg_label + "\n";
-    output += pos->gen_code(scope, func, keep_result);
-    output += std::string("    goto ") + post_neg_label + "\n";
-    output += neg_label + ":";
-    output += neg->gen_code(scope, func, keep_result);
-    output += post_neg_label + ":";
+    return this;
+}
 
-    return output;
+bool AST::TernaryOpExpression::is_pure() {
+    return cond->is_pure() && pos->is_pure() && neg->is_pure();
 }
 
 /* CastExpresion */
-AST::CastExpression::CastExpression(location loc, std::string cast_type, Expression* rhs)
+AST::CastExpression::CastExpression(location loc, AST::Type cast_type, Expression* rhs)
     : Expression(loc), cast_type(cast_type), rhs(rhs) {}
 
-void AST::CastExpression::write() {
-    std::cout << "<CastExpression type=" << cast_type << ">\n";
-    rhs->write();
-    std::cout << "</CastExpression>\n";
+void AST::CastExpression::write(std::ostream& out) {
+    out << "<CastExpression type=" << cast_type << ">\n";
+    rhs->write(out);
+    out << "</CastExpression>\n";
 }
 
-std::string AST::CastExpression::type(Scope* global_scope, Function* func) {
-    std::string oper_type = rhs->type(global_scope, func);
-
-    if (cast_type == "char") {
-        if (oper_type == "char") return cast_type;
-        if (oper_type == "int") return cast_type;
-        if (oper_type == "float") return cast_type;
-    } else if (cast_type == "int") {
-        if (oper_type == "char") return cast_type;
-        if (oper_type == "int") return cast_type;
-        if (oper_type == "float") return cast_type;
-    } else if (cast_type == "float") {
-        if (oper_type == "char") return cast_type;
-        if (oper_type == "int") return cast_type;
-        if (oper_type == "float") return cast_type;
+AST::Type AST::CastExpression::infer_type(Scope* global_scope, Function* func) {
+    AST::Type oper_type = rhs->type(global_scope, func);
+
+    if (cast_type == types::CHAR) {
+        if (oper_type == types::CHAR) return cast_type;
+        if (oper_type == types::INT) return cast_type;
+        if (oper_type == types::FLOAT) return cast_type;
+    } else if (cast_type == types::INT) {
+        if (oper_type == types::CHAR) return cast_type;
+        if (oper_type == types::INT) return cast_type;
+        if (oper_type == types::FLOAT) return cast_type;
+    } else if (cast_type == types::FLOAT) {
+        if (oper_type == types::CHAR) return cast_type;
+        if (oper_type == types::INT) return cast_type;
+        if (oper_type == types::FLOAT) return cast_type;
     }
 
     throw yy::parser::syntax_error(loc, "cannot cast " + oper_type + " to " + cast_type);
-    return "NOTYPE";
+    return types::NOTYPE;
 }
 
-std::string AST::CastExpression::gen_code(Scope* global_scope, Function* func, bool keep_result) {
+void AST::CastExpression::gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result) {
     /* we have a nested expression, so we must evaluate it regardless of whether we're keeping the result */
-    std::string out = rhs->gen_code(global_scope, func, keep_result);
-    if (!keep_result) return out;
+    rhs->gen_code(out, global_scope, func, keep_result);
+    if (!keep_result) return;
 
-    std::string oper_type = rhs->type(global_scope, func);
+    AST::Type oper_type = rhs->result_type;
 
     /* many of the casts can be no-ops */
-    if (cast_type == "char") {
-        if (oper_type == "float") out += "    convfi\n";
-    } else if (cast_type == "int") {
-        if (oper_type == "float") out += "    convfi\n";
-    } else if (cast_type == "float") {
-        if (oper_type == "char") out += "    convif\n";
-        if (oper_type == "int") out += "    convif\n";
+    if (cast_type == types::CHAR) {
+        if (oper_type == types::FLOAT) out.emit(IR::Op::CONVFI);
+    } else if (cast_type == types::INT) {
+        if (oper_type == types::FLOAT) out.emit(IR::Op::CONVFI);
+    } else if (cast_type == types::FLOAT) {
+        if (oper_type == types::CHAR) out.emit(IR::Op::CONVIF);
+        if (oper_type == types::INT) out.emit(IR::Op::CONVIF);
+    }
+}
+
+void AST::CastExpression::reserve(IR::ConstPool& pool) {
+    rhs->reserve(pool);
+}
+
+AST::Expression* AST::CastExpression::fold(FoldContext& ctx) {
+    rhs = rhs->fold(ctx);
+
+    AST::Type oper_type = rhs->result_type;
+    uint32_t a;
+
+    if (rhs->constant_bits(a)) {
+        if (cast_type == types::FLOAT && oper_type != types::FLOAT) {
+            return make_constant(ctx, loc, cast_type, float_to_word((float) (int32_t) a));
+        }
+
+        if (cast_type != types::FLOAT && oper_type == types::FLOAT) {
+            /* out of range conversions are left to the VM */
+            float f = word_to_float(a);
+            if (!(f >= -2147483648.0f && f < 2147483648.0f)) return this;
+            return make_constant(ctx, loc, cast_type, (uint32_t) (int32_t) f);
+        }
+
+        return make_constant(ctx, loc, cast_type, a);
     }
 
-    return out;
+    /* same-type casts generate no code */
+    if (oper_type == cast_type) return replace(ctx, rhs);
+
+    return this;
 }
 
-void AST::CastExpression::reserve(AST::Program* prg) {
-    rhs->reserve(prg);
+bool AST::CastExpression::is_pure() {
+    return rhs->is_pure();
 }
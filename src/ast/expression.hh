@@ -1,5 +1,7 @@
 #pragma once
 #include "node.hh"
+#include "../ir/buffer.hh"
+#include "../ir/constpool.hh"
 
 namespace AST {
     class Scope;
@@ -7,38 +9,111 @@ namespace AST {
     class Program;
     class Variable;
 
+    /* state shared by the constant folding pass */
+    struct FoldContext {
+        util::Arena& arena;
+        int folded; /* number of expressions replaced */
+    };
+
+    /* passed to gen_branch() for the outcome which continues with the next instruction */
+    const int FALL_THROUGH = -1;
+
     class Expression : public Node {
     public:
         Expression(location);
-        virtual std::string type(Scope* global_scope, Function* func);
-        virtual void reserve(AST::Program* prg);
+
+        /*
+         * type()
+         *
+         * check the expression and return its type. the type is inferred on the
+         * first call and recorded in 'result_type', so later calls don't walk the subtree again
+         */
+
+        AST::Type type(Scope* global_scope, Function* func);
+        virtual AST::Type infer_type(Scope* global_scope, Function* func);
+        virtual void reserve(IR::ConstPool& pool);
 
         /*
          * gen_code()
          *
-         * generate code for an expression
+         * generate code for an expression into the instruction buffer 'out'
          * the value of the expression is always pushed onto the stack.
          *
          * this eliminates any need for temporary variables
          * keep_result determines if an evaluation result should be left on the stack
+         *
+         * code generation never re-checks a subtree. it only reads the annotations
+         * left by the type checker: result_type, and the resolved var/f pointers
+         */
+
+        virtual void gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result);
+
+        /*
+         * gen_branch()
+         *
+         * generate code for an expression in a condition. nothing is left on the
+         * stack: control goes to true_label if the value is nonzero, otherwise to
+         * false_label. at most one of them may be FALL_THROUGH.
+         *
+         * comparisons and logical operators jump directly instead of computing a 0 or 1
          */
 
-        virtual std::string gen_code(Scope* global_scope, Function* func, bool keep_result);
+        virtual void gen_branch(IR::Buffer& out, Scope* global_scope, Function* func, int true_label, int false_label);
+
+        /*
+         * fold()
+         *
+         * fold the constant subtrees of a type-checked expression and return the
+         * expression which should take its place, which is often just 'this'.
+         * replacements are built in the arena and carry the same result_type
+         */
+
+        virtual Expression* fold(FoldContext& ctx);
+
+        /* the 32-bit word a literal scalar evaluates to, if this is one */
+        virtual bool constant_bits(uint32_t& bits);
+
+        /* true if evaluating the expression has no side effects and cannot trap */
+        virtual bool is_pure();
+
+        /* true if the expression always evaluates to 0 or 1 */
+        virtual bool is_boolean();
+
+        /* turn the expression into its logical negation and return it, or return NULL if that costs code */
+        virtual Expression* negate(FoldContext& ctx);
+
+        /* the variable a plain scalar identifier names, NULL for anything else */
+        virtual Variable* named_variable();
+
+        /* final type of the expression, set by type() */
+        AST::Type result_type;
+        bool typed = false;
     };
 
     class LValue : public Node {
     public:
-        LValue(location, std::string name, Expression* expr = NULL);
+        LValue(location, util::Atom name, Expression* expr = NULL);
 
-        std::string type(Scope* global_scope, Function* func);
-        void write();
-        void reserve(AST::Program* prg);
+        AST::Type type(Scope* global_scope, Function* func);
+        void write(std::ostream& out);
+        void reserve(IR::ConstPool& pool);
+        void fold(FoldContext& ctx);
 
         /* LValue code gen works a little differently -- we only generate code elsewhere when we need to store something in one */
-        std::string gen_store_code(Scope* global_scope, Function* func, bool keep_result);
-        std::string gen_retrieve_code(Scope* global_scope, Function* func, bool keep_result);
+        void gen_store_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result);
+
+        /*
+         * read-modify-write, so an index is only evaluated once: gen_address_code
+         * pushes the element index (nothing for a scalar), gen_load_code pushes the
+         * value and leaves the index under it, gen_save_code copies the top value
+         * under the index and gen_update_code stores the top value, popping the index
+         */
+        void gen_address_code(IR::Buffer& out, Scope* global_scope, Function* func);
+        void gen_load_code(IR::Buffer& out);
+        void gen_save_code(IR::Buffer& out);
+        void gen_update_code(IR::Buffer& out, bool keep_result);
 
-        std::string name;
+        util::Atom name;
         Expression* expr;
         Variable* var;
     };
@@ -47,103 +122,116 @@ namespace AST {
     public:
         IntConst(location, int);
 
-        void write();
-        std::string type(Scope* global_scope, Function* func);
+        void write(std::ostream& out);
+        AST::Type infer_type(Scope* global_scope, Function* func);
 
-        void reserve(AST::Program* prg);
-        std::string gen_code(Scope* global_scope, Function* func, bool keep_result);
+        void reserve(IR::ConstPool& pool);
+        void gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result);
+        bool constant_bits(uint32_t& bits);
+        bool is_pure();
 
         int n;
-        std::string code_location;
+        IR::Slot code_location;
     };
 
     class RealConst : public Expression {
     public:
         RealConst(location, double);
 
-        void write();
-        std::string type(Scope* global_scope, Function* func);
-        void reserve(AST::Program* prg);
-        std::string gen_code(Scope* global_scope, Function* func, bool keep_result);
+        void write(std::ostream& out);
+        AST::Type infer_type(Scope* global_scope, Function* func);
+        void reserve(IR::ConstPool& pool);
+        void gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result);
+        bool constant_bits(uint32_t& bits);
+        bool is_pure();
 
         double n;
-        std::string code_location;
+        IR::Slot code_location;
     };
 
     class StrConst : public Expression {
     public:
         StrConst(location, std::string);
 
-        void write();
-        std::string type(Scope* global_scope, Function* func);
-        void reserve(AST::Program* prg);
-        std::string gen_code(Scope* global_scope, Function* func, bool keep_result);
+        void write(std::ostream& out);
+        AST::Type infer_type(Scope* global_scope, Function* func);
+        void reserve(IR::ConstPool& pool);
+        void gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result);
+        bool is_pure();
 
         std::string val;
-        std::string code_location;
+        IR::Slot code_location;
     };
 
     class CharConst : public Expression {
     public:
         CharConst(location, char);
 
-        void write();
-        std::string type(Scope* global_scope, Function* func);
-        void reserve(AST::Program* prg);
-        std::string gen_code(Scope* global_scope, Function* func, bool keep_result);
+        void write(std::ostream& out);
+        AST::Type infer_type(Scope* global_scope, Function* func);
+        void reserve(IR::ConstPool& pool);
+        void gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result);
+        bool constant_bits(uint32_t& bits);
+        bool is_pure();
 
         char val;
-        std::string code_location;
+        IR::Slot code_location;
     };
 
     class IdentifierExpression : public Expression {
     public:
-        IdentifierExpression(location, std::string name);
+        IdentifierExpression(location, util::Atom name);
 
-        void write();
-        std::string type(Scope* global_scope, Function* func);
-        std::string gen_code(Scope* global_scope, Function* func, bool keep_result);
+        void write(std::ostream& out);
+        AST::Type infer_type(Scope* global_scope, Function* func);
+        void gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result);
+        bool is_pure();
+        Variable* named_variable();
 
-        std::string name;
+        util::Atom name;
         Variable* var;
     };
 
     class AddressExpression : public Expression {
     public:
-        AddressExpression(location, std::string name);
+        AddressExpression(location, util::Atom name);
 
-        void write();
-        std::string type(Scope* global_scope, Function* func);
-        std::string gen_code(Scope* global_scope, Function* func, bool keep_result);
+        void write(std::ostream& out);
+        AST::Type infer_type(Scope* global_scope, Function* func);
+        void gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result);
+        bool is_pure();
 
-        std::string name;
+        util::Atom name;
         Variable* var;
     };
 
     class IndexExpression : public Expression {
     public:
-        IndexExpression(location, std::string name, Expression* ind);
+        IndexExpression(location, util::Atom name, Expression* ind);
 
-        void write();
-        std::string type(Scope* global_scope, Function* func);
-        std::string gen_code(Scope* global_scope, Function* func, bool keep_result);
-        void reserve(AST::Program* prg);
+        void write(std::ostream& out);
+        AST::Type infer_type(Scope* global_scope, Function* func);
+        void gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result);
+        void reserve(IR::ConstPool& pool);
+        Expression* fold(FoldContext& ctx);
+        bool is_pure();
 
-        std::string name;
+        util::Atom name;
         Expression* ind;
         Variable* var;
     };
 
     class CallExpression : public Expression {
     public:
-        CallExpression(location, std::string name, std::vector<Expression*> args);
+        CallExpression(location, util::Atom name, std::vector<Expression*> args);
 
-        void write();
-        std::string type(Scope* global_scope, Function* func);
-        std::string gen_code(Scope* global_scope, Function* func, bool keep_result);
-        void reserve(AST::Program* prg);
+        void write(std::ostream& out);
+        AST::Type infer_type(Scope* global_scope, Function* func);
+        void gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result);
+        void reserve(IR::ConstPool& pool);
+        Expression* fold(FoldContext& ctx);
 
-        std::string name;
+        util::Atom name;
         std::vector<Expression*> args;
 
         Function* f;
@@ -161,15 +249,16 @@ namespace AST {
 
         AssignmentExpression(location, LValue* lhs, Type t, Expression* rhs);
 
-        void write();
-        std::string type(Scope* global_scope, Function* func);
-        std::string gen_code(Scope* global_scope, Function* func, bool keep_result);
-        void reserve(AST::Program* prg);
+        void write(std::ostream& out);
+        AST::Type infer_type(Scope* global_scope, Function* func);
+        void gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result);
+        void reserve(IR::ConstPool& pool);
+        Expression* fold(FoldContext& ctx);
 
         LValue* lhs;
         Type t;
         Expression* rhs;
-        std::string operand_type;
+        AST::Type operand_type;
     };
 
     class IncDecExpression : public Expression {
@@ -181,10 +270,11 @@ namespace AST {
 
         IncDecExpression(location, LValue* operand, Type t, bool op_on_left);
 
-        void write();
-        std::string type(Scope* global_scope, Function* func);
-        void reserve(AST::Program* prg);
-        std::string gen_code(Scope* global_scope, Function* func, bool keep_result);
+        void write(std::ostream& out);
+        AST::Type infer_type(Scope* global_scope, Function* func);
+        void reserve(IR::ConstPool& pool);
+        void gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result);
+        Expression* fold(FoldContext& ctx);
 
         LValue* operand;
         Type t;
@@ -201,10 +291,15 @@ namespace AST {
 
         UnaryOpExpression(location, Expression* operand, Type t);
 
-        void write();
-        std::string type(Scope* global_scope, Function* func);
-        std::string gen_code(Scope* global_scope, Function* func, bool keep_result);
-        void reserve(AST::Program* prg);
+        void write(std::ostream& out);
+        AST::Type infer_type(Scope* global_scope, Function* func);
+        void gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result);
+        void gen_branch(IR::Buffer& out, Scope* global_scope, Function* func, int true_label, int false_label);
+        void reserve(IR::ConstPool& pool);
+        Expression* fold(FoldContext& ctx);
+        bool is_pure();
+        bool is_boolean();
+        Expression* negate(FoldContext& ctx);
 
         Expression* operand;
         Type t;
@@ -232,40 +327,50 @@ namespace AST {
 
         BinaryOpExpression(location, Expression* lhs, Expression* rhs, Type t);
 
-        void write();
-        std::string type(Scope* global_scope, Function* func);
-        void reserve(AST::Program* prg);
-        std::string gen_code(Scope* global_scope, Function* func, bool keep_result);
+        void write(std::ostream& out);
+        AST::Type infer_type(Scope* global_scope, Function* func);
+        void reserve(IR::ConstPool& pool);
+        void gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result);
+        void gen_branch(IR::Buffer& out, Scope* global_scope, Function* func, int true_label, int false_label);
+        Expression* fold(FoldContext& ctx);
+        bool is_pure();
+        bool is_boolean();
+        Expression* negate(FoldContext& ctx);
 
         Expression* lhs, *rhs;
         Type t;
-        std::string operand_type;
+        AST::Type operand_type;
     };
 
     class TernaryOpExpression : public Expression {
     public:
         TernaryOpExpression(location, Expression* cond, Expression* pos, Expression* neg);
 
-        void write();
-        std::string type(Scope* global_scope, Function* func);
-        void reserve(AST::Program* prg);
+        void write(std::ostream& out);
+        AST::Type infer_type(Scope* global_scope, Function* func);
+        void reserve(IR::ConstPool& pool);
+        Expression* fold(FoldContext& ctx);
+        bool is_pure();
 
-        std::string gen_code(Scope* scope, Function* func, bool keep_result);
+        void gen_code(IR::Buffer& out, Scope* scope, Function* func, bool keep_result);
+        void gen_branch(IR::Buffer& out, Scope* global_scope, Function* func, int true_label, int false_label);
 
         Expression* cond, *pos, *neg;
-        std::string cond_type;
+        AST::Type cond_type;
     };
 
     class CastExpression : public Expression {
     public:
-        CastExpression(location, std::string cast_type, Expression* rhs);
+        CastExpression(location, AST::Type cast_type, Expression* rhs);
 
-        void write();
-        std::string type(Scope* global_scope, Function* func);
-        void reserve(AST::Program* prg);
-        std::string gen_code(Scope* global_scope, Function* func, bool keep_result);
+        void write(std::ostream& out);
+        AST::Type infer_type(Scope* global_scope, Function* func);
+        void reserve(IR::ConstPool& pool);
+        void gen_code(IR::Buffer& out, Scope* global_scope, Function* func, bool keep_result);
+        Expression* fold(FoldContext& ctx);
+        bool is_pure();
 
-        std::string cast_type;
+        AST::Type cast_type;
         Expression* rhs;
     };
 }
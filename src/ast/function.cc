@@ -3,32 +3,32 @@
 #include "../parser.hh"
 
 AST::Function::Function(location loc,
-                        std::string ret_type,
-                        std::string name,
+                        Type ret_type,
+                        util::Atom name,
                         AST::Scope* params)
-    : Node(loc), name(name), ret_type(ret_type), params(params), defined(false) {
+    : Node(loc), name(name), ret_type(ret_type), scope(NULL), locals(NULL), params(params), defined(false) {
     /* not a bulitin */
     is_builtin = false;
 }
 
 AST::Function::Function(location loc,
-                        std::string ret_type,
-                        std::string name,
+                        Type ret_type,
+                        util::Atom name,
                         AST::Scope* params,
                         int builtin)
-    : Node(loc), name(name), ret_type(ret_type), params(params), defined(false) {
+    : Node(loc), name(name), ret_type(ret_type), scope(NULL), locals(NULL), params(params), defined(false) {
     /* builtin declaration! */
     function_number = builtin;
     is_builtin = true;
 }
 
-AST::Function::Function(location loc, std::string ret_type, std::string name,
+AST::Function::Function(location loc, util::Arena& arena, Type ret_type, util::Atom name,
                         AST::Scope* params,
                         AST::Scope* locals,
                         std::vector<Statement*> body)
     : Node(loc), name(name), ret_type(ret_type), locals(locals), params(params), body(body), defined(true) {
     /* make sure we can merge params and locals */
-    scope = new AST::Scope(loc, params, locals);
+    scope = arena.make<AST::Scope>(loc, params, locals);
 
     /* not a builtin */
     is_builtin = false;
@@ -36,34 +36,47 @@ AST::Function::Function(location loc, std::string ret_type, std::string name,
 
 
 
-void AST::Function::write() {
-    std::cout << "<Function name=" << name << " ret_type=" << ret_type << " defined=" << defined << ">\n";
-    std::cout << "(parameters)\n";
-    params->write();
-    std::cout << "(locals)\n";
-    locals->write();
-    std::cout << "(scope)\n";
-    scope->write();
-    std::cout << "(body)\n";
-    for (auto i : body) i->write();
-    std::cout << "</Function>\n";
+void AST::Function::write(std::ostream& out) {
+    out << "<Function name=" << name << " ret_type=" << ret_type << " defined=" << defined << ">\n";
+    out << "(parameters)\n";
+    params->write(out);
+
+    /* prototypes and builtins have no locals or body */
+    if (!defined) {
+        out << "</Function>\n";
+        return;
+    }
+
+    out << "(locals)\n";
+    locals->write(out);
+    out << "(scope)\n";
+    scope->write(out);
+    out << "(body)\n";
+    for (auto i : body) i->write(out);
+    out << "</Function>\n";
 }
 
-void AST::Function::check_types(AST::Scope* global_scope, bool verbose) {
+void AST::Function::check_types(AST::Scope* global_scope, std::ostream* trace) {
     if (!defined) return;
 
     for (auto i : body) {
-        i->check_types(global_scope, this, verbose);
+        i->check_types(global_scope, this, trace);
+    }
+}
+
+void AST::Function::fold(FoldContext& ctx) {
+    for (auto i : body) {
+        i->fold(ctx);
     }
 }
 
-void AST::Function::reserve(AST::Program* prg) {
+void AST::Function::reserve(IR::ConstPool& pool) {
     /* function reservation */
 
     /* 0. reserve parameter locations */
     local_counter = 0;
     for (auto i : params->variables) {
-        i->code_location = "L" + std::to_string(local_counter++);
+        i->code_location = IR::Slot(IR::Segment::LOCAL, local_counter++);
     }
 
     /* 1. reserve local locations */
@@ -73,44 +86,43 @@ void AST::Function::reserve(AST::Program* prg) {
         if (i->name->is_array) {
             num_slots = i->name->array_size;
 
-            if (i->base_type == "char") {
-                num_slots = (num_slots + 1) / 4;
+            if (i->base_type == types::CHAR) {
+                num_slots = (num_slots + 3) / 4;
             }
         }
 
-        i->code_location = "L" + std::to_string(local_counter);
+        i->code_location = IR::Slot(IR::Segment::LOCAL, local_counter);
         local_counter += num_slots;
     }
 
     /* 2. walk statements for constants */
     for (auto i : body) {
-        i->reserve(prg);
+        i->reserve(pool);
     }
 }
 
-std::string AST::Function::gen_code(Scope* global_scope) {
+void AST::Function::gen_code(IR::Buffer& out, Scope* global_scope) {
     /* output function info */
-    std::string output = ".FUNC " + std::to_string(function_number) + " " + name + "\n";
-
-    output += "  .params " + std::to_string(params->variables.size()) + "\n";
-    output += std::string("  .return ") + ((ret_type == "void") ? "0 \n" : "1 \n");
-    output += "  .locals " + std::to_string(local_counter) + "\n";
+    out.emit_text(IR::Op::FUNC, function_number, name.str());
+    out.emit_value(IR::Op::PARAMS, params->variables.size());
+    out.emit_value(IR::Op::RETURN, (ret_type == types::VOID) ? 0 : 1);
+    out.emit_value(IR::Op::LOCALS, local_counter);
 
     /* output statement code */
     for (auto i : body) {
-        output += i->gen_code(global_scope, this);
+        i->gen_code(out, global_scope, this);
     }
 
     /* if we are supposed to return something, make sure we do.
      * a function with a proper return statement will never use this instruction */
-    if (ret_type != "void") {
-        output += "    pushv 0x0\n";
+    if (ret_type != types::VOID) {
+        out.emit_value(IR::Op::PUSHV, 0);
     }
 
-    output += "    ret\n.end FUNC\n";
-    return output;
+    out.emit(IR::Op::RET);
+    out.emit(IR::Op::END_FUNC);
 }
 
-std::string AST::Function::make_label() {
-    return std::string("I") + std::to_string(label_counter++);
+int AST::Function::make_label() {
+    return label_counter++;
 }
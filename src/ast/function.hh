@@ -9,14 +9,16 @@ namespace AST {
 
     class Function : public Node {
     public:
-        Function(location, std::string ret_type, std::string name, Scope* params);
-        Function(location, std::string ret_type, std::string name, Scope* params, Scope* locals, std::vector<Statement*> body);
-        Function(location, std::string ret_type, std::string name, Scope* params, int builtin);
+        Function(location, Type ret_type, util::Atom name, Scope* params);
+        Function(location, util::Arena& arena, Type ret_type, util::Atom name, Scope* params, Scope* locals, std::vector<Statement*> body);
+        Function(location, Type ret_type, util::Atom name, Scope* params, int builtin);
 
-        void write();
-        void check_types(Scope* global_scope, bool verbose);
+        void write(std::ostream& out);
+        void check_types(Scope* global_scope, std::ostream* trace);
+        void fold(FoldContext& ctx);
 
-        std::string name, ret_type;
+        util::Atom name;
+        Type ret_type;
         Scope* scope, *locals, *params;
         std::vector<Statement*> body;
         bool defined;
@@ -24,12 +26,19 @@ namespace AST {
         /* code generation */
         bool is_builtin;
         int function_number; /* set by AST::Program before code gen unless the function is builtin */
-        void reserve(AST::Program* prg);
-        std::string gen_code(Scope* global_scope);
+        void reserve(IR::ConstPool& pool);
+        void gen_code(IR::Buffer& out, Scope* global_scope);
 
         int local_counter = 0; /* counter for local variables, needed for array types */
         int label_counter = 0;
 
-        std::string make_label();
+        int make_label();
+
+        /* jump targets for break/continue in the loops enclosing the current statement */
+        struct LoopContext {
+            int continue_label, break_label;
+        };
+
+        std::vector<LoopContext> loops;
     };
 }
@@ -1,4 +1,4 @@
 #include "node.hh"
 
 AST::Node::Node(location loc) : loc(loc) {}
-void AST::Node::write() {}
+void AST::Node::write(std::ostream& out) {}
@@ -6,6 +6,9 @@
 #include <map>
 
 #include "../location.hh"
+#include "../arena.hh"
+#include "../intern.hh"
+#include "types.hh"
 
 typedef yy::location location;
 
@@ -13,7 +16,7 @@ namespace AST {
     class Node {
     public:
         Node(location loc);
-        virtual void write();
+        virtual void write(std::ostream& out);
         location loc;
     };
 }
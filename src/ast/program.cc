@@ -1,18 +1,25 @@
 #include "program.hh"
 #include "../parser.hh"
+#include "../util.hh"
+#include "../version.hh"
+#include "../ir/sink.hh"
+#include "../ir/x86_64.hh"
 
-AST::Program::Program(location loc) : Node(loc), const_counter(0) {
-    scope = new AST::Scope(loc);
+#include <algorithm>
+
+AST::Program::Program(location loc, util::Arena& arena) : Node(loc), arena(arena), constants_requested(0), constants_emitted(0), labels_made(0), instructions_emitted(0), expressions_folded(0), deterministic(false) {
+    scope = arena.make<AST::Scope>(loc);
+    pass_results.clear(0);
 
     /* here we should initialize the builtin functions */
-    push_function(new Function(loc, "int", "getchar", new Scope(loc), 0));
-    push_function(new Function(loc, "int", "putchar", new Scope(loc, new Variable(loc, "int", new VariableName(loc, "c"))), 1));
+    push_function(arena.make<Function>(loc, types::INT, util::intern("getchar"), arena.make<Scope>(loc), 0));
+    push_function(arena.make<Function>(loc, types::INT, util::intern("putchar"), arena.make<Scope>(loc, arena.make<Variable>(loc, types::INT, arena.make<VariableName>(loc, util::intern("c")))), 1));
 }
 
-void AST::Program::write() {
-    std::cout << "<Program>\n";
-    scope->write();
-    std::cout << "</Program>\n";
+void AST::Program::write(std::ostream& out) {
+    out << "<Program>\n";
+    scope->write(out);
+    out << "</Program>\n";
 }
 
 void AST::Program::push_globals(AST::Scope* s) {
@@ -23,18 +30,63 @@ void AST::Program::push_function(Function* f) {
     scope->push_function(f);
 }
 
-void AST::Program::check_types(bool verbose) {
+void AST::Program::check_types(std::ostream* trace) {
+    for (auto i : scope->functions) {
+        i->check_types(scope, trace);
+    }
+}
+
+void AST::Program::fold_constants() {
+    FoldContext ctx = {arena, 0};
+
     for (auto i : scope->functions) {
-        i->check_types(scope, verbose);
+        i->fold(ctx);
     }
+
+    expressions_folded = ctx.folded;
+}
+
+void AST::Program::generate_ir(std::ostream& out, int jobs, const PassManager* passes) {
+    IR::Sink sink(out);
+
+    generate(jobs, passes, [&](const IR::Buffer& b) {
+        sink.write(b);
+        sink.flush();
+    });
 }
 
-std::string AST::Program::generate_ir() {
-    std::string output = "; compiler build ";
-    output += __DATE__;
-    output += " ";
-    output += __TIME__;
-    output += "\n";
+std::string AST::Program::generate_x86_64(int jobs, const PassManager* passes) {
+    IR::Buffer program = generate_buffer(jobs, passes);
+
+    /* the backend needs to know which parameters hold pointers */
+    std::vector<std::vector<bool>> pointer_params;
+
+    for (auto i : scope->functions) {
+        if (i->is_builtin) continue;
+        if ((int) pointer_params.size() <= i->function_number) pointer_params.resize(i->function_number + 1);
+
+        for (auto p : i->params->variables) {
+            pointer_params[i->function_number].push_back(p->name->is_array);
+        }
+    }
+
+    return IR::lower_x86_64(program, pointer_params);
+}
+
+IR::Buffer AST::Program::generate_buffer(int jobs, const PassManager* passes) {
+    IR::Buffer output;
+
+    generate(jobs, passes, [&](const IR::Buffer& b) {
+        output.append(b);
+    });
+
+    return output;
+}
+
+void AST::Program::generate(int jobs, const PassManager* passes, const std::function<void(const IR::Buffer&)>& emit) {
+    IR::Buffer header;
+    if (deterministic) header.emit_text(IR::Op::COMMENT, 0, "compiler version " COMPILER_VERSION);
+    else header.emit_text(IR::Op::COMMENT, 0, std::string("compiler build ") + __DATE__ + " " + __TIME__);
 
     /* 0. reserve global locations */
     int global_counter = 0;
@@ -43,12 +95,12 @@ std::string AST::Program::generate_ir() {
         if (i->name->is_array){
             num_slots = i->name->array_size;
 
-            if (i->base_type == "char") {
-                num_slots = (num_slots + 1) / 4;
+            if (i->base_type == types::CHAR) {
+                num_slots = (num_slots + 3) / 4;
             }
         }
 
-        i->code_location = "G" + std::to_string(global_counter);
+        i->code_location = IR::Slot(IR::Segment::GLOBAL, global_counter);
         global_counter += num_slots;
     }
 
@@ -58,68 +110,93 @@ std::string AST::Program::generate_ir() {
         if (i->is_builtin) ++num_builtins;
     }
 
-    /* 1. reserve all other locations */
+    /* 1. number the functions up front, so calls can be generated in any order */
+    std::vector<Function*> funcs;
     function_counter = 0;
     for (auto i : scope->functions) {
         if (i->is_builtin) continue; /* skip builtins */
         i->function_number = function_counter++ + num_builtins;
-        i->reserve(this);
+        funcs.push_back(i);
     }
 
-    /* output constant count */
-    output += ".CONSTANTS " + std::to_string(const_counter) + "\n";
+    /* what each function number takes and returns, so the IR passes can follow calls */
+    std::vector<IR::Signature> signatures(function_counter + num_builtins);
 
-    /* output constant values if any */
-    for (auto i : const_values) {
-        char buf[11] = {0};
-        snprintf(buf, sizeof buf, "0x%08x", i);
-        output += "  " + std::string(buf) + "\n";
+    for (auto i : scope->functions) {
+        signatures[i->function_number] = {(int) i->params->variables.size(), i->ret_type != types::VOID};
     }
 
-    /* output global count */
-    output += "\n.GLOBALS " + std::to_string(global_counter) + "\n";
+    /*
+     * 2. reserve locations and constants for each function. every function has
+     * its own constant pool, so they can be filled in parallel
+     */
+    std::vector<IR::ConstPool> pools(funcs.size());
 
-    /* output function count */
-    output += "\n.FUNCTIONS " + std::to_string(function_counter) + "\n";
+    util::parallel_for(funcs.size(), jobs, [&](int i) {
+        funcs[i]->reserve(pools[i]);
+    });
 
-    /* for each function, print generated code */
-    for (auto i : scope->functions) {
-        if (i->is_builtin) continue;
-        output += "\n" + i->gen_code(scope);
+    /* 3. merge the constant pools, sharing words between functions */
+    IR::Words const_words;
+    std::vector<std::vector<int>> const_maps;
+    IR::merge_pools(pools, const_words, const_maps);
+
+    constants_requested = 0;
+    for (auto& i : pools) {
+        constants_requested += i.requested;
     }
 
-    return output;
-}
+    constants_emitted = const_words.size();
 
-std::string AST::Program::make_const_int(int v) {
-    const_values.push_back(v);
-    return "C" + std::to_string(const_counter++);
-}
+    /* the header is complete before any code is generated, so it can go out first */
+    header.emit_value(IR::Op::CONSTANTS, const_words.size());
 
-std::string AST::Program::make_const_real(float v) {
-    const_values.push_back(*((uint32_t*) &v));
-    return "C" + std::to_string(const_counter++);
-}
+    for (auto i : const_words) {
+        header.emit_value(IR::Op::WORD, i);
+    }
 
-std::string AST::Program::make_const_string(std::string v) {
-    /* we make multiple constants and return the ref to the first one */
-    /* break the string into chunks of 4 bytes */
-    std::string ret = "C" + std::to_string(const_counter);
-    while (v.size()) {
-        int num = v.size();
-        if (num > 4) num = 4;
-
-        char bytes[4] = {0};
-        for (int i = 0; i < num; ++i) {
-            bytes[i] = v[i];
-        }
+    header.emit_value(IR::Op::GLOBALS, global_counter);
+    header.emit_value(IR::Op::FUNCTIONS, function_counter);
+    emit(header);
 
-        v.erase(0, 4);
-        uint32_t val = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (bytes[3] << 24);
+    /*
+     * 4. generate the bodies in declaration order, a batch at a time, so only
+     * a batch is held in memory. a single thread hands out every function as
+     * soon as it is done
+     */
+    size_t batch = (jobs > 1) ? 4 * jobs : 1;
+    std::vector<IR::Buffer> bodies(batch);
+    std::vector<PassResults> results(batch);
 
-        const_counter++;
-        const_values.push_back(val);
-    }
+    size_t num_passes = passes ? passes->pipeline.size() : 0;
+    pass_results.clear(num_passes);
+    labels_made = instructions_emitted = 0;
+
+    for (size_t first = 0; first < funcs.size(); first += batch) {
+        size_t count = std::min(batch, funcs.size() - first);
+
+        util::parallel_for(count, jobs, [&](int k) {
+            bodies[k].clear();
+            results[k].clear(num_passes);
+
+            funcs[first + k]->gen_code(bodies[k], scope);
+            if (passes) passes->run_ir(bodies[k], const_maps[first + k], signatures, results[k]);
+        });
+
+        for (size_t k = 0; k < count; ++k) {
+            pass_results.add(results[k]);
+            if (passes && passes->dump) *passes->dump << results[k].dump;
 
-    return ret;
+            labels_made += funcs[first + k]->label_counter;
+
+            for (auto& i : bodies[k].code) {
+                if (i.op >= IR::Op::PUSH) ++instructions_emitted;
+            }
+
+            /* point the body's constants at their merged words */
+            IR::Buffer body;
+            body.append(bodies[k], const_maps[first + k]);
+            emit(body);
+        }
+    }
 }
@@ -3,30 +3,66 @@
 #include "variable.hh"
 #include "function.hh"
 #include "scope.hh"
+#include "../passes.hh"
 
 #include <cstdint>
+#include <functional>
+#include <ostream>
 
 namespace AST {
     class Program : public Node {
     public:
-        Program(location);
+        Program(location, util::Arena& arena);
 
-        void write();
+        void write(std::ostream& out);
         void push_globals(Scope* s);
         void push_function(Function*);
 
-        void check_types(bool verbose);
-        std::string generate_ir();
+        void check_types(std::ostream* trace);
+
+        /* fold constant expressions in every function, between check_types() and generate_ir() */
+        void fold_constants();
+
+        /*
+         * generate the program IR and stream it to 'out' one function at a time,
+         * with function bodies spread over 'jobs' threads.
+         * each function body is run through the IR passes of 'passes' if it is not NULL
+         */
+        void generate_ir(std::ostream& out, int jobs = 1, const PassManager* passes = NULL);
+
+        /* same, as a single instruction buffer */
+        IR::Buffer generate_buffer(int jobs = 1, const PassManager* passes = NULL);
+
+        /* generate the program as x86-64 assembly, see ir/x86_64.hh */
+        std::string generate_x86_64(int jobs = 1, const PassManager* passes = NULL);
 
         Scope* scope;
 
-        /* allocate a new constant location */
-        std::string make_const_int(int v);
-        std::string make_const_real(float v);
-        std::string make_const_string(std::string v);
+        /* owner of every node in the tree */
+        util::Arena& arena;
+
+        /* constant words used by the program before and after sharing, set by generate_ir() */
+        int constants_requested, constants_emitted;
+
+        /* labels made by Function::make_label() and instructions left after the IR passes, set by generate_ir() */
+        int labels_made, instructions_emitted;
+
+        /* expressions replaced by fold_constants() */
+        int expressions_folded;
+
+        /* leave the build date and time out of the output, so it only depends on the input */
+        bool deterministic;
+
+        /* what the IR passes did to all functions, set by generate_ir() */
+        PassResults pass_results;
 
     private:
-        int const_counter, function_counter;
-        std::vector<uint32_t> const_values;
+        int function_counter;
+
+        /*
+         * generate the program, handing the header and then each function body
+         * (with constants pointing into the merged pool) to 'emit' in order
+         */
+        void generate(int jobs, const PassManager* passes, const std::function<void(const IR::Buffer&)>& emit);
     };
 }
@@ -3,6 +3,8 @@
 #include "variable.hh"
 #include "function.hh"
 
+#include <unordered_map>
+
 /* scope is more of an abtsract structure, useful for checking for name conflicts */
 
 namespace AST {
@@ -10,7 +12,7 @@ namespace AST {
     public:
         Scope(location loc);
         Scope(location loc, AST::Variable* first);
-        Scope(location loc, std::string type, std::vector<AST::VariableName*> names);
+        Scope(location loc, util::Arena& arena, Type type, std::vector<AST::VariableName*> names);
         Scope(location loc, Scope* a, Scope* b);
         ~Scope();
 
@@ -18,12 +20,18 @@ namespace AST {
         void push_variable(AST::Variable* v);
         void push_function(AST::Function* f);
 
-        AST::Variable* get_variable(std::string name);
-        AST::Function* get_function(std::string name);
+        AST::Variable* get_variable(util::Atom name);
+        AST::Function* get_function(util::Atom name);
 
-        void write();
+        void write(std::ostream& out);
 
+        /* declarations in order, codegen relies on this for slot numbering */
         std::vector<AST::Variable*> variables;
         std::vector<AST::Function*> functions;
+
+    private:
+        /* name lookup indexes over the declaration lists */
+        std::unordered_map<util::Atom, AST::Variable*> variable_index;
+        std::unordered_map<util::Atom, AST::Function*> function_index;
     };
 }
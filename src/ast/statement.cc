@@ -6,99 +6,100 @@
 /* Statement base class */
 AST::Statement::Statement(location loc) : Node(loc) {}
 
-void AST::Statement::check_types(Scope* global_scope, Function* func, bool verbose) {
+void AST::Statement::check_types(Scope* global_scope, Function* func, std::ostream* trace) {
     return;
 }
 
-void AST::Statement::reserve(AST::Program* prg) {}
+void AST::Statement::reserve(IR::ConstPool& pool) {}
 
-std::string AST::Statement::gen_code(Scope* global_scope, Function* func) {
-    return "";
-}
-
-std::string AST::Statement::backpatch(std::string code, std::string sub, std::string repl) {
-    size_t ind = 0;
-
-    for (;;) {
-        ind = code.find(sub, ind);
-        if (ind == std::string::npos) break;
-        code.replace(ind, sub.size(), repl);
-        ind += sub.size();
-    }
+void AST::Statement::fold(FoldContext& ctx) {}
 
-    return code;
-}
+void AST::Statement::gen_code(IR::Buffer& out, Scope* global_scope, Function* func) {}
 
 /* ExpressionStatement */
 AST::ExpressionStatement::ExpressionStatement(location loc, AST::Expression* expr) : Statement(loc), expr(expr) {}
 
-void AST::ExpressionStatement::write() {
-    std::cout << "<ExpressionStatement>\n";
-    expr->write();
-    std::cout << "</ExpressionStatement>\n";
+void AST::ExpressionStatement::write(std::ostream& out) {
+    out << "<ExpressionStatement>\n";
+    expr->write(out);
+    out << "</ExpressionStatement>\n";
+}
+
+void AST::ExpressionStatement::check_types(Scope* global_scope, Function* func, std::ostream* trace) {
+    Type expr_type = expr->type(global_scope, func);
+    if (trace) *trace << "Expression at " << *(loc.begin.filename) << ":" << std::to_string(loc.begin.line) << " has type " << expr_type << "\n";
 }
 
-void AST::ExpressionStatement::check_types(Scope* global_scope, Function* func, bool verbose) {
-    std::string expr_type = expr->type(global_scope, func);
-    if (verbose) std::cout << "Expression at " << *(loc.begin.filename) << ":" << std::to_string(loc.begin.line) << " has type " << expr_type << "\n";
+void AST::ExpressionStatement::reserve(IR::ConstPool& pool) {
+    expr->reserve(pool);
 }
 
-void AST::ExpressionStatement::reserve(AST::Program* prg) {
-    expr->reserve(prg);
+void AST::ExpressionStatement::fold(FoldContext& ctx) {
+    expr = expr->fold(ctx);
 }
 
-std::string AST::ExpressionStatement::gen_code(Scope* global_scope, Function* func) {
-    return expr->gen_code(global_scope, func, false);
+void AST::ExpressionStatement::gen_code(IR::Buffer& out, Scope* global_scope, Function* func) {
+    expr->gen_code(out, global_scope, func, false);
 }
 
 /* BreakStatement */
 AST::BreakStatement::BreakStatement(location loc) : Statement(loc) {}
 
-std::string AST::BreakStatement::gen_code(Scope* scope, Function* func) {
-    return "    goto <POSTLOOP>\n";
+void AST::BreakStatement::gen_code(IR::Buffer& out, Scope* scope, Function* func) {
+    if (func->loops.empty()) {
+        throw yy::parser::syntax_error(loc, "break statement not within a loop");
+    }
+
+    out.emit_jump(IR::Op::GOTO, func->loops.back().break_label);
 }
 
 /* ContinueStatement */
 AST::ContinueStatement::ContinueStatement(location loc) : Statement(loc) {}
 
-std::string AST::ContinueStatement::gen_code(Scope* scope, Function* func) {
-    return "    goto <PRELOOP>\n";
+void AST::ContinueStatement::gen_code(IR::Buffer& out, Scope* scope, Function* func) {
+    if (func->loops.empty()) {
+        throw yy::parser::syntax_error(loc, "continue statement not within a loop");
+    }
+
+    out.emit_jump(IR::Op::GOTO, func->loops.back().continue_label);
 }
 
 /* ReturnStatement */
 AST::ReturnStatement::ReturnStatement(location loc, Expression* expr) : Statement(loc), expr(expr) {}
 
-void AST::ReturnStatement::write() {
-    std::cout << "<ReturnStatement>\n";
-    if (expr) expr->write();
-    std::cout << "</ReturnStatement>\n";
+void AST::ReturnStatement::write(std::ostream& out) {
+    out << "<ReturnStatement>\n";
+    if (expr) expr->write(out);
+    out << "</ReturnStatement>\n";
 }
 
-void AST::ReturnStatement::check_types(Scope* scope, Function* func, bool verbose) {
-    if (func->ret_type == "void" && expr) {
+void AST::ReturnStatement::check_types(Scope* scope, Function* func, std::ostream* trace) {
+    if (func->ret_type == types::VOID && expr) {
         throw yy::parser::syntax_error(loc, "return statement with value, in function returning void");
     }
 
-    if (!expr && func->ret_type != "void") {
+    if (!expr && func->ret_type != types::VOID) {
         throw yy::parser::syntax_error(loc, "return statement with no value, in function returning " + func->ret_type);
     }
 
-    std::string expr_type = expr ? expr->type(scope, func) : "void";
+    Type expr_type = expr ? expr->type(scope, func) : types::VOID;
 
     if (expr_type != func->ret_type) {
         throw yy::parser::syntax_error(loc, "mismatched types; cannot return '" + expr_type + "' from function returning " + func->ret_type);
     }
 }
 
-void AST::ReturnStatement::reserve(AST::Program* prg) {
-    if (expr) expr->reserve(prg);
+void AST::ReturnStatement::reserve(IR::ConstPool& pool) {
+    if (expr) expr->reserve(pool);
 }
 
-std::string AST::ReturnStatement::gen_code(Scope* scope, Function* func) {
-    std::string out;
-    if (expr) out = expr->gen_code(scope, func, true);
-    out += "    ret\n";
-    return out;
+void AST::ReturnStatement::fold(FoldContext& ctx) {
+    if (expr) expr = expr->fold(ctx);
+}
+
+void AST::ReturnStatement::gen_code(IR::Buffer& out, Scope* scope, Function* func) {
+    if (expr) expr->gen_code(out, scope, func, true);
+    out.emit(IR::Op::RET);
 }
 
 /* IfStatement */
@@ -108,108 +109,113 @@ AST::IfStatement::IfStatement(location loc, Expression* cond, std::vector<Statem
 AST::IfStatement::IfStatement(location loc, Expression* cond, std::vector<Statement*> body, std::vector<Statement*> else_body)
     : Statement(loc), has_else(true), cond(cond), body(body), else_body(else_body) {}
 
-void AST::IfStatement::write() {
-    std::cout << "<IfStatement>\n";
-    std::cout << "(condition)\n";
-    cond->write();
-    std::cout << "(body)\n";
-    for (auto i : body) i->write();
+void AST::IfStatement::write(std::ostream& out) {
+    out << "<IfStatement>\n";
+    out << "(condition)\n";
+    cond->write(out);
+    out << "(body)\n";
+    for (auto i : body) i->write(out);
     if (has_else) {
-        std::cout << "(else_body)\n";
-        for (auto i : else_body) i->write();
+        out << "(else_body)\n";
+        for (auto i : else_body) i->write(out);
     }
-    std::cout << "</IfStatement>\n";
+    out << "</IfStatement>\n";
 }
 
-void AST::IfStatement::check_types(Scope* global_scope, Function* func, bool verbose) {
-    std::string cond_type = cond->type(global_scope, func);
+void AST::IfStatement::check_types(Scope* global_scope, Function* func, std::ostream* trace) {
+    Type cond_type = cond->type(global_scope, func);
 
-    if (cond_type != "int" && cond_type != "char" && cond_type != "float") {
+    if (cond_type != types::INT && cond_type != types::CHAR && cond_type != types::FLOAT) {
         throw yy::parser::syntax_error(loc, "invalid condition type " + cond_type + " in 'if' statement");
     }
 
     for (auto i : body) {
-        i->check_types(global_scope, func, verbose);
+        i->check_types(global_scope, func, trace);
     }
 
     for (auto i : else_body) {
-        i->check_types(global_scope, func, verbose);
+        i->check_types(global_scope, func, trace);
     }
 }
 
-void AST::IfStatement::reserve(AST::Program* prg) {
-    cond->reserve(prg);
+void AST::IfStatement::reserve(IR::ConstPool& pool) {
+    cond->reserve(pool);
 
     for (auto i : body) {
-        i->reserve(prg);
+        i->reserve(pool);
     }
 
     for (auto i : else_body) {
-        i->reserve(prg);
+        i->reserve(pool);
     }
 }
 
-std::string AST::IfStatement::gen_code(Scope* scope, Function* func) {
-    std::string output, fail_label, post_else_label;
+void AST::IfStatement::fold(FoldContext& ctx) {
+    cond = cond->fold(ctx);
 
-    /* generate a label for when the condition is false */
-    fail_label = func->make_label();
+    for (auto i : body) {
+        i->fold(ctx);
+    }
 
-    std::string cond_type = cond->type(scope, func);
+    for (auto i : else_body) {
+        i->fold(ctx);
+    }
+}
+
+void AST::IfStatement::gen_code(IR::Buffer& out, Scope* scope, Function* func) {
+    int fail_label, post_else_label = 0;
 
-    /* first, get the value of the conditional expression */
-    output += cond->gen_code(scope, func, true);
+    /* generate a label for when the condition is false */
+    fail_label = func->make_label();
 
-    /* if the condition fails, jump to the fail label */
-    output += std::string("    ==0") + cond_type[0] + " " + fail_label + "\n";
-    for (auto i : body) output += i->gen_code(scope, func);
+    /* branch on the condition, jumping to the fail label if it doesn't hold */
+    cond->gen_branch(out, scope, func, FALL_THROUGH, fail_label);
+    for (auto i : body) i->gen_code(out, scope, func);
 
     if (has_else) {
         post_else_label = func->make_label();
-        output += "    goto " + post_else_label + "\n";
+        out.emit_jump(IR::Op::GOTO, post_else_label);
     }
 
-    output += fail_label + ":";
+    out.emit_label(fail_label);
 
     /* if there is an else block, we need another label after the else block */
     /* jump to it at the end of the initial body */
 
     if (has_else) {
-        for (auto i : else_body) output += i->gen_code(scope, func);
-        output += post_else_label + ":";
+        for (auto i : else_body) i->gen_code(out, scope, func);
+        out.emit_label(post_else_label);
     }
-
-    return output;
 }
 
 /* ForStatement */
 AST::ForStatement::ForStatement(location loc, Expression* init, Expression* cond, Expression* next, std::vector<Statement*> body)
     : Statement(loc), init(init), cond(cond), next(next), body(body) {}
 
-void AST::ForStatement::write() {
-    std::cout << "<ForStatement>\n";
+void AST::ForStatement::write(std::ostream& out) {
+    out << "<ForStatement>\n";
     if (init) {
-        std::cout << "(init)\n";
-        init->write();
+        out << "(init)\n";
+        init->write(out);
     }
     if (cond) {
-        std::cout << "(cond)\n";
-        cond->write();
+        out << "(cond)\n";
+        cond->write(out);
     }
     if (next) {
-        std::cout << "(next)\n";
-        next->write();
+        out << "(next)\n";
+        next->write(out);
     }
-    std::cout << "(body)\n";
-    for (auto i : body) i->write();
-    std::cout << "</ForStatement>\n";
+    out << "(body)\n";
+    for (auto i : body) i->write(out);
+    out << "</ForStatement>\n";
 }
 
-void AST::ForStatement::check_types(Scope* global_scope, Function* func, bool verbose) {
+void AST::ForStatement::check_types(Scope* global_scope, Function* func, std::ostream* trace) {
     if (cond) {
-        std::string cond_type = cond->type(global_scope, func);
+        Type cond_type = cond->type(global_scope, func);
 
-        if (cond_type != "int" && cond_type != "char" && cond_type != "float") {
+        if (cond_type != types::INT && cond_type != types::CHAR && cond_type != types::FLOAT) {
             throw yy::parser::syntax_error(loc, "invalid condition type " + cond_type + " in 'for' statement");
         }
     }
@@ -218,165 +224,178 @@ void AST::ForStatement::check_types(Scope* global_scope, Function* func, bool ve
     if (next) next->type(global_scope, func);
 
     for (auto i : body) {
-        i->check_types(global_scope, func, verbose);
+        i->check_types(global_scope, func, trace);
     }
 }
 
-void AST::ForStatement::reserve(AST::Program* prg) {
-    if (init) init->reserve(prg);
-    if (cond) cond->reserve(prg);
-    if (next) next->reserve(prg);
+void AST::ForStatement::reserve(IR::ConstPool& pool) {
+    if (init) init->reserve(pool);
+    if (cond) cond->reserve(pool);
+    if (next) next->reserve(pool);
 
     for (auto i : body) {
-        i->reserve(prg);
+        i->reserve(pool);
     }
 }
 
-std::string AST::ForStatement::gen_code(Scope* scope, Function* func) {
-    std::string output, loop_label = func->make_label(), post_loop_label = func->make_label();
-
-    if (init) output += init->gen_code(scope, func, false);
-    output += loop_label + ":";
+void AST::ForStatement::fold(FoldContext& ctx) {
+    if (init) init = init->fold(ctx);
+    if (cond) cond = cond->fold(ctx);
+    if (next) next = next->fold(ctx);
 
-    if (cond) {
-        std::string cond_type = cond->type(scope, func);
-        output += cond->gen_code(scope, func, true);
-        output += std::string("    ==0") + cond_type[0] + " " + post_loop_label + "\n";
+    for (auto i : body) {
+        i->fold(ctx);
     }
+}
+
+void AST::ForStatement::gen_code(IR::Buffer& out, Scope* scope, Function* func) {
+    /* the loop is rotated: the condition is tested once on the way in, and
+     * then at the bottom with a single branch back to the body.
+     * continue has to run the next expression, so it gets a label of its own */
 
-    std::string body_code;
-    for (auto i : body) body_code += i->gen_code(scope, func);
-    body_code = backpatch(body_code, "<PRELOOP>", loop_label);
-    body_code = backpatch(body_code, "<POSTLOOP>", post_loop_label);
+    int body_label = func->make_label(), next_label = func->make_label(), post_loop_label = func->make_label();
 
-    output += body_code;
+    if (init) init->gen_code(out, scope, func, false);
+    if (cond) cond->gen_branch(out, scope, func, FALL_THROUGH, post_loop_label);
+
+    out.emit_label(body_label);
+
+    /* break/continue in the body jump straight to our labels */
+    func->loops.push_back({next_label, post_loop_label});
+    for (auto i : body) i->gen_code(out, scope, func);
+    func->loops.pop_back();
+
+    out.emit_label(next_label);
 
     if (next) {
-        output += next->gen_code(scope, func, false);
+        next->gen_code(out, scope, func, false);
     }
 
-    output += "    goto " + loop_label + "\n";
-    output += post_loop_label + ":";
-    return output;
+    if (cond) cond->gen_branch(out, scope, func, body_label, FALL_THROUGH);
+    else out.emit_jump(IR::Op::GOTO, body_label);
+
+    out.emit_label(post_loop_label);
 }
 
 /* WhileStatement */
 AST::WhileStatement::WhileStatement(location loc, Expression* cond, std::vector<Statement*> body)
     : Statement(loc), cond(cond), body(body) {}
 
-void AST::WhileStatement::write() {
-    std::cout << "<WhileStatement>\n";
-    std::cout << "(cond)\n";
-    cond->write();
-    std::cout << "(body)\n";
-    for (auto i : body) i->write();
-    std::cout << "</WhileStatement>\n";
+void AST::WhileStatement::write(std::ostream& out) {
+    out << "<WhileStatement>\n";
+    out << "(cond)\n";
+    cond->write(out);
+    out << "(body)\n";
+    for (auto i : body) i->write(out);
+    out << "</WhileStatement>\n";
 }
 
-void AST::WhileStatement::check_types(Scope* global_scope, Function* func, bool verbose) {
-    std::string cond_type = cond->type(global_scope, func);
+void AST::WhileStatement::check_types(Scope* global_scope, Function* func, std::ostream* trace) {
+    Type cond_type = cond->type(global_scope, func);
 
-    if (cond_type != "int" && cond_type != "char" && cond_type != "float") {
+    if (cond_type != types::INT && cond_type != types::CHAR && cond_type != types::FLOAT) {
         throw yy::parser::syntax_error(loc, "invalid condition type " + cond_type + " in 'while' statement");
     }
 
     for (auto i : body) {
-        i->check_types(global_scope, func, verbose);
+        i->check_types(global_scope, func, trace);
     }
 }
 
-void AST::WhileStatement::reserve(AST::Program* prg) {
-    cond->reserve(prg);
+void AST::WhileStatement::reserve(IR::ConstPool& pool) {
+    cond->reserve(pool);
 
     for (auto i : body) {
-        i->reserve(prg);
+        i->reserve(pool);
     }
 }
 
-std::string AST::WhileStatement::gen_code(Scope* scope, Function* func) {
-    /* we only need a single label at the beginning of the loop,
-     * and another one after the loop.
-     * as we evaluate the conditional expression every time, we place the
-     * label marker immediately before it */
+void AST::WhileStatement::fold(FoldContext& ctx) {
+    cond = cond->fold(ctx);
+
+    for (auto i : body) {
+        i->fold(ctx);
+    }
+}
 
-    std::string loop_label = func->make_label(), post_loop_label = func->make_label(), output;
-    std::string cond_type = cond->type(scope, func);
+void AST::WhileStatement::gen_code(IR::Buffer& out, Scope* scope, Function* func) {
+    /* the loop is rotated: the condition is tested once before the loop,
+     * and again after the body with a single branch back to the top, so
+     * every iteration only takes one jump. continue goes to the bottom test */
 
-    /* generate body code early, so we can backpatch break/continue */
-    std::string body_code;
-    for (auto i : body) body_code += i->gen_code(scope, func);
+    int body_label = func->make_label(), cond_label = func->make_label(), post_loop_label = func->make_label();
 
-    output += loop_label + ":";
-    output += cond->gen_code(scope, func, true);
-    output += std::string("    ==0") + cond_type[0] + " " + post_loop_label + "\n";
-    
-    /* perform any needed backpatching */
-    body_code = backpatch(body_code, "<PRELOOP>", loop_label);
-    body_code = backpatch(body_code, "<POSTLOOP>", post_loop_label);
+    cond->gen_branch(out, scope, func, FALL_THROUGH, post_loop_label);
+    out.emit_label(body_label);
 
-    output += body_code;
-    output += "    goto " + loop_label + "\n";
-    output += post_loop_label + ":";
+    /* break/continue in the body jump straight to our labels */
+    func->loops.push_back({cond_label, post_loop_label});
+    for (auto i : body) i->gen_code(out, scope, func);
+    func->loops.pop_back();
 
-    return output;
+    out.emit_label(cond_label);
+    cond->gen_branch(out, scope, func, body_label, FALL_THROUGH);
+    out.emit_label(post_loop_label);
 }
 
 /* DoWhileStatement */
 AST::DoWhileStatement::DoWhileStatement(location loc, Expression* cond, std::vector<Statement*> body)
     : Statement(loc), cond(cond), body(body) {}
 
-void AST::DoWhileStatement::write() {
-    std::cout << "<DoWhileStatement>\n";
-    std::cout << "(cond)\n";
-    cond->write();
-    std::cout << "(body)\n";
-    for (auto i : body) i->write();
-    std::cout << "</DoWhileStatement>\n";
+void AST::DoWhileStatement::write(std::ostream& out) {
+    out << "<DoWhileStatement>\n";
+    out << "(cond)\n";
+    cond->write(out);
+    out << "(body)\n";
+    for (auto i : body) i->write(out);
+    out << "</DoWhileStatement>\n";
 }
 
-void AST::DoWhileStatement::check_types(Scope* global_scope, Function* func, bool verbose) {
-    std::string cond_type = cond->type(global_scope, func);
+void AST::DoWhileStatement::check_types(Scope* global_scope, Function* func, std::ostream* trace) {
+    Type cond_type = cond->type(global_scope, func);
 
-    if (cond_type != "int" && cond_type != "char" && cond_type != "float") {
+    if (cond_type != types::INT && cond_type != types::CHAR && cond_type != types::FLOAT) {
         throw yy::parser::syntax_error(loc, "invalid condition type " + cond_type + " in 'while' statement");
     }
 
     for (auto i : body) {
-        i->check_types(global_scope, func, verbose);
+        i->check_types(global_scope, func, trace);
     }
 }
 
-void AST::DoWhileStatement::reserve(AST::Program* prg) {
-    cond->reserve(prg);
+void AST::DoWhileStatement::reserve(IR::ConstPool& pool) {
+    cond->reserve(pool);
 
     for (auto i : body) {
-        i->reserve(prg);
+        i->reserve(pool);
     }
 }
 
-std::string AST::DoWhileStatement::gen_code(Scope* scope, Function* func) {
+void AST::DoWhileStatement::fold(FoldContext& ctx) {
+    cond = cond->fold(ctx);
+
+    for (auto i : body) {
+        i->fold(ctx);
+    }
+}
+
+void AST::DoWhileStatement::gen_code(IR::Buffer& out, Scope* scope, Function* func) {
     /* very similar to WhileStatement, except evaluation of conditional
      * is moved after the body code */
 
     /* we actually need 3 labels, as continue; jumps before the conditional evaluation but after the code */
 
-    std::string loop_label = func->make_label(), post_loop_label = func->make_label(), output;
-    std::string pre_cond_label = func->make_label();
-    std::string cond_type = cond->type(scope, func);
-
-    /* generate body code early, so we can backpatch break/continue */
-    std::string body_code;
-    for (auto i : body) body_code += i->gen_code(scope, func);
-
-    output += loop_label + ":";
-    
-    /* perform any needed backpatching */
-    body_code = backpatch(body_code, "<PRELOOP>", pre_cond_label);
-    body_code = backpatch(body_code, "<POSTLOOP>", post_loop_label);
-    output += body_code;
-    output += pre_cond_label + ":" + cond->gen_code(scope, func, true);
-    output += std::string("    !=0") + cond_type[0] + " " + loop_label + "\n";
-    output += post_loop_label + ":";
-
-    return output;
+    int loop_label = func->make_label(), post_loop_label = func->make_label();
+    int pre_cond_label = func->make_label();
+
+    out.emit_label(loop_label);
+
+    /* break/continue in the body jump straight to our labels */
+    func->loops.push_back({pre_cond_label, post_loop_label});
+    for (auto i : body) i->gen_code(out, scope, func);
+    func->loops.pop_back();
+
+    out.emit_label(pre_cond_label);
+    cond->gen_branch(out, scope, func, loop_label, FALL_THROUGH);
+    out.emit_label(post_loop_label);
 }
@@ -11,22 +11,23 @@ namespace AST {
     public:
         Statement(location loc);
 
-        virtual void check_types(Scope* global_scope, Function* func, bool verbose);
-        virtual void reserve(AST::Program* prg);
-        virtual std::string gen_code(Scope* global_scope, Function* func);
+        virtual void check_types(Scope* global_scope, Function* func, std::ostream* trace);
+        virtual void reserve(IR::ConstPool& pool);
+        virtual void gen_code(IR::Buffer& out, Scope* global_scope, Function* func);
 
-        /* backpatch is just a string substitution */
-        std::string backpatch(std::string code, std::string sub, std::string repl);
+        /* fold the constant subexpressions of the statement, see Expression::fold() */
+        virtual void fold(FoldContext& ctx);
     };
 
     class ExpressionStatement : public Statement {
     public:
         ExpressionStatement(location loc, Expression* expr);
-        void write();
+        void write(std::ostream& out);
 
-        void check_types(Scope* global_scope, Function* func, bool verbose);
-        void reserve(AST::Program* prg);
-        std::string gen_code(Scope* global_scope, Function* func);
+        void check_types(Scope* global_scope, Function* func, std::ostream* trace);
+        void reserve(IR::ConstPool& pool);
+        void fold(FoldContext& ctx);
+        void gen_code(IR::Buffer& out, Scope* global_scope, Function* func);
 
         Expression* expr;
     };
@@ -35,24 +36,25 @@ namespace AST {
     public:
         BreakStatement(location);
 
-        std::string gen_code(Scope* scope, Function* func);
+        void gen_code(IR::Buffer& out, Scope* scope, Function* func);
     };
 
     class ContinueStatement : public Statement {
     public:
         ContinueStatement(location);
 
-        std::string gen_code(Scope* scope, Function* func);
+        void gen_code(IR::Buffer& out, Scope* scope, Function* func);
     };
 
     class ReturnStatement : public Statement {
     public:
         ReturnStatement(location, Expression* expr);
 
-        void check_types(Scope* global_scope, Function* func, bool verbose);
-        void write();
-        void reserve(AST::Program* prg);
-        std::string gen_code(Scope* global_scope, Function* func);
+        void check_types(Scope* global_scope, Function* func, std::ostream* trace);
+        void write(std::ostream& out);
+        void reserve(IR::ConstPool& pool);
+        void fold(FoldContext& ctx);
+        void gen_code(IR::Buffer& out, Scope* global_scope, Function* func);
 
         Expression* expr;
     };
@@ -62,11 +64,12 @@ namespace AST {
         IfStatement(location, Expression* cond, std::vector<Statement*> body);
         IfStatement(location, Expression* cond, std::vector<Statement*> body, std::vector<Statement*> else_body);
 
-        void write();
-        void check_types(Scope* global_scope, Function* func, bool verbose);
-        void reserve(AST::Program* prg);
+        void write(std::ostream& out);
+        void check_types(Scope* global_scope, Function* func, std::ostream* trace);
+        void reserve(IR::ConstPool& pool);
+        void fold(FoldContext& ctx);
 
-        std::string gen_code(Scope* scope, Function* func);
+        void gen_code(IR::Buffer& out, Scope* scope, Function* func);
 
         bool has_else;
         Expression* cond;
@@ -77,11 +80,12 @@ namespace AST {
     public:
         ForStatement(location, Expression* init, Expression* cond, Expression* next, std::vector<Statement*> body);
 
-        void write();
-        void check_types(Scope* global_scope, Function* func, bool verbose);
-        void reserve(AST::Program* prg);
+        void write(std::ostream& out);
+        void check_types(Scope* global_scope, Function* func, std::ostream* trace);
+        void reserve(IR::ConstPool& pool);
+        void fold(FoldContext& ctx);
 
-        std::string gen_code(Scope* scope, Function* func);
+        void gen_code(IR::Buffer& out, Scope* scope, Function* func);
 
         /* 3 optional values force us to use NULL pointers when there is no expression */
         Expression* init, *cond, *next;
@@ -92,11 +96,12 @@ namespace AST {
     public:
         WhileStatement(location, Expression* cond, std::vector<Statement*> body);
 
-        void write();
-        void check_types(Scope* global_scope, Function* func, bool verbose);
-        void reserve(AST::Program* prg);
+        void write(std::ostream& out);
+        void check_types(Scope* global_scope, Function* func, std::ostream* trace);
+        void reserve(IR::ConstPool& pool);
+        void fold(FoldContext& ctx);
 
-        std::string gen_code(Scope* scope, Function* func);
+        void gen_code(IR::Buffer& out, Scope* scope, Function* func);
 
         Expression* cond;
         std::vector<Statement*> body;
@@ -106,11 +111,12 @@ namespace AST {
     public:
         DoWhileStatement(location, Expression* cond, std::vector<Statement*> body);
 
-        void write();
-        void check_types(Scope* global_scope, Function* func, bool verbose);
-        void reserve(AST::Program* prg);
+        void write(std::ostream& out);
+        void check_types(Scope* global_scope, Function* func, std::ostream* trace);
+        void reserve(IR::ConstPool& pool);
+        void fold(FoldContext& ctx);
 
-        std::string gen_code(Scope* scope, Function* func);
+        void gen_code(IR::Buffer& out, Scope* scope, Function* func);
 
         Expression* cond;
         std::vector<Statement*> body;
@@ -0,0 +1,56 @@
+#include "types.hh"
+
+#include <cstring>
+
+char AST::Type::suffix() const {
+    switch (kind) {
+    case Kind::CHAR:  return 'c';
+    case Kind::INT:   return 'i';
+    case Kind::FLOAT: return 'f';
+    default:          return 0;
+    }
+}
+
+std::string AST::Type::str() const {
+    std::string out;
+
+    switch (kind) {
+    case Kind::NONE:  out = "NOTYPE"; break;
+    case Kind::VOID:  out = "void"; break;
+    case Kind::CHAR:  out = "char"; break;
+    case Kind::INT:   out = "int"; break;
+    case Kind::FLOAT: out = "float"; break;
+    }
+
+    if (array) out += "[]";
+    return out;
+}
+
+AST::Type AST::types::from_name(const char* name) {
+    if (!strcmp(name, "void")) return VOID;
+    if (!strcmp(name, "char")) return CHAR;
+    if (!strcmp(name, "int")) return INT;
+    if (!strcmp(name, "float")) return FLOAT;
+
+    return NOTYPE;
+}
+
+std::string AST::operator+(const std::string& a, const Type& b) {
+    return a + b.str();
+}
+
+std::string AST::operator+(const Type& a, const std::string& b) {
+    return a.str() + b;
+}
+
+std::string AST::operator+(const char* a, const Type& b) {
+    return a + b.str();
+}
+
+std::string AST::operator+(const Type& a, const char* b) {
+    return a.str() + b;
+}
+
+std::ostream& AST::operator<<(std::ostream& out, const Type& t) {
+    return out << t.str();
+}
@@ -0,0 +1,64 @@
+#pragma once
+
+/*
+ * types.hh
+ * declares the type representation used by the type checker and code generator
+ *
+ * a type is a base kind plus an array flag, small enough to pass by value.
+ * types are only spelled out ("int", "char[]", ...) for diagnostics.
+ */
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+namespace AST {
+    struct Type {
+        enum class Kind : uint8_t {
+            NONE,
+            VOID,
+            CHAR,
+            INT,
+            FLOAT,
+        };
+
+        constexpr Type(Kind kind = Kind::NONE, bool array = false) : kind(kind), array(array) {}
+
+        /* the type of one element, e.g. int[] -> int */
+        constexpr Type element() const { return Type(kind); }
+
+        /* char, int or float */
+        constexpr bool is_scalar() const { return !array && (kind == Kind::CHAR || kind == Kind::INT || kind == Kind::FLOAT); }
+
+        constexpr bool operator==(const Type& o) const { return kind == o.kind && array == o.array; }
+        constexpr bool operator!=(const Type& o) const { return !(*this == o); }
+
+        /* opcode suffix for operations on values of this type ('c', 'i', 'f') */
+        char suffix() const;
+        std::string str() const;
+
+        Kind kind;
+        bool array;
+    };
+
+    namespace types {
+        constexpr Type NOTYPE;
+        constexpr Type VOID(Type::Kind::VOID);
+        constexpr Type CHAR(Type::Kind::CHAR);
+        constexpr Type INT(Type::Kind::INT);
+        constexpr Type FLOAT(Type::Kind::FLOAT);
+
+        /* the array type with elements of 'base', e.g. int -> int[] */
+        constexpr Type array_of(Type base) { return Type(base.kind, true); }
+
+        /* look up a type keyword as matched by the scanner */
+        Type from_name(const char* name);
+    }
+
+    /* string building helpers for diagnostics */
+    std::string operator+(const std::string& a, const Type& b);
+    std::string operator+(const Type& a, const std::string& b);
+    std::string operator+(const char* a, const Type& b);
+    std::string operator+(const Type& a, const char* b);
+    std::ostream& operator<<(std::ostream& out, const Type& t);
+}
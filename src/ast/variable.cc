@@ -1,22 +1,22 @@
 #include "variable.hh"
 
-AST::VariableName::VariableName(location loc, std::string name) : Node(loc), name(name), is_array(false) {}
-AST::VariableName::VariableName(location loc, std::string name, int arr_size) : Node(loc), name(name), is_array(true), array_size(arr_size) {}
+AST::VariableName::VariableName(location loc, util::Atom name) : Node(loc), name(name), is_array(false) {}
+AST::VariableName::VariableName(location loc, util::Atom name, int arr_size) : Node(loc), name(name), is_array(true), array_size(arr_size) {}
 
-void AST::VariableName::write() {
-    std::cout << "<VariableName name=\"" << name << "\" is_array=" << is_array;
-    if (is_array) std::cout << " array_size=" << array_size;
-    std::cout << " />\n";
+void AST::VariableName::write(std::ostream& out) {
+    out << "<VariableName name=\"" << name << "\" is_array=" << is_array;
+    if (is_array) out << " array_size=" << array_size;
+    out << " />\n";
 }
 
-AST::Variable::Variable(location loc, std::string base_type, AST::VariableName* name) : Expression(loc), base_type(base_type), name(name) {}
+AST::Variable::Variable(location loc, Type base_type, AST::VariableName* name) : Expression(loc), base_type(base_type), name(name) {}
 
-std::string AST::Variable::type() {
-    return base_type + (name->is_array ? "[]" : "");
+AST::Type AST::Variable::type() {
+    return name->is_array ? types::array_of(base_type) : base_type;
 }
 
-void AST::Variable::write() {
-    std::cout << "<Variable base_type=" << base_type << ">\n";
-    name->write();
-    std::cout << "</Variable>\n";
+void AST::Variable::write(std::ostream& out) {
+    out << "<Variable base_type=" << base_type << ">\n";
+    name->write(out);
+    out << "</Variable>\n";
 }
@@ -5,30 +5,30 @@
 namespace AST {
     class VariableName : public Node {
     public:
-        VariableName(location loc, std::string name);
-        VariableName(location loc, std::string name, int arr_size);
+        VariableName(location loc, util::Atom name);
+        VariableName(location loc, util::Atom name, int arr_size);
 
-        void write();
+        void write(std::ostream& out);
 
-        std::string name;
+        util::Atom name;
         bool is_array;
         int array_size;
     };
 
     class Variable : public Expression {
     public:
-        Variable(location loc, std::string base_type, VariableName* name);
+        Variable(location loc, Type base_type, VariableName* name);
 
-        void write();
-        std::string type();
+        void write(std::ostream& out);
+        Type type();
 
-        std::string base_type;
+        Type base_type;
         VariableName* name;
 
         /* 
          * generated code location -- set either by AST::Program (globals)
          * or by AST::Function (locals, parameters)
          */
-        std::string code_location;
+        IR::Slot code_location;
     };
 }
@@ -0,0 +1,77 @@
+#include "cache.hh"
+#include "version.hh"
+#include "util.hh"
+
+#include <cerrno>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <sys/stat.h>
+#include <unistd.h>
+
+uint64_t util::hash_bytes(const void* data, size_t size, uint64_t seed) {
+    const unsigned char* p = static_cast<const unsigned char*>(data);
+    uint64_t h = seed;
+
+    for (size_t i = 0; i < size; ++i) {
+        h ^= p[i];
+        h *= 0x100000001b3ULL;
+    }
+
+    return h;
+}
+
+static std::string hex(uint64_t v) {
+    char buf[17];
+    snprintf(buf, sizeof buf, "%016llx", (unsigned long long) v);
+    return buf;
+}
+
+util::Cache::Cache(const std::string& dir) : dir(dir) {}
+
+bool util::Cache::make_key(const std::string& source, const std::string& options, std::string& key) const {
+    MappedFile file;
+    if (!file.open(source)) return false;
+
+    /* the build stamp keeps entries from one compiler binary away from the next */
+    key = "src=" + hex(hash_bytes(file.data, file.size)) + ":" + std::to_string(file.size);
+    key += " version=" COMPILER_VERSION " build=" __DATE__ " " __TIME__;
+    key += " " + options;
+    return true;
+}
+
+std::string util::Cache::entry_path(const std::string& key) const {
+    return dir + "/" + hex(hash_bytes(key.data(), key.size()));
+}
+
+bool util::Cache::lookup(const std::string& key, std::string& data) const {
+    MappedFile entry;
+    if (!entry.open(entry_path(key))) return false;
+
+    /* the entry starts with its key on a line of its own */
+    const char* bytes = static_cast<const char*>(entry.data);
+    size_t header = key.size() + 1;
+
+    if (entry.size < header || key.compare(0, key.size(), bytes, key.size()) || bytes[key.size()] != '\n') return false;
+
+    data.assign(bytes + header, entry.size - header);
+    return true;
+}
+
+void util::Cache::store(const std::string& key, const std::string& data) const {
+    if (mkdir(dir.c_str(), 0777) < 0 && errno != EEXIST) return;
+
+    std::string path = entry_path(key);
+    std::string temp = path + ".tmp" + std::to_string(getpid()) + "." + hex((uint64_t) &data);
+
+    {
+        std::ofstream out(temp, std::ios::binary);
+        out << key << "\n" << data;
+        if (!out) {
+            unlink(temp.c_str());
+            return;
+        }
+    }
+
+    if (rename(temp.c_str(), path.c_str()) < 0) unlink(temp.c_str());
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+/*
+ * cache.hh
+ * declares the on-disk compile cache
+ *
+ * an entry holds the generated output for one source file and is named by a
+ * hash of its key: the hash and size of the source bytes, the compiler
+ * version and build, and every option that changes the output. the full key
+ * is stored in the entry and compared on lookup, so a collision of the file
+ * name is a miss. entries are written to a temporary file and renamed into
+ * place, so concurrent compilers never see a partial entry.
+ */
+
+#include <cstdint>
+#include <string>
+
+namespace util {
+    /* 64-bit FNV-1a */
+    uint64_t hash_bytes(const void* data, size_t size, uint64_t seed = 0xcbf29ce484222325ULL);
+
+    class Cache {
+    public:
+        /* the directory is created on the first store() */
+        explicit Cache(const std::string& dir);
+
+        /* key for compiling 'source' with the options in 'options', false if it can't be read */
+        bool make_key(const std::string& source, const std::string& options, std::string& key) const;
+
+        /* true and the cached output in 'data' on a hit */
+        bool lookup(const std::string& key, std::string& data) const;
+
+        /* save the output for 'key', failures only cost a future miss */
+        void store(const std::string& key, const std::string& data) const;
+
+    private:
+        std::string dir;
+
+        std::string entry_path(const std::string& key) const;
+    };
+}
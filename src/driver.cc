@@ -1,25 +1,36 @@
 #include "driver.hh"
 #include "util.hh"
+#include "ir/binary.hh"
 
-extern char* yytext;
+#include <cerrno>
+#include <cstring>
+#include <sstream>
 
-driver::driver() : trace_parsing(false), trace_scanning(false) {}
+driver::driver()
+    : result(NULL), tokens_scanned(0), trace_parsing(false), codegen_jobs(1), target("ir"), emit("text"), deterministic(false), out(&std::cout), err(&std::cerr), trace_scanning(false), scanner(NULL) {}
 
 int driver::parse(const std::string& f) {
+    util::Stats::Timer timer(stats, "parse");
+
     file = f;
     location.initialize(&file);
-    scan_begin();
+    if (!scan_begin()) return 1;
+
     yy::parser parse(*this);
     parse.set_debug_level(trace_parsing);
+    parse.set_debug_stream(*err);
+
     int res = parse();
     scan_end();
     return res;
 }
 
 int driver::scan(const std::string& f) {
+    util::Stats::Timer timer(stats, "scan");
+
     file = f;
     location.initialize(&file);
-    scan_begin();
+    if (!scan_begin()) return 1;
 
     try {
         while (true) {
@@ -27,12 +38,12 @@ int driver::scan(const std::string& f) {
             auto loc = tok.location;
 
             if (tok.type == yy::parser::token::TOK_END) break;
-            std::cout << "File " << *(loc.begin.filename) << " Line " << loc.begin.line << " Token ";
-            std::cout << util::symbol_type_name(tok) << " Text '" << yytext << "'\n";
+            *out << "File " << *(loc.begin.filename) << " Line " << loc.begin.line << " Token ";
+            *out << util::symbol_type_name(tok) << " Text '" << scan_text() << "'\n";
         }
     } catch (yy::parser::syntax_error& e) {
-        std::cerr << "Error in " << *(e.location.begin.filename) << " line " << e.location.begin.line << ":\n\t";
-        std::cerr << e.what() << "\n";
+        *err << "Error in " << *(e.location.begin.filename) << " line " << e.location.begin.line << ":\n\t";
+        *err << e.what() << "\n";
         scan_end();
         return -1;
     }
@@ -44,27 +55,136 @@ int driver::scan(const std::string& f) {
 int driver::check_types(bool verbose) {
     if (!result) return 1;
 
+    util::Stats::Timer timer(stats, "check_types");
+
     try {
-        result->check_types(verbose);
+        result->check_types(verbose ? out : NULL);
     } catch (yy::parser::syntax_error& e) {
-        std::cerr << "Error in " << *(e.location.begin.filename) << " line " << e.location.begin.line << ":\n\t";
-        std::cerr << e.what() << "\n";
+        *err << "Error in " << *(e.location.begin.filename) << " line " << e.location.begin.line << ":\n\t";
+        *err << e.what() << "\n";
         return -1;
     }
 
     return 0;
 }
 
-int driver::generate_ir() {
+int driver::optimize() {
     if (!result) return 1;
 
+    passes.dump = err;
+    passes.run_ast(*result, stats);
+    return 0;
+}
+
+int driver::generate_ir(std::ostream& dest) {
+    if (!result) return 1;
+
+    passes.dump = err;
+    result->deterministic = deterministic;
+
     try {
-        ir_result = result->generate_ir();
+        util::Stats::Timer timer(stats, "codegen");
+
+        if (target == "x86-64") dest << result->generate_x86_64(codegen_jobs, &passes);
+        else if (emit == "bin") dest << IR::write_binary(result->generate_buffer(codegen_jobs, &passes));
+        else result->generate_ir(dest, codegen_jobs, &passes);
     } catch (yy::parser::syntax_error& e) {
-        std::cerr << "Error in " << *(e.location.begin.filename) << " line " << e.location.begin.line << ":\n\t";
-        std::cerr << e.what() << "\n";
+        *err << "Error in " << *(e.location.begin.filename) << " line " << e.location.begin.line << ":\n\t";
+        *err << e.what() << "\n";
+        return -1;
+    } catch (std::runtime_error& e) {
+        *err << "Error in " << file << ":\n\t" << e.what() << "\n";
         return -1;
     }
 
+    /* the IR passes ran inside codegen, count them on their own instead */
+    const PassResults& r = result->pass_results;
+
+    for (size_t k = 0; k < r.wall_ms.size(); ++k) {
+        if (PassManager::passes[passes.pipeline[k]].kind != PassManager::IR_PASS) continue;
+
+        stats.add(PassManager::passes[passes.pipeline[k]].name, r.wall_ms[k], r.cpu_ms[k]);
+        stats.add("codegen", -r.wall_ms[k], -r.cpu_ms[k]);
+    }
+
     return 0;
 }
+
+std::string driver::options_key() const {
+    std::string key = "target=" + target + " emit=" + emit + " passes=" + passes.str();
+    if (deterministic) key += " deterministic";
+
+    if (passes.runs(PassManager::PEEPHOLE)) {
+        key += " peephole=";
+        for (int i = 0; i < IR::Peephole::NUM_RULES; ++i) key += passes.peephole.enabled[i] ? '1' : '0';
+    }
+
+    return key;
+}
+
+int driver::disassemble(const std::string& f) {
+    file = f;
+
+    util::MappedFile mapped;
+    IR::BinaryProgram program;
+    std::string error;
+
+    if (!mapped.open(f)) {
+        *err << "Error in " << f << ":\n\t" << strerror(errno) << "\n";
+        return -1;
+    }
+
+    if (!IR::load_binary(mapped.data, mapped.size, program, error)) {
+        *err << "Error in " << f << ":\n\t" << error << "\n";
+        return -1;
+    }
+
+    *out << IR::disassemble(program).str();
+    return 0;
+}
+
+int driver::run_ir() {
+    /* the interpreter reads the same text -i prints */
+    std::ostringstream text;
+    if (generate_ir(text)) return -1;
+
+    util::Stats::Timer timer(stats, "run");
+
+    try {
+        IR::Bytecode bc = IR::assemble(text.str());
+        IR::run(bc, stdin, *out, run_stats);
+    } catch (std::runtime_error& e) {
+        out->flush();
+        *err << "Runtime error in " << file << ":\n\t" << e.what() << "\n";
+        return -1;
+    }
+
+    return 0;
+}
+
+void driver::collect_stats() {
+    stats.set("tokens_scanned", tokens_scanned);
+    stats.set("ast_nodes", arena.objects());
+    stats.set("arena_bytes_used", arena.bytes_used());
+    stats.set("arena_bytes_reserved", arena.bytes_reserved());
+    stats.set("peak_rss_kb", util::peak_rss_kb());
+
+    if (result) {
+        stats.set("expressions_folded", result->expressions_folded);
+        stats.set("constants_requested", result->constants_requested);
+        stats.set("constants_emitted", result->constants_emitted);
+        stats.set("labels_made", result->labels_made);
+        stats.set("blocks_unreachable", result->pass_results.cfg.unreachable);
+        stats.set("jumps_threaded", result->pass_results.cfg.threaded);
+        stats.set("blocks_merged", result->pass_results.cfg.merged);
+        stats.set("returns_duplicated", result->pass_results.cfg.duplicated);
+        stats.set("locals_promoted", result->pass_results.ssa.promoted);
+        stats.set("dead_values_removed", result->pass_results.ssa.removed);
+        stats.set("functions_not_promoted", result->pass_results.ssa.skipped);
+        stats.set("instructions_emitted", result->instructions_emitted);
+    }
+
+    for (auto& i : arena.objects_by_type()) {
+        stats.set(i.first, i.second, "ast_nodes_by_class");
+    }
+}
@@ -1,18 +1,32 @@
 /*
  * driver.hh
  * declares the "driver" class which stores a parsing context
+ *
+ * a driver owns everything needed to compile one file, including the
+ * scanner state, so separate drivers can be used from separate threads.
  */
 
 #pragma once
 
+#include <iostream>
 #include <string>
 #include <map>
 
 #include "parser.hh"
 #include "ast.hh"
+#include "arena.hh"
+#include "passes.hh"
+#include "stats.hh"
+#include "ir/interp.hh"
+
+/* opaque reentrant scanner state, matches the typedef flex generates */
+#ifndef YY_TYPEDEF_YY_SCANNER_T
+#define YY_TYPEDEF_YY_SCANNER_T
+typedef void* yyscan_t;
+#endif
 
 /* define the correct yylex prototype for flex */
-#define YY_DECL yy::parser::symbol_type yylex (driver& drv)
+#define YY_DECL yy::parser::symbol_type yylex (driver& drv, yyscan_t yyscanner)
 YY_DECL;
 
 class driver {
@@ -28,22 +42,71 @@ public:
     /* execute type checker on result */
     int check_types(bool verbose);
 
-    /* execute intermediate gen on result */
-    int generate_ir();
+    /* run the AST passes of the pipeline on result */
+    int optimize();
+
+    /* execute intermediate gen on result, writing it to 'dest' as it is generated */
+    int generate_ir(std::ostream& dest);
+
+    /* print the text form of the binary IR file f */
+    int disassemble(const std::string& f);
+
+    /* generate, assemble and run the IR, reading stdin and writing program output to out */
+    int run_ir();
+
+    /* fill in the counters of 'stats' from the last compile */
+    void collect_stats();
+
+    /* owns the whole AST, released when the driver is destroyed */
+    util::Arena arena;
 
     /* parsing result */
     AST::Program* result;
 
-    /* IR result */
-    std::string ir_result;
+    /* time per phase and counters for --time-passes and --stats */
+    util::Stats stats;
+    uint64_t tokens_scanned;
+
+    /* statistics of the last run_ir() */
+    IR::RunStats run_stats;
 
     /* parsing config */
     std::string file;
     bool trace_parsing;
 
+    /* number of threads generating function bodies */
+    int codegen_jobs;
+
+    /* output of generate_ir(): "ir" for the stack IR or "x86-64" for assembly */
+    std::string target;
+
+    /* form of the stack IR: "text", or "bin" for the format in ir/binary.hh */
+    std::string emit;
+
+    /* optimization pipeline, run by optimize() and generate_ir() */
+    PassManager passes;
+
+    /* output only depends on the input, see AST::Program::deterministic */
+    bool deterministic;
+
+    /* every option above that changes the output of generate_ir(), for cache keys */
+    std::string options_key() const;
+
+    /* output streams, stdout and stderr unless redirected */
+    std::ostream* out;
+    std::ostream* err;
+
     /* encapsulate flex */
-    void scan_begin();
+    bool scan_begin();
     void scan_end();
+    const char* scan_text();
     bool trace_scanning;
     yy::location location;
+    yyscan_t scanner;
 };
+
+/* the parser calls the scanner through the driver */
+inline yy::parser::symbol_type yylex(driver& drv) {
+    ++drv.tokens_scanned;
+    return yylex(drv, drv.scanner);
+}
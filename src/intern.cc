@@ -0,0 +1,73 @@
+#include "intern.hh"
+
+#include <deque>
+#include <mutex>
+#include <unordered_map>
+
+namespace {
+    /* the interner is built on first use, so atoms can be made during static init */
+    struct Interner {
+        std::mutex lock;
+        std::deque<util::Atom::Entry> entries; /* deque keeps entry addresses stable */
+        std::unordered_map<std::string, const util::Atom::Entry*> index;
+    };
+
+    Interner& interner() {
+        static Interner* in = new Interner;
+        return *in;
+    }
+}
+
+util::Atom::Atom() {
+    static const Entry* empty = intern("", 0).entry;
+    entry = empty;
+}
+
+util::Atom util::intern(const char* s, size_t len) {
+    Interner& in = interner();
+
+    /* reuse a per-thread buffer for the lookup key so hits don't allocate */
+    static thread_local std::string key;
+    key.assign(s, len);
+
+    std::lock_guard<std::mutex> guard(in.lock);
+
+    auto it = in.index.find(key);
+    if (it != in.index.end()) return Atom(it->second);
+
+    in.entries.push_back({key, (unsigned) in.entries.size()});
+    const Atom::Entry* e = &in.entries.back();
+    in.index.emplace(key, e);
+
+    return Atom(e);
+}
+
+util::Atom util::intern(const std::string& s) {
+    return intern(s.data(), s.size());
+}
+
+size_t util::interned_count() {
+    Interner& in = interner();
+    std::lock_guard<std::mutex> guard(in.lock);
+    return in.entries.size();
+}
+
+std::string util::operator+(const std::string& a, const Atom& b) {
+    return a + b.str();
+}
+
+std::string util::operator+(const Atom& a, const std::string& b) {
+    return a.str() + b;
+}
+
+std::string util::operator+(const char* a, const Atom& b) {
+    return a + b.str();
+}
+
+std::string util::operator+(const Atom& a, const char* b) {
+    return a.str() + b;
+}
+
+std::ostream& util::operator<<(std::ostream& out, const Atom& a) {
+    return out << a.str();
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+/*
+ * intern.hh
+ * declares the global string interner
+ *
+ * identifiers and type names are interned once by the scanner. the resulting
+ * atoms share storage with every other atom of the same spelling, so copying
+ * one is free and comparing two is a pointer comparison.
+ */
+
+#include <cstddef>
+#include <functional>
+#include <ostream>
+#include <string>
+
+namespace util {
+    class Atom {
+    public:
+        /* the empty atom */
+        Atom();
+
+        const std::string& str() const { return entry->text; }
+        const char* c_str() const { return entry->text.c_str(); }
+        size_t size() const { return entry->text.size(); }
+        bool empty() const { return entry->text.empty(); }
+        char operator[](size_t i) const { return entry->text[i]; }
+
+        /* small integer handle, unique per spelling */
+        unsigned id() const { return entry->id; }
+
+        bool operator==(const Atom& o) const { return entry == o.entry; }
+        bool operator!=(const Atom& o) const { return entry != o.entry; }
+
+        struct Entry {
+            std::string text;
+            unsigned id;
+        };
+
+    private:
+        explicit Atom(const Entry* e) : entry(e) {}
+        const Entry* entry;
+
+        friend Atom intern(const char* s, size_t len);
+    };
+
+    /* intern a string, safe to call from multiple threads */
+    Atom intern(const char* s, size_t len);
+    Atom intern(const std::string& s);
+
+    /* number of distinct atoms interned so far */
+    size_t interned_count();
+
+    /* string building helpers for diagnostics */
+    std::string operator+(const std::string& a, const Atom& b);
+    std::string operator+(const Atom& a, const std::string& b);
+    std::string operator+(const char* a, const Atom& b);
+    std::string operator+(const Atom& a, const char* b);
+    std::ostream& operator<<(std::ostream& out, const Atom& a);
+}
+
+namespace std {
+    template <>
+    struct hash<util::Atom> {
+        size_t operator()(const util::Atom& a) const { return a.id(); }
+    };
+}
@@ -0,0 +1,221 @@
+#include "binary.hh"
+
+#include <cstring>
+#include <map>
+#include <vector>
+
+/* append the raw bytes of 'count' records to out */
+template <typename T>
+static void write_records(std::string& out, const T* records, size_t count) {
+    out.append(reinterpret_cast<const char*>(records), count * sizeof(T));
+}
+
+std::string IR::write_binary(const Buffer& program) {
+    std::vector<uint32_t> constants;
+    std::vector<BinaryFunction> functions;
+    std::vector<BinaryInsn> code;
+    std::string strings;
+    uint32_t globals = 0;
+
+    /* per function: label -> instruction index, and the jumps to patch at the end */
+    std::map<int, uint32_t> labels;
+    std::vector<std::pair<uint32_t, int>> fixups;
+
+    for (auto& i : program.code) {
+        switch (i.op) {
+        case Op::COMMENT:
+        case Op::CONSTANTS:
+        case Op::FUNCTIONS:
+            /* implied by the section sizes */
+            break;
+        case Op::WORD:
+            constants.push_back(i.value);
+            break;
+        case Op::GLOBALS:
+            globals = i.value;
+            break;
+        case Op::FUNC:
+            {
+                BinaryFunction f;
+                memset(&f, 0, sizeof f);
+                f.number = i.value;
+                f.name = strings.size();
+                f.first = code.size();
+                functions.push_back(f);
+
+                strings += program.strings[i.slot.index];
+                strings.push_back('\0');
+
+                labels.clear();
+                fixups.clear();
+            }
+            break;
+        case Op::PARAMS:
+            functions.back().params = i.value;
+            break;
+        case Op::RETURN:
+            functions.back().returns = i.value;
+            break;
+        case Op::LOCALS:
+            functions.back().locals = i.value;
+            break;
+        case Op::LABEL:
+            labels[i.value] = code.size();
+            break;
+        case Op::END_FUNC:
+            /* jumps hold the distance to their target */
+            for (auto& f : fixups) {
+                code[f.first].operand = (int32_t) (labels.at(f.second) - f.first);
+            }
+
+            functions.back().count = code.size() - functions.back().first;
+            break;
+        default:
+            {
+                BinaryInsn b;
+                b.op = (uint8_t) i.op;
+                b.type = (uint8_t) i.type;
+                b.seg = (uint8_t) i.slot.seg;
+                b.unused = 0;
+                b.operand = (i.slot.seg != Segment::NONE) ? i.slot.index : i.value;
+
+                if (is_jump(i.op)) fixups.push_back({code.size(), i.value});
+                code.push_back(b);
+            }
+            break;
+        }
+    }
+
+    while (strings.size() % 4) strings.push_back('\0');
+
+    BinaryHeader h;
+    memcpy(h.magic, BINARY_MAGIC, sizeof h.magic);
+    h.version = BINARY_VERSION;
+    h.num_constants = constants.size();
+    h.constants_offset = sizeof h;
+    h.num_globals = globals;
+    h.num_functions = functions.size();
+    h.functions_offset = h.constants_offset + constants.size() * sizeof(uint32_t);
+    h.num_insns = code.size();
+    h.code_offset = h.functions_offset + functions.size() * sizeof(BinaryFunction);
+    h.strings_size = strings.size();
+    h.strings_offset = h.code_offset + code.size() * sizeof(BinaryInsn);
+
+    std::string out;
+    out.reserve(h.strings_offset + h.strings_size);
+
+    write_records(out, &h, 1);
+    write_records(out, constants.data(), constants.size());
+    write_records(out, functions.data(), functions.size());
+    write_records(out, code.data(), code.size());
+    out += strings;
+
+    return out;
+}
+
+/* true if 'count' records of 'size' bytes at 'offset' lie inside the file */
+static bool section_fits(uint32_t offset, uint32_t count, size_t size, size_t file_size) {
+    return offset % 4 == 0 && offset <= file_size && (file_size - offset) / size >= count;
+}
+
+bool IR::load_binary(const void* data, size_t size, BinaryProgram& program, std::string& error) {
+    const char* bytes = static_cast<const char*>(data);
+
+    if (size < sizeof(BinaryHeader) || memcmp(bytes, BINARY_MAGIC, sizeof BINARY_MAGIC)) {
+        error = "not a binary IR file";
+        return false;
+    }
+
+    const BinaryHeader* h = reinterpret_cast<const BinaryHeader*>(bytes);
+
+    if (h->version != BINARY_VERSION) {
+        error = "binary IR version " + std::to_string(h->version) + " is not supported (expected " + std::to_string(BINARY_VERSION) + ")";
+        return false;
+    }
+
+    if (!section_fits(h->constants_offset, h->num_constants, sizeof(uint32_t), size) ||
+        !section_fits(h->functions_offset, h->num_functions, sizeof(BinaryFunction), size) ||
+        !section_fits(h->code_offset, h->num_insns, sizeof(BinaryInsn), size) ||
+        !section_fits(h->strings_offset, h->strings_size, 1, size) ||
+        (h->strings_size && bytes[h->strings_offset + h->strings_size - 1] != '\0')) {
+        error = "truncated or corrupt binary IR";
+        return false;
+    }
+
+    program.header = h;
+    program.constants = reinterpret_cast<const uint32_t*>(bytes + h->constants_offset);
+    program.functions = reinterpret_cast<const BinaryFunction*>(bytes + h->functions_offset);
+    program.code = reinterpret_cast<const BinaryInsn*>(bytes + h->code_offset);
+    program.strings = bytes + h->strings_offset;
+
+    for (uint32_t k = 0; k < h->num_functions; ++k) {
+        const BinaryFunction& f = program.functions[k];
+
+        if (f.name >= h->strings_size || f.first > h->num_insns || h->num_insns - f.first < f.count) {
+            error = "corrupt function table entry " + std::to_string(k);
+            return false;
+        }
+
+        for (uint32_t i = f.first; i < f.first + f.count; ++i) {
+            const BinaryInsn& b = program.code[i];
+            int64_t target = (int64_t) i + b.operand;
+
+            if (b.op < (uint8_t) Op::PUSH || b.op > (uint8_t) Op::RET || b.seg > (uint8_t) Segment::CONSTANT ||
+                (is_jump((Op) b.op) && (target < f.first || target > f.first + f.count))) {
+                error = "invalid instruction " + std::to_string(i) + " in function " + std::string(program.strings + f.name);
+                return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+IR::Buffer IR::disassemble(const BinaryProgram& program) {
+    const BinaryHeader* h = program.header;
+    Buffer out;
+
+    out.emit_value(Op::CONSTANTS, h->num_constants);
+    for (uint32_t k = 0; k < h->num_constants; ++k) out.emit_value(Op::WORD, program.constants[k]);
+
+    out.emit_value(Op::GLOBALS, h->num_globals);
+    out.emit_value(Op::FUNCTIONS, h->num_functions);
+
+    for (uint32_t k = 0; k < h->num_functions; ++k) {
+        const BinaryFunction& f = program.functions[k];
+        uint32_t end = f.first + f.count;
+
+        out.emit_text(Op::FUNC, f.number, program.strings + f.name);
+        out.emit_value(Op::PARAMS, f.params);
+        out.emit_value(Op::RETURN, f.returns);
+        out.emit_value(Op::LOCALS, f.locals);
+
+        /* number the jump targets in the order they appear */
+        std::map<uint32_t, int> labels;
+
+        for (uint32_t i = f.first; i < end; ++i) {
+            if (is_jump((Op) program.code[i].op)) labels[i + program.code[i].operand] = 0;
+        }
+
+        int next_label = 0;
+        for (auto& l : labels) l.second = next_label++;
+
+        for (uint32_t i = f.first; i <= end; ++i) {
+            auto l = labels.find(i);
+            if (l != labels.end()) out.emit_label(l->second);
+            if (i == end) break;
+
+            const BinaryInsn& b = program.code[i];
+            Instruction ins = {(Op) b.op, (char) b.type, Slot(), b.operand};
+
+            if (b.seg != (uint8_t) Segment::NONE) ins.slot = Slot((Segment) b.seg, b.operand);
+            if (is_jump(ins.op)) ins.value = labels[i + b.operand];
+
+            out.code.push_back(ins);
+        }
+
+        out.emit(Op::END_FUNC);
+    }
+
+    return out;
+}
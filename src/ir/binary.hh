@@ -0,0 +1,70 @@
+#pragma once
+
+/*
+ * ir/binary.hh
+ * declares the binary IR format, its writer and the disassembler
+ *
+ * the binary form holds the same program as the text IR, laid out so a
+ * mapped file can be used in place: a header, the constant words, the
+ * function table, the instructions and the function names. every field is
+ * a little endian 32-bit word and every section is 4 byte aligned.
+ * instructions are 8 bytes wide and jumps hold the distance to their target
+ * in instructions, so there are no labels to resolve.
+ *
+ * BINARY_VERSION must be bumped whenever the layout or the numbering of
+ * IR::Op changes.
+ */
+
+#include <cstdint>
+#include <string>
+
+#include "buffer.hh"
+
+namespace IR {
+    static const char BINARY_MAGIC[4] = {'C', 'I', 'R', 'B'};
+    static const uint32_t BINARY_VERSION = 1;
+
+    struct BinaryHeader {
+        char magic[4];
+        uint32_t version;
+        uint32_t num_constants, constants_offset; /* offsets are in bytes from the start of the file */
+        uint32_t num_globals;
+        uint32_t num_functions, functions_offset;
+        uint32_t num_insns, code_offset;
+        uint32_t strings_size, strings_offset;
+    };
+
+    struct BinaryFunction {
+        uint32_t number;
+        uint32_t name;   /* offset of the nul terminated name in the string section */
+        uint32_t params, returns, locals;
+        uint32_t first;  /* index of the first instruction */
+        uint32_t count;  /* number of instructions */
+    };
+
+    struct BinaryInsn {
+        uint8_t op;      /* IR::Op */
+        uint8_t type;    /* type suffix, 'c', 'i', 'f' or 0 */
+        uint8_t seg;     /* IR::Segment of the slot operand */
+        uint8_t unused;
+        int32_t operand; /* slot index, immediate, function number or jump distance */
+    };
+
+    /* a validated view of a binary program, pointing into the caller's memory */
+    struct BinaryProgram {
+        const BinaryHeader* header;
+        const uint32_t* constants;
+        const BinaryFunction* functions;
+        const BinaryInsn* code;
+        const char* strings;
+    };
+
+    /* encode a whole program buffer, as built by AST::Program::generate_buffer */
+    std::string write_binary(const Buffer& program);
+
+    /* check a binary program in place, false with a message in 'error' if it is malformed */
+    bool load_binary(const void* data, size_t size, BinaryProgram& program, std::string& error);
+
+    /* turn a binary program back into a buffer, with labels for the jump targets */
+    Buffer disassemble(const BinaryProgram& program);
+}
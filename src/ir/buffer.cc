@@ -0,0 +1,234 @@
+#include "buffer.hh"
+
+#include <cstdio>
+
+/* Slot */
+IR::Slot::Slot() : seg(Segment::NONE), index(0) {}
+IR::Slot::Slot(Segment seg, int index) : seg(seg), index(index) {}
+
+std::string IR::Slot::str() const {
+    switch (seg) {
+    case Segment::LOCAL:
+        return "L" + std::to_string(index);
+    case Segment::GLOBAL:
+        return "G" + std::to_string(index);
+    case Segment::CONSTANT:
+        return "C" + std::to_string(index);
+    default:
+        return "?";
+    }
+}
+
+/* Buffer */
+void IR::Buffer::emit(Op op, char type) {
+    code.push_back({op, type, Slot(), 0});
+}
+
+void IR::Buffer::emit(Op op, Slot s) {
+    code.push_back({op, 0, s, 0});
+}
+
+void IR::Buffer::emit_value(Op op, int32_t v, char type) {
+    code.push_back({op, type, Slot(), v});
+}
+
+void IR::Buffer::emit_text(Op op, int32_t v, const std::string& text) {
+    /* text operands live in a side table, the slot index refers to them */
+    code.push_back({op, 0, Slot(Segment::NONE, (int) strings.size()), v});
+    strings.push_back(text);
+}
+
+void IR::Buffer::emit_jump(Op op, int label, char type) {
+    code.push_back({op, type, Slot(), label});
+}
+
+void IR::Buffer::emit_label(int label) {
+    code.push_back({Op::LABEL, 0, Slot(), label});
+}
+
+void IR::Buffer::append(const Buffer& b) {
+    int base = (int) strings.size();
+
+    for (auto i : b.code) {
+        if (i.op == Op::COMMENT || i.op == Op::FUNC) i.slot.index += base;
+        code.push_back(i);
+    }
+
+    strings.insert(strings.end(), b.strings.begin(), b.strings.end());
+}
+
+void IR::Buffer::append(const Buffer& b, const std::vector<int>& const_map) {
+    size_t first = code.size();
+    append(b);
+
+    for (size_t i = first; i < code.size(); ++i) {
+        if (code[i].slot.seg == Segment::CONSTANT) code[i].slot.index = const_map[code[i].slot.index];
+    }
+}
+
+size_t IR::Buffer::size() const {
+    return code.size();
+}
+
+void IR::Buffer::clear() {
+    code.clear();
+    strings.clear();
+}
+
+std::string IR::Buffer::str() const {
+    std::string out;
+    serialize(out);
+    return out;
+}
+
+void IR::Buffer::serialize(std::string& out) const {
+    /* rough guess at the output size to avoid most reallocation */
+    out.reserve(out.size() + code.size() * 12);
+
+    char buf[16];
+
+    for (auto& i : code) {
+        switch (i.op) {
+        case Op::COMMENT:
+            out += "; " + strings[i.slot.index] + "\n";
+            break;
+        case Op::CONSTANTS:
+            out += ".CONSTANTS " + std::to_string(i.value) + "\n";
+            break;
+        case Op::WORD:
+            snprintf(buf, sizeof buf, "0x%08x", (uint32_t) i.value);
+            out += "  ";
+            out += buf;
+            out += "\n";
+            break;
+        case Op::GLOBALS:
+            out += "\n.GLOBALS " + std::to_string(i.value) + "\n";
+            break;
+        case Op::FUNCTIONS:
+            out += "\n.FUNCTIONS " + std::to_string(i.value) + "\n";
+            break;
+        case Op::FUNC:
+            out += "\n.FUNC " + std::to_string(i.value) + " " + strings[i.slot.index] + "\n";
+            break;
+        case Op::PARAMS:
+            out += "  .params " + std::to_string(i.value) + "\n";
+            break;
+        case Op::RETURN:
+            out += "  .return " + std::to_string(i.value) + " \n";
+            break;
+        case Op::LOCALS:
+            out += "  .locals " + std::to_string(i.value) + "\n";
+            break;
+        case Op::END_FUNC:
+            out += ".end FUNC\n";
+            break;
+        case Op::LABEL:
+            /* labels prefix the next instruction on the same line */
+            out += "I" + std::to_string(i.value) + ":";
+            break;
+        default:
+            out += "    " + mnemonic(i);
+
+            switch (i.op) {
+            case Op::PUSH:
+            case Op::PTRTO:
+            case Op::POP:
+                out += " " + i.slot.str();
+                break;
+            case Op::PUSHV:
+                snprintf(buf, sizeof buf, " 0x%x", (uint32_t) i.value);
+                out += buf;
+                break;
+            case Op::MOVE:
+            case Op::CALL:
+                out += " " + std::to_string(i.value);
+                break;
+            default:
+                if (is_jump(i.op)) out += " I" + std::to_string(i.value);
+                break;
+            }
+
+            out += "\n";
+            break;
+        }
+    }
+}
+
+std::string IR::mnemonic(const Instruction& i) {
+    std::string t(i.type ? 1 : 0, i.type);
+
+    switch (i.op) {
+    case Op::PUSH:       return "push";
+    case Op::PUSHV:      return "pushv";
+    case Op::PTRTO:      return "ptrto";
+    case Op::POP:        return "pop";
+    case Op::POPX:       return "popx";
+    case Op::COPY:       return "copy";
+    case Op::MOVE:       return "move";
+    case Op::PUSH_INDEX: return "push" + t + "[]";
+    case Op::POP_INDEX:  return "pop" + t + "[]";
+    case Op::ADD:        return "+" + t;
+    case Op::SUB:        return "-" + t;
+    case Op::MUL:        return "*" + t;
+    case Op::DIV:        return "/" + t;
+    case Op::MOD:        return "%" + t;
+    case Op::NEG:        return "neg" + t;
+    case Op::AND:        return "&";
+    case Op::OR:         return "|";
+    case Op::FLIP:       return "flip";
+    case Op::INC:        return "++" + t;
+    case Op::DEC:        return "--" + t;
+    case Op::CONVFI:     return "convfi";
+    case Op::CONVIF:     return "convif";
+    case Op::GOTO:       return "goto";
+    case Op::BEQ:        return "==" + t;
+    case Op::BNE:        return "!=" + t;
+    case Op::BGT:        return ">" + t;
+    case Op::BGE:        return ">=" + t;
+    case Op::BLT:        return "<" + t;
+    case Op::BLE:        return "<=" + t;
+    case Op::BEQZ:       return "==0" + t;
+    case Op::BNEZ:       return "!=0" + t;
+    case Op::CALL:       return "call";
+    case Op::RET:        return "ret";
+    default:             return "";
+    }
+}
+
+bool IR::is_jump(Op op) {
+    switch (op) {
+    case Op::GOTO:
+    case Op::BEQ:
+    case Op::BNE:
+    case Op::BGT:
+    case Op::BGE:
+    case Op::BLT:
+    case Op::BLE:
+    case Op::BEQZ:
+    case Op::BNEZ:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* the branch taken exactly when 'op' is not. ordered float comparisons are false for NaN both ways */
+bool IR::invert_branch(Op op, char type, Op& inverse) {
+    switch (op) {
+    case Op::BEQ:  inverse = Op::BNE; return true;
+    case Op::BNE:  inverse = Op::BEQ; return true;
+    case Op::BEQZ: inverse = Op::BNEZ; return true;
+    case Op::BNEZ: inverse = Op::BEQZ; return true;
+    default: break;
+    }
+
+    if (type == 'f') return false;
+
+    switch (op) {
+    case Op::BGT: inverse = Op::BLE; return true;
+    case Op::BGE: inverse = Op::BLT; return true;
+    case Op::BLT: inverse = Op::BGE; return true;
+    case Op::BLE: inverse = Op::BGT; return true;
+    default:      return false;
+    }
+}
@@ -0,0 +1,147 @@
+#pragma once
+
+/*
+ * ir/buffer.hh
+ * declares the instruction buffer which code generation writes into
+ *
+ * code generation appends typed instruction records here instead of building
+ * strings, and the whole buffer is serialized to the textual IR once at the end.
+ */
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace IR {
+    /* storage segments, matching the slot prefixes in the text format */
+    enum class Segment : uint8_t {
+        NONE,
+        LOCAL,    /* L */
+        GLOBAL,   /* G */
+        CONSTANT, /* C */
+    };
+
+    /* a storage location, e.g. L3 or C12 */
+    struct Slot {
+        Slot();
+        Slot(Segment seg, int index);
+
+        std::string str() const;
+
+        Segment seg;
+        int index;
+    };
+
+    enum class Op : uint8_t {
+        /* directives */
+        COMMENT,   /* ; text */
+        CONSTANTS, /* .CONSTANTS n */
+        WORD,      /* constant value */
+        GLOBALS,   /* .GLOBALS n */
+        FUNCTIONS, /* .FUNCTIONS n */
+        FUNC,      /* .FUNC n name */
+        PARAMS,    /* .params n */
+        RETURN,    /* .return n */
+        LOCALS,    /* .locals n */
+        END_FUNC,  /* .end FUNC */
+
+        /* jump target */
+        LABEL,
+
+        /* stack operations */
+        PUSH,
+        PUSHV,
+        PTRTO,
+        POP,
+        POPX,
+        COPY,
+        MOVE,
+        PUSH_INDEX, /* push?[] */
+        POP_INDEX,  /* pop?[] */
+
+        /* arithmetic */
+        ADD,
+        SUB,
+        MUL,
+        DIV,
+        MOD,
+        NEG,
+        AND,
+        OR,
+        FLIP,
+        INC,
+        DEC,
+        CONVFI,
+        CONVIF,
+
+        /* control flow */
+        GOTO,
+        BEQ,  /* == */
+        BNE,  /* != */
+        BGT,  /* > */
+        BGE,  /* >= */
+        BLT,  /* < */
+        BLE,  /* <= */
+        BEQZ, /* ==0 */
+        BNEZ, /* !=0 */
+        CALL,
+        RET,
+    };
+
+    /*
+     * a single instruction record.
+     * the meaning of 'value' depends on the opcode: it holds the immediate for
+     * pushv/move, the label id for labels and jumps, the function number for
+     * calls and the count for directives.
+     */
+    struct Instruction {
+        Op op;
+        char type; /* operand type suffix ('c', 'i', 'f') or 0 */
+        Slot slot;
+        int32_t value;
+    };
+
+    class Buffer {
+    public:
+        /* instructions without operands */
+        void emit(Op op, char type = 0);
+
+        /* instructions with a storage operand */
+        void emit(Op op, Slot s);
+
+        /* instructions or directives with an integer operand */
+        void emit_value(Op op, int32_t v, char type = 0);
+
+        /* directives carrying text (comments, function names) */
+        void emit_text(Op op, int32_t v, const std::string& text);
+
+        /* jumps and labels */
+        void emit_jump(Op op, int label, char type = 0);
+        void emit_label(int label);
+
+        /* append all records from another buffer */
+        void append(const Buffer& b);
+
+        /* same, but constant slot n of 'b' becomes constant slot const_map[n] */
+        void append(const Buffer& b, const std::vector<int>& const_map);
+
+        /* write the text form of every record to out */
+        void serialize(std::string& out) const;
+        std::string str() const;
+
+        size_t size() const;
+        void clear();
+
+        std::vector<Instruction> code;
+        std::vector<std::string> strings;
+    };
+
+    /* the mnemonic for an instruction, without operands */
+    std::string mnemonic(const Instruction& i);
+
+    /* true if an instruction jumps to the label in its value */
+    bool is_jump(Op op);
+
+    /* the branch taken exactly when 'op' is not, false if there is none */
+    bool invert_branch(Op op, char type, Op& inverse);
+}
@@ -0,0 +1,303 @@
+#include "cfg.hh"
+
+#include <algorithm>
+#include <unordered_map>
+
+IR::CFG::CFG(const Buffer& body) : next_label(0) {
+    std::unordered_map<int, int> label_blocks;
+    std::vector<int> goto_labels;
+
+    /* the block taking code, and the block that falls through into the next one made */
+    int cur = -1, fall = -1;
+
+    auto new_block = [&](int label) {
+        Block b;
+        b.label = label;
+        b.branches = false;
+        b.taken = b.next = -1;
+        b.removed = false;
+
+        if (fall != -1) blocks[fall].next = blocks.size();
+        cur = fall = blocks.size();
+
+        blocks.push_back(b);
+        goto_labels.push_back(-1);
+    };
+
+    for (auto& i : body.code) {
+        if (i.op == Op::LABEL || is_jump(i.op)) next_label = std::max(next_label, i.value + 1);
+
+        switch (i.op) {
+        case Op::FUNC:
+            name = body.strings[i.slot.index];
+            prologue.push_back(i);
+            break;
+        case Op::END_FUNC:
+            epilogue.push_back(i);
+            break;
+        case Op::LABEL:
+            if (cur != -1 && blocks[cur].code.empty()) {
+                /* several labels in a row name the same block */
+                if (blocks[cur].label == -1) blocks[cur].label = i.value;
+            } else {
+                new_block(i.value);
+            }
+
+            label_blocks[i.value] = cur;
+            break;
+        default:
+            if (i.op < Op::LABEL) {
+                prologue.push_back(i);
+                break;
+            }
+
+            if (cur == -1) new_block(-1);
+
+            if (i.op == Op::GOTO) {
+                goto_labels[cur] = i.value;
+                cur = fall = -1;
+            } else if (is_jump(i.op)) {
+                blocks[cur].branches = true;
+                blocks[cur].branch = i;
+                cur = -1;
+            } else {
+                blocks[cur].code.push_back(i);
+                if (i.op == Op::RET) cur = fall = -1;
+            }
+
+            break;
+        }
+    }
+
+    /* labels are only known once the whole body is read */
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        if (goto_labels[b] != -1) blocks[b].next = label_blocks.at(goto_labels[b]);
+        if (blocks[b].branches) blocks[b].taken = label_blocks.at(blocks[b].branch.value);
+    }
+}
+
+int IR::CFG::remove_unreachable() {
+    std::vector<bool> reached(blocks.size(), false);
+    std::vector<int> work;
+    int removed = 0;
+
+    if (blocks.empty()) return 0;
+
+    reached[0] = true;
+    work.push_back(0);
+
+    while (!work.empty()) {
+        Block& b = blocks[work.back()];
+        work.pop_back();
+
+        for (int s : {b.next, b.branches ? b.taken : -1}) {
+            if (s != -1 && !reached[s]) {
+                reached[s] = true;
+                work.push_back(s);
+            }
+        }
+    }
+
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        if (!reached[b] && !blocks[b].removed) {
+            blocks[b].removed = true;
+            ++removed;
+        }
+    }
+
+    return removed;
+}
+
+int IR::CFG::thread_jumps() {
+    int moved = 0;
+
+    /* where an edge into 'target' really leads. edges into a cycle of empty blocks are left alone */
+    auto destination = [&](int target) {
+        std::vector<int> seen = {target};
+        int t = target;
+
+        while (t != -1 && blocks[t].code.empty() && !blocks[t].branches && blocks[t].next != -1) {
+            t = blocks[t].next;
+            if (std::find(seen.begin(), seen.end(), t) != seen.end()) return target;
+            seen.push_back(t);
+        }
+
+        return t;
+    };
+
+    for (auto& b : blocks) {
+        if (b.removed) continue;
+
+        for (int* edge : {&b.next, &b.taken}) {
+            if (*edge == -1) continue;
+
+            int t = destination(*edge);
+
+            if (t != *edge) {
+                *edge = t;
+                ++moved;
+            }
+        }
+    }
+
+    return moved;
+}
+
+int IR::CFG::merge_blocks() {
+    std::vector<int> preds(blocks.size(), 0);
+    int merged = 0;
+
+    if (blocks.empty()) return 0;
+
+    /* the entry block is entered from outside */
+    preds[0] = 1;
+
+    for (auto& b : blocks) {
+        if (b.removed) continue;
+        if (b.next != -1) ++preds[b.next];
+        if (b.branches) ++preds[b.taken];
+    }
+
+    for (auto& a : blocks) {
+        if (a.removed) continue;
+
+        while (!a.branches && a.next != -1 && preds[a.next] == 1 && &blocks[a.next] != &a) {
+            Block& b = blocks[a.next];
+
+            a.code.insert(a.code.end(), b.code.begin(), b.code.end());
+            a.branches = b.branches;
+            a.branch = b.branch;
+            a.taken = b.taken;
+            a.next = b.next;
+
+            b.removed = true;
+            ++merged;
+        }
+    }
+
+    return merged;
+}
+
+int IR::CFG::duplicate_returns(size_t max_size) {
+    int copies = 0;
+
+    for (size_t a = 0; a < blocks.size(); ++a) {
+        if (blocks[a].removed || blocks[a].branches || blocks[a].next == -1) continue;
+
+        /* going on to the block after this one takes no jump */
+        size_t follow = a + 1;
+        while (follow < blocks.size() && blocks[follow].removed) ++follow;
+
+        const Block& b = blocks[blocks[a].next];
+
+        if ((size_t) blocks[a].next == follow || b.branches || b.next != -1 || b.code.empty() ||
+            b.code.back().op != Op::RET || b.code.size() > max_size) continue;
+
+        blocks[a].code.insert(blocks[a].code.end(), b.code.begin(), b.code.end());
+        blocks[a].next = -1;
+        ++copies;
+    }
+
+    return copies;
+}
+
+void IR::CFG::write(Buffer& body) const {
+    std::vector<int> order;
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        if (!blocks[b].removed) order.push_back(b);
+    }
+
+    /* decide the jumps ending each block, and which blocks need a label */
+    struct End {
+        Instruction branch;
+        int taken, next;
+    };
+
+    std::vector<End> ends(blocks.size());
+    std::vector<bool> jumped_to(blocks.size(), false), needs_goto(blocks.size(), false);
+
+    for (size_t k = 0; k < order.size(); ++k) {
+        const Block& b = blocks[order[k]];
+        End& e = ends[order[k]];
+        int follow = (k + 1 < order.size()) ? order[k + 1] : -1;
+        Op inverse;
+
+        e = {b.branch, b.taken, b.next};
+
+        /* branch to the block after this one -> opposite branch to 'next' */
+        if (b.branches && b.taken == follow && b.next != follow && invert_branch(b.branch.op, b.branch.type, inverse)) {
+            e.branch.op = inverse;
+            std::swap(e.taken, e.next);
+        }
+
+        if (b.branches) jumped_to[e.taken] = true;
+
+        if (e.next != -1 && e.next != follow) {
+            needs_goto[order[k]] = true;
+            jumped_to[e.next] = true;
+        }
+    }
+
+    std::vector<int> labels(blocks.size());
+    int new_label = next_label;
+
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        labels[b] = (blocks[b].label != -1) ? blocks[b].label : new_label++;
+    }
+
+    for (auto& i : prologue) {
+        if (i.op == Op::FUNC) body.emit_text(Op::FUNC, i.value, name);
+        else body.code.push_back(i);
+    }
+
+    for (int k : order) {
+        const Block& b = blocks[k];
+        const End& e = ends[k];
+
+        if (jumped_to[k]) body.emit_label(labels[k]);
+        body.code.insert(body.code.end(), b.code.begin(), b.code.end());
+        if (b.branches) body.emit_jump(e.branch.op, labels[e.taken], e.branch.type);
+        if (needs_goto[k]) body.emit_jump(Op::GOTO, labels[e.next]);
+    }
+
+    body.code.insert(body.code.end(), epilogue.begin(), epilogue.end());
+}
+
+/* replace a function body with the graph built from it */
+static void write_back(const IR::CFG& cfg, IR::Buffer& body) {
+    IR::Buffer out;
+    out.code.reserve(body.code.size());
+    cfg.write(out);
+
+    std::swap(body.code, out.code);
+    std::swap(body.strings, out.strings);
+}
+
+void IR::simplify_cfg(Buffer& body, CFGCounts& counts) {
+    CFG cfg(body);
+    int changes;
+
+    /* threading past an empty block leaves it unreachable, and dropping blocks leaves others with a single predecessor */
+    do {
+        int unreachable = cfg.remove_unreachable();
+        int threaded = cfg.thread_jumps();
+        int merged = cfg.merge_blocks();
+
+        counts.unreachable += unreachable;
+        counts.threaded += threaded;
+        counts.merged += merged;
+        changes = unreachable + threaded + merged;
+    } while (changes);
+
+    write_back(cfg, body);
+}
+
+void IR::duplicate_returns(Buffer& body, CFGCounts& counts) {
+    CFG cfg(body);
+
+    /* only a few instructions, so the code hardly grows */
+    counts.duplicated += cfg.duplicate_returns(4);
+    counts.unreachable += cfg.remove_unreachable();
+
+    write_back(cfg, body);
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+/*
+ * ir/cfg.hh
+ * declares the control flow graph of a single function body
+ *
+ * the body is split into basic blocks at labels and after jumps and
+ * returns. a block ends in at most one conditional branch and otherwise
+ * goes on to 'next', which can be any block: the gotos and labels are
+ * worked out again when the graph is written back, so the passes only have
+ * to change edges. blocks stay in their original order.
+ */
+
+#include <string>
+#include <vector>
+
+#include "buffer.hh"
+
+namespace IR {
+    class CFG {
+    public:
+        struct Block {
+            int label;                     /* label jumps to this block use, -1 if it had none */
+            std::vector<Instruction> code; /* straight-line code, ending in ret if the block returns */
+            bool branches;                 /* true if 'branch' ends the block */
+            Instruction branch;
+            int taken;                     /* block the branch jumps to */
+            int next;                      /* block reached otherwise, -1 after ret */
+            bool removed;                  /* dropped or merged into another block */
+        };
+
+        /* build the graph of one function, from .FUNC to .end FUNC */
+        explicit CFG(const Buffer& body);
+
+        /* drop blocks no path from the entry reaches, returns the number dropped */
+        int remove_unreachable();
+
+        /* send edges into empty blocks straight on to where they lead, returns the number of edges moved */
+        int thread_jumps();
+
+        /* append blocks to their only predecessor when it always goes on to them, returns the number merged */
+        int merge_blocks();
+
+        /*
+         * copy blocks of at most 'max_size' instructions ending in ret into the
+         * blocks that go on to them, when they are not laid out right after
+         * them, saving a jump. returns the number of copies
+         */
+        int duplicate_returns(size_t max_size);
+
+        /* write the function back, with gotos only where a block does not go on to the one after it */
+        void write(Buffer& body) const;
+
+        std::vector<Block> blocks; /* the entry block first */
+
+    private:
+        std::vector<Instruction> prologue, epilogue; /* the function directives */
+        std::string name;                            /* text of the .FUNC directive */
+        int next_label;                              /* first label number not used in the body */
+    };
+
+    struct CFGCounts {
+        int unreachable, threaded, merged, duplicated;
+    };
+
+    /* build the graph of a function body, simplify it until nothing changes and write it back */
+    void simplify_cfg(Buffer& body, CFGCounts& counts);
+
+    /* CFG::duplicate_returns on a function body, dropping the blocks it leaves unreachable */
+    void duplicate_returns(Buffer& body, CFGCounts& counts);
+}
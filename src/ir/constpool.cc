@@ -0,0 +1,140 @@
+#include "constpool.hh"
+
+#include <algorithm>
+#include <cstring>
+
+/* words are hashed right to left, so the hash of every suffix of a string falls out of one pass */
+static const uint64_t HASH_MULT = 0x100000001b3ULL;
+
+static size_t finish_hash(uint64_t h, size_t len) {
+    return (size_t) ((h ^ len) * 0x9e3779b97f4a7c15ULL);
+}
+
+size_t IR::WordsHash::operator()(const Words& w) const {
+    uint64_t h = 0;
+    for (size_t i = w.size(); i-- > 0;) {
+        h = h * HASH_MULT + w[i];
+    }
+
+    return finish_hash(h, w.size());
+}
+
+IR::ConstPool::ConstPool() : requested(0) {}
+
+IR::Slot IR::ConstPool::make_scalar(uint32_t v) {
+    ++requested;
+
+    auto it = scalar_index.find(v);
+    if (it != scalar_index.end()) return Slot(Segment::CONSTANT, it->second);
+
+    int id = (int) entries.size();
+    entries.push_back({false, Words(1, v)});
+    scalar_index[v] = id;
+
+    return Slot(Segment::CONSTANT, id);
+}
+
+IR::Slot IR::ConstPool::make_int(int v) {
+    return make_scalar(v);
+}
+
+IR::Slot IR::ConstPool::make_real(float v) {
+    uint32_t bits;
+    memcpy(&bits, &v, sizeof bits);
+    return make_scalar(bits);
+}
+
+IR::Slot IR::ConstPool::make_string(const std::string& v) {
+    /* break the string into chunks of 4 bytes */
+    Words words;
+
+    for (size_t i = 0; i < v.size(); i += 4) {
+        char bytes[4] = {0};
+        for (size_t j = 0; j < 4 && i + j < v.size(); ++j) {
+            bytes[j] = v[i + j];
+        }
+
+        uint32_t val = bytes[0] | (bytes[1] << 8) | (bytes[2] << 16) | (bytes[3] << 24);
+        words.push_back(val);
+    }
+
+    requested += words.size();
+
+    auto it = string_index.find(words);
+    if (it != string_index.end()) return Slot(Segment::CONSTANT, it->second);
+
+    int id = (int) entries.size();
+    string_index[words] = id;
+    entries.push_back({true, std::move(words)});
+
+    return Slot(Segment::CONSTANT, id);
+}
+
+void IR::merge_pools(const std::vector<ConstPool>& pools, Words& words, std::vector<std::vector<int>>& maps) {
+    words.clear();
+    maps.assign(pools.size(), std::vector<int>());
+
+    /* 1. distinct strings, in order of first use */
+    std::unordered_map<Words, int, WordsHash> string_start;
+    std::vector<const Words*> strings;
+
+    for (auto& p : pools) {
+        for (auto& e : p.entries) {
+            if (e.is_string && string_start.emplace(e.words, -1).second) {
+                strings.push_back(&e.words);
+            }
+        }
+    }
+
+    /* 2. place the longest strings first, so shorter ones can land inside them */
+    std::stable_sort(strings.begin(), strings.end(), [](const Words* a, const Words* b) {
+        return a->size() > b->size();
+    });
+
+    /* hash of every suffix of every placed string -> word index of the suffix */
+    std::unordered_multimap<size_t, int> suffixes;
+
+    for (auto s : strings) {
+        int start = -1;
+        auto range = suffixes.equal_range(WordsHash()(*s));
+
+        for (auto i = range.first; i != range.second; ++i) {
+            if (i->second + s->size() <= words.size() && std::equal(s->begin(), s->end(), words.begin() + i->second)) {
+                start = i->second;
+                break;
+            }
+        }
+
+        if (start < 0) {
+            start = (int) words.size();
+            words.insert(words.end(), s->begin(), s->end());
+
+            uint64_t h = 0;
+            for (size_t k = s->size(); k-- > 0;) {
+                h = h * HASH_MULT + (*s)[k];
+                suffixes.emplace(finish_hash(h, s->size() - k), start + (int) k);
+            }
+        }
+
+        string_start[*s] = start;
+    }
+
+    /* 3. scalars reuse any word with the same value, strings included */
+    std::unordered_map<uint32_t, int> scalar_start;
+    for (size_t i = 0; i < words.size(); ++i) {
+        scalar_start.emplace(words[i], (int) i);
+    }
+
+    for (size_t p = 0; p < pools.size(); ++p) {
+        for (auto& e : pools[p].entries) {
+            if (e.is_string) {
+                maps[p].push_back(string_start[e.words]);
+                continue;
+            }
+
+            auto r = scalar_start.emplace(e.words[0], (int) words.size());
+            if (r.second) words.push_back(e.words[0]);
+            maps[p].push_back(r.first->second);
+        }
+    }
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+/*
+ * ir/constpool.hh
+ * declares the constant pool which constant expressions reserve words in
+ *
+ * each function reserves its constants in a pool of its own. the pool is
+ * hash-consed, so every distinct value gets one entry no matter how often it
+ * is used, and slots handed out by the pool refer to entries, not words.
+ * merge_pools() lays the entries of all pools out in the constant segment
+ * and tells each function where its entries ended up.
+ */
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "buffer.hh"
+
+namespace IR {
+    typedef std::vector<uint32_t> Words;
+
+    struct WordsHash {
+        size_t operator()(const Words& w) const;
+    };
+
+    class ConstPool {
+    public:
+        ConstPool();
+
+        Slot make_int(int v);
+        Slot make_real(float v);
+
+        /* strings take one word per 4 bytes, the slot refers to the first word */
+        Slot make_string(const std::string& v);
+
+        struct Entry {
+            bool is_string;
+            Words words; /* exactly one word for scalars */
+        };
+
+        std::vector<Entry> entries;
+
+        /* words the constants would take without any sharing */
+        int requested;
+
+    private:
+        Slot make_scalar(uint32_t v);
+
+        std::unordered_map<uint32_t, int> scalar_index;
+        std::unordered_map<Words, int, WordsHash> string_index;
+    };
+
+    /*
+     * lay out the entries of every pool in the constant segment.
+     *
+     * identical values share a word across all pools, a string whose words are a
+     * suffix of a longer string points into that string, and a scalar which
+     * already appears as a word anywhere in the segment reuses it.
+     * the layout only depends on the pools, not on the order they were built in.
+     *
+     * 'words' receives the segment, and maps[i][e] is the word index of entry e of pools[i].
+     */
+    void merge_pools(const std::vector<ConstPool>& pools, Words& words, std::vector<std::vector<int>>& maps);
+}
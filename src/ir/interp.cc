@@ -0,0 +1,613 @@
+#include "interp.hh"
+#include "buffer.hh"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+
+/* computed goto is a GNU extension, other compilers get a switch */
+#if defined(__GNUC__)
+#define IR_THREADED_DISPATCH 1
+#endif
+
+/* builtin function numbers, as registered by AST::Program::Program */
+static const int BUILTIN_GETCHAR = 0;
+static const int BUILTIN_PUTCHAR = 1;
+
+/* pointers are tagged with a bit above the 32-bit word */
+static const uint64_t POINTER_TAG = 1ULL << 32;
+
+static const size_t MAX_CALL_DEPTH = 1 << 20;
+static const size_t MAX_MEMORY_WORDS = 1 << 29; /* byte addresses must fit in a word */
+
+static const char* op_names[IR::Bytecode::NUM_OPS] = {
+    #define IR_BYTECODE_NAME(op, name) name,
+    IR_BYTECODE_OPS(IR_BYTECODE_NAME)
+    #undef IR_BYTECODE_NAME
+};
+
+const char* IR::Bytecode::op_name(int op) {
+    return op_names[op];
+}
+
+/* Assembler */
+namespace {
+    struct Assembler {
+        IR::Bytecode bc;
+        int line_no = 0;
+
+        /* mnemonic -> opcode and type suffix, built from the table the serializer uses */
+        std::unordered_map<std::string, std::pair<IR::Op, char>> mnemonics;
+
+        /* per function state */
+        int func = -1;
+        std::unordered_map<int, int> labels;
+        std::vector<std::pair<size_t, int>> fixups; /* code index, label */
+
+        Assembler() {
+            bc.globals = 0;
+            bc.main = -1;
+
+            for (int op = (int) IR::Op::PUSH; op <= (int) IR::Op::RET; ++op) {
+                for (char t : {'\0', 'c', 'i', 'f'}) {
+                    IR::Instruction ins = {(IR::Op) op, t, IR::Slot(), 0};
+                    std::string m = IR::mnemonic(ins);
+                    if (!m.empty()) mnemonics.emplace(m, std::make_pair((IR::Op) op, t));
+                }
+            }
+        }
+
+        void fail(const std::string& msg) {
+            throw std::runtime_error("IR line " + std::to_string(line_no) + ": " + msg);
+        }
+
+        long parse_number(const std::string& s, int base) {
+            char* end;
+            long v = strtol(s.c_str(), &end, base);
+            if (s.empty() || *end) fail("invalid number '" + s + "'");
+            return v;
+        }
+
+        void emit(IR::Bytecode::Op op, int32_t arg = 0) {
+            bc.code.push_back({op, arg});
+        }
+
+        /* emit a slot instruction, choosing the local or the absolute form */
+        void emit_slot(IR::Bytecode::Op local_op, IR::Bytecode::Op absolute_op, const std::string& slot) {
+            if (slot.size() < 2) fail("invalid slot '" + slot + "'");
+            long index = parse_number(slot.substr(1), 10);
+            IR::Bytecode::Function& f = bc.functions[func];
+
+            switch (slot[0]) {
+            case 'L':
+                if (index < 0 || index >= std::max(f.locals, f.params)) fail("local slot out of range: " + slot);
+                emit(local_op, index);
+                break;
+            case 'C':
+                if (index < 0 || index >= (long) bc.constants.size()) fail("constant slot out of range: " + slot);
+                emit(absolute_op, index);
+                break;
+            case 'G':
+                if (index < 0 || index >= bc.globals) fail("global slot out of range: " + slot);
+                emit(absolute_op, bc.constants.size() + index);
+                break;
+            default:
+                fail("invalid slot '" + slot + "'");
+            }
+        }
+
+        void begin_function(int num, const std::string& name) {
+            if (func >= 0) fail("missing .end FUNC");
+            if (num < 0) fail("invalid function number");
+
+            if ((int) bc.functions.size() <= num) bc.functions.resize(num + 1, {"", 0, 0, false, -1, 0});
+            if (bc.functions[num].entry >= 0) fail("function " + std::to_string(num) + " defined twice");
+
+            func = num;
+            bc.functions[num].name = name;
+            bc.functions[num].entry = bc.code.size();
+            if (name == "main") bc.main = num;
+
+            labels.clear();
+            fixups.clear();
+        }
+
+        void end_function() {
+            if (func < 0) fail(".end without .FUNC");
+
+            for (auto& i : fixups) {
+                auto it = labels.find(i.second);
+                if (it == labels.end()) fail("undefined label I" + std::to_string(i.second));
+                bc.code[i.first].arg = it->second;
+            }
+
+            /* well formed code always returns before this */
+            emit(IR::Bytecode::FELL_OFF);
+
+            IR::Bytecode::Function& f = bc.functions[func];
+            f.size = bc.code.size() - f.entry;
+            func = -1;
+        }
+
+        void instruction(std::string s) {
+            if (func < 0) fail("instruction outside of a function");
+
+            /* labels are glued to the instruction they mark */
+            while (!s.empty() && s[0] == 'I') {
+                size_t colon = s.find(':');
+                if (colon == std::string::npos) fail("invalid label");
+
+                labels[parse_number(s.substr(1, colon - 1), 10)] = bc.code.size();
+                s = s.substr(colon + 1);
+                s.erase(0, s.find_first_not_of(" \t"));
+            }
+
+            std::istringstream in(s);
+            std::string name, operand;
+            in >> name >> operand;
+
+            auto it = mnemonics.find(name);
+            if (it == mnemonics.end()) fail("unknown instruction '" + name + "'");
+
+            IR::Op op = it->second.first;
+            bool is_float = (it->second.second == 'f');
+            IR::Bytecode::Function& f = bc.functions[func];
+
+            typedef IR::Bytecode B;
+
+            switch (op) {
+            case IR::Op::PUSH:       emit_slot(B::PUSH_L, B::PUSH_M, operand); break;
+            case IR::Op::PTRTO:      emit_slot(B::PTRTO_L, B::PTRTO_M, operand); break;
+            case IR::Op::POP:        emit_slot(B::POP_L, B::POP_M, operand); break;
+            case IR::Op::PUSHV:      emit(B::PUSHV, (int32_t) (uint32_t) strtoul(operand.c_str(), NULL, 16)); break;
+            case IR::Op::POPX:       emit(B::POPX); break;
+            case IR::Op::COPY:       emit(B::COPY); break;
+            case IR::Op::MOVE:       emit(B::MOVE, parse_number(operand, 10)); break;
+            case IR::Op::PUSH_INDEX: emit(it->second.second == 'c' ? B::LOAD_C : B::LOAD_W); break;
+            case IR::Op::POP_INDEX:  emit(it->second.second == 'c' ? B::STORE_C : B::STORE_W); break;
+            case IR::Op::ADD:        emit(is_float ? B::ADD_F : B::ADD_I); break;
+            case IR::Op::SUB:        emit(is_float ? B::SUB_F : B::SUB_I); break;
+            case IR::Op::MUL:        emit(is_float ? B::MUL_F : B::MUL_I); break;
+            case IR::Op::DIV:        emit(is_float ? B::DIV_F : B::DIV_I); break;
+            case IR::Op::MOD:        emit(is_float ? B::MOD_F : B::MOD_I); break;
+            case IR::Op::NEG:        emit(is_float ? B::NEG_F : B::NEG_I); break;
+            case IR::Op::INC:        emit(is_float ? B::INC_F : B::INC_I); break;
+            case IR::Op::DEC:        emit(is_float ? B::DEC_F : B::DEC_I); break;
+            case IR::Op::AND:        emit(B::AND); break;
+            case IR::Op::OR:         emit(B::OR); break;
+            case IR::Op::FLIP:       emit(B::FLIP); break;
+            case IR::Op::CONVFI:     emit(B::CONVFI); break;
+            case IR::Op::CONVIF:     emit(B::CONVIF); break;
+            case IR::Op::RET:        emit(f.returns ? B::RETV : B::RET); break;
+            case IR::Op::CALL:
+                {
+                    long n = parse_number(operand, 10);
+                    if (n == BUILTIN_GETCHAR) emit(B::GETCHAR);
+                    else if (n == BUILTIN_PUTCHAR) emit(B::PUTCHAR);
+                    else emit(B::CALL, n);
+                }
+                break;
+            default:
+                {
+                    /* jumps */
+                    B::Op jump;
+
+                    switch (op) {
+                    case IR::Op::GOTO: jump = B::GOTO; break;
+                    case IR::Op::BEQ:  jump = is_float ? B::BEQ_F : B::BEQ_I; break;
+                    case IR::Op::BNE:  jump = is_float ? B::BNE_F : B::BNE_I; break;
+                    case IR::Op::BGT:  jump = is_float ? B::BGT_F : B::BGT_I; break;
+                    case IR::Op::BGE:  jump = is_float ? B::BGE_F : B::BGE_I; break;
+                    case IR::Op::BLT:  jump = is_float ? B::BLT_F : B::BLT_I; break;
+                    case IR::Op::BLE:  jump = is_float ? B::BLE_F : B::BLE_I; break;
+                    case IR::Op::BEQZ: jump = is_float ? B::BEQZ_F : B::BEQZ_I; break;
+                    case IR::Op::BNEZ: jump = is_float ? B::BNEZ_F : B::BNEZ_I; break;
+                    default:
+                        fail("unexpected instruction '" + name + "'");
+                        return;
+                    }
+
+                    if (operand.size() < 2 || operand[0] != 'I') fail("invalid jump target '" + operand + "'");
+                    fixups.push_back({bc.code.size(), (int) parse_number(operand.substr(1), 10)});
+                    emit(jump);
+                }
+                break;
+            }
+        }
+
+        void line(std::string s) {
+            ++line_no;
+
+            s.erase(0, s.find_first_not_of(" \t"));
+            if (s.empty() || s[0] == ';') return;
+
+            std::istringstream in(s);
+            std::string word;
+            in >> word;
+
+            if (word == ".CONSTANTS") {
+                int count;
+                if (!(in >> count) || count < 0) fail("invalid constant count");
+                bc.constants.reserve(count);
+                constants_left = count;
+            } else if (constants_left > 0) {
+                bc.constants.push_back((uint32_t) strtoul(word.c_str(), NULL, 16));
+                --constants_left;
+            } else if (word == ".GLOBALS") {
+                if (!(in >> bc.globals) || bc.globals < 0) fail("invalid global count");
+            } else if (word == ".FUNCTIONS") {
+                /* the count is implied by the .FUNC directives */
+            } else if (word == ".FUNC") {
+                int num;
+                std::string name;
+                if (!(in >> num >> name)) fail("invalid .FUNC directive");
+                begin_function(num, name);
+            } else if (word == ".params" || word == ".return" || word == ".locals") {
+                int n;
+                if (func < 0 || !(in >> n) || n < 0) fail("invalid " + word + " directive");
+
+                IR::Bytecode::Function& f = bc.functions[func];
+                if (word == ".params") f.params = n;
+                if (word == ".return") f.returns = (n != 0);
+                if (word == ".locals") f.locals = n;
+            } else if (word == ".end") {
+                end_function();
+            } else {
+                instruction(s);
+            }
+        }
+
+        void finish() {
+            if (func >= 0) fail("missing .end FUNC");
+            if (constants_left > 0) fail("missing constants");
+
+            for (auto& i : bc.code) {
+                if (i.op != IR::Bytecode::CALL) continue;
+                if (i.arg >= (int) bc.functions.size() || bc.functions[i.arg].entry < 0) {
+                    throw std::runtime_error("call to undefined function " + std::to_string(i.arg));
+                }
+            }
+        }
+
+        int constants_left = 0;
+    };
+}
+
+IR::Bytecode IR::assemble(const std::string& text) {
+    Assembler a;
+    std::istringstream in(text);
+    std::string line;
+
+    while (std::getline(in, line)) {
+        a.line(line);
+    }
+
+    a.finish();
+    return std::move(a.bc);
+}
+
+/* Interpreter */
+static inline int32_t as_int(uint64_t v) {
+    return (int32_t) (uint32_t) v;
+}
+
+static inline uint64_t from_int(uint32_t v) {
+    return v;
+}
+
+static inline float as_float(uint64_t v) {
+    uint32_t w = (uint32_t) v;
+    float f;
+    memcpy(&f, &w, sizeof f);
+    return f;
+}
+
+static inline uint64_t from_float(float f) {
+    uint32_t w;
+    memcpy(&w, &f, sizeof w);
+    return w;
+}
+
+/* float to int conversion, out of range values give INT_MIN like x86 does */
+static inline int32_t float_to_int(float f) {
+    if (!(f >= -2147483648.0f && f < 2147483648.0f)) return INT32_MIN;
+    return (int32_t) f;
+}
+
+namespace {
+    struct Frame {
+        int return_pc, fp;
+        size_t sp; /* operand stack depth after the arguments were taken */
+    };
+}
+
+void IR::run(const Bytecode& bc, FILE* in, std::ostream& out, RunStats& stats) {
+    typedef Bytecode B;
+
+    if (bc.main < 0) throw std::runtime_error("no main function");
+
+    const B::Insn* code = bc.code.data();
+
+    /* memory is constants, then globals, then call frames */
+    size_t globals_end = bc.constants.size() + bc.globals;
+    std::vector<uint64_t> mem(globals_end + 4096, 0);
+    std::copy(bc.constants.begin(), bc.constants.end(), mem.begin());
+
+    std::vector<uint64_t> stack(4096);
+    std::vector<Frame> calls;
+    std::vector<uint64_t> counts(B::NUM_OPS, 0);
+    std::string output;
+
+    uint64_t* m = mem.data();
+    uint64_t* sp = stack.data();
+    int fp = globals_end, frame_top, pc;
+
+    /* make room for a frame of a function starting at 'frame' */
+    auto enter = [&](const B::Function& f, int frame) {
+        size_t frame_size = std::max(f.locals, f.params);
+        size_t depth = sp - stack.data();
+
+        if (calls.size() >= MAX_CALL_DEPTH) throw std::runtime_error("call stack overflow in " + f.name);
+
+        if (frame + frame_size > mem.size()) {
+            if (frame + frame_size > MAX_MEMORY_WORDS) throw std::runtime_error("out of memory in " + f.name);
+            mem.resize(std::min(std::max(mem.size() * 2, frame + frame_size), MAX_MEMORY_WORDS));
+            m = mem.data();
+        }
+
+        /* every instruction pushes at most one value, so the body can't outgrow this */
+        if (depth + f.size + 1 > stack.size()) {
+            stack.resize(std::max(stack.size() * 2, depth + f.size + 1));
+            sp = stack.data() + depth;
+        }
+
+        /* arguments become the first locals, the rest start out zeroed */
+        sp -= f.params;
+        std::copy(sp, sp + f.params, m + frame);
+        std::fill(m + frame + f.params, m + frame + frame_size, 0);
+
+        frame_top = frame + frame_size;
+        return f.entry;
+    };
+
+    /* byte address of an element of the array 'ptr', checked against memory */
+    auto element = [&](uint64_t ptr, uint64_t index, int size) -> uint64_t {
+        uint64_t addr = (uint32_t) ptr + (uint64_t) (int64_t) as_int(index) * size;
+        if (addr + size > mem.size() * 4) throw std::runtime_error("memory access out of bounds");
+        return addr;
+    };
+
+    auto flush = [&]() {
+        out.write(output.data(), output.size());
+        output.clear();
+    };
+
+    auto start = std::chrono::steady_clock::now();
+    stats.exit_value = 0;
+
+    #define ARG (code[pc].arg)
+    #define BINARY_INT(expr) { uint32_t b = (uint32_t) *--sp, a = (uint32_t) sp[-1]; sp[-1] = from_int(expr); ++pc; DISPATCH(); }
+    #define BINARY_FLOAT(expr) { float b = as_float(*--sp), a = as_float(sp[-1]); sp[-1] = from_float(expr); ++pc; DISPATCH(); }
+    #define BRANCH_INT(cond) { int32_t b = as_int(*--sp), a = as_int(*--sp); pc = (cond) ? ARG : pc + 1; DISPATCH(); }
+    #define BRANCH_FLOAT(cond) { float b = as_float(*--sp), a = as_float(*--sp); pc = (cond) ? ARG : pc + 1; DISPATCH(); }
+
+#ifdef IR_THREADED_DISPATCH
+    /* direct threading: every instruction is translated to the address of its handler up front */
+    static const void* const handlers[B::NUM_OPS] = {
+        #define IR_BYTECODE_HANDLER(op, name) &&op_##op,
+        IR_BYTECODE_OPS(IR_BYTECODE_HANDLER)
+        #undef IR_BYTECODE_HANDLER
+    };
+
+    std::vector<const void*> threaded(bc.code.size());
+    for (size_t i = 0; i < bc.code.size(); ++i) {
+        threaded[i] = handlers[bc.code[i].op];
+    }
+
+    #define DISPATCH() do { ++counts[code[pc].op]; goto *threaded[pc]; } while (0)
+#else
+    #define DISPATCH() goto dispatch
+#endif
+
+    try {
+        pc = enter(bc.functions[bc.main], fp);
+        DISPATCH();
+
+#ifndef IR_THREADED_DISPATCH
+    dispatch:
+        ++counts[code[pc].op];
+
+        switch (code[pc].op) {
+            #define IR_BYTECODE_CASE(op, name) case B::op: goto op_##op;
+            IR_BYTECODE_OPS(IR_BYTECODE_CASE)
+            #undef IR_BYTECODE_CASE
+        default:
+            throw std::runtime_error("invalid opcode");
+        }
+#endif
+
+    op_PUSH_L:  *sp++ = m[fp + ARG]; ++pc; DISPATCH();
+    op_PUSH_M:  *sp++ = m[ARG]; ++pc; DISPATCH();
+    op_PUSHV:   *sp++ = from_int(ARG); ++pc; DISPATCH();
+    op_PTRTO_L:
+        {
+            /* an array parameter already holds a pointer */
+            uint64_t v = m[fp + ARG];
+            *sp++ = (v & POINTER_TAG) ? v : (POINTER_TAG | (uint64_t) (fp + ARG) * 4);
+            ++pc;
+            DISPATCH();
+        }
+    op_PTRTO_M: *sp++ = POINTER_TAG | (uint64_t) ARG * 4; ++pc; DISPATCH();
+    op_POP_L:   m[fp + ARG] = *--sp; ++pc; DISPATCH();
+    op_POP_M:   m[ARG] = *--sp; ++pc; DISPATCH();
+    op_POPX:    --sp; ++pc; DISPATCH();
+    op_COPY:    *sp = sp[-1]; ++sp; ++pc; DISPATCH();
+    op_MOVE:
+        {
+            /* the top value moves under the ARG values below it */
+            uint64_t v = sp[-1];
+            for (int k = 1; k <= ARG; ++k) sp[-k] = sp[-k - 1];
+            sp[-ARG - 1] = v;
+            ++pc;
+            DISPATCH();
+        }
+    op_LOAD_C:
+        {
+            uint64_t ptr = *--sp, addr = element(ptr, sp[-1], 1);
+            sp[-1] = from_int((int8_t) (m[addr / 4] >> (8 * (addr % 4))));
+            ++pc;
+            DISPATCH();
+        }
+    op_LOAD_W:
+        {
+            uint64_t ptr = *--sp, addr = element(ptr, sp[-1], 4);
+            sp[-1] = m[addr / 4];
+            ++pc;
+            DISPATCH();
+        }
+    op_STORE_C:
+        {
+            uint64_t v = *--sp, ptr = *--sp, addr = element(ptr, *--sp, 1);
+            int shift = 8 * (addr % 4);
+            m[addr / 4] = (m[addr / 4] & 0xffffffffu & ~(0xffu << shift)) | ((v & 0xff) << shift);
+            ++pc;
+            DISPATCH();
+        }
+    op_STORE_W:
+        {
+            uint64_t v = *--sp, ptr = *--sp, addr = element(ptr, *--sp, 4);
+            m[addr / 4] = v;
+            ++pc;
+            DISPATCH();
+        }
+
+    op_ADD_I: BINARY_INT(a + b)
+    op_ADD_F: BINARY_FLOAT(a + b)
+    op_SUB_I: BINARY_INT(a - b)
+    op_SUB_F: BINARY_FLOAT(a - b)
+    op_MUL_I: BINARY_INT(a * b)
+    op_MUL_F: BINARY_FLOAT(a * b)
+    op_DIV_I:
+    op_MOD_I:
+        {
+            int32_t b = as_int(*--sp), a = as_int(sp[-1]);
+            bool div = (code[pc].op == B::DIV_I);
+
+            if (b == 0) throw std::runtime_error("integer division by zero");
+
+            /* INT_MIN / -1 wraps around */
+            if (b == -1) sp[-1] = from_int(div ? 0u - (uint32_t) a : 0);
+            else sp[-1] = from_int(div ? a / b : a % b);
+
+            ++pc;
+            DISPATCH();
+        }
+    op_DIV_F: BINARY_FLOAT(a / b)
+    op_MOD_F: BINARY_FLOAT(fmodf(a, b))
+    op_NEG_I: sp[-1] = from_int(0u - (uint32_t) sp[-1]); ++pc; DISPATCH();
+    op_NEG_F: sp[-1] = from_float(-as_float(sp[-1])); ++pc; DISPATCH();
+    op_AND:   BINARY_INT(a & b)
+    op_OR:    BINARY_INT(a | b)
+    op_FLIP:  sp[-1] = from_int(~(uint32_t) sp[-1]); ++pc; DISPATCH();
+    op_INC_I: sp[-1] = from_int((uint32_t) sp[-1] + 1); ++pc; DISPATCH();
+    op_INC_F: sp[-1] = from_float(as_float(sp[-1]) + 1.0f); ++pc; DISPATCH();
+    op_DEC_I: sp[-1] = from_int((uint32_t) sp[-1] - 1); ++pc; DISPATCH();
+    op_DEC_F: sp[-1] = from_float(as_float(sp[-1]) - 1.0f); ++pc; DISPATCH();
+    op_CONVFI: sp[-1] = from_int(float_to_int(as_float(sp[-1]))); ++pc; DISPATCH();
+    op_CONVIF: sp[-1] = from_float((float) as_int(sp[-1])); ++pc; DISPATCH();
+
+    op_GOTO:   pc = ARG; DISPATCH();
+    op_BEQ_I:  BRANCH_INT(a == b)
+    op_BEQ_F:  BRANCH_FLOAT(a == b)
+    op_BNE_I:  BRANCH_INT(a != b)
+    op_BNE_F:  BRANCH_FLOAT(a != b)
+    op_BGT_I:  BRANCH_INT(a > b)
+    op_BGT_F:  BRANCH_FLOAT(a > b)
+    op_BGE_I:  BRANCH_INT(a >= b)
+    op_BGE_F:  BRANCH_FLOAT(a >= b)
+    op_BLT_I:  BRANCH_INT(a < b)
+    op_BLT_F:  BRANCH_FLOAT(a < b)
+    op_BLE_I:  BRANCH_INT(a <= b)
+    op_BLE_F:  BRANCH_FLOAT(a <= b)
+    op_BEQZ_I: pc = (as_int(*--sp) == 0) ? ARG : pc + 1; DISPATCH();
+    op_BEQZ_F: pc = (as_float(*--sp) == 0.0f) ? ARG : pc + 1; DISPATCH();
+    op_BNEZ_I: pc = (as_int(*--sp) != 0) ? ARG : pc + 1; DISPATCH();
+    op_BNEZ_F: pc = (as_float(*--sp) != 0.0f) ? ARG : pc + 1; DISPATCH();
+
+    op_CALL:
+        {
+            int return_pc = pc + 1;
+            const B::Function& f = bc.functions[ARG];
+
+            calls.push_back({return_pc, fp, (size_t) (sp - stack.data()) - f.params});
+            fp = frame_top;
+            pc = enter(f, fp);
+            DISPATCH();
+        }
+    op_GETCHAR:
+        {
+            /* show any pending output before waiting for input */
+            flush();
+            out.flush();
+
+            int c = fgetc(in);
+            *sp++ = from_int((c == EOF) ? -1 : c);
+            ++pc;
+            DISPATCH();
+        }
+    op_PUTCHAR:
+        /* putchar returns its argument, so the value stays on the stack */
+        output.push_back((char) sp[-1]);
+        if (output.size() >= 65536) flush();
+        ++pc;
+        DISPATCH();
+    op_RET:
+    op_RETV:
+        {
+            bool has_value = (code[pc].op == B::RETV);
+            uint64_t v = has_value ? *--sp : 0;
+
+            if (calls.empty()) {
+                stats.exit_value = as_int(v);
+                goto done;
+            }
+
+            Frame r = calls.back();
+            calls.pop_back();
+
+            frame_top = fp;
+            fp = r.fp;
+            pc = r.return_pc;
+            sp = stack.data() + r.sp;
+            if (has_value) *sp++ = v;
+            DISPATCH();
+        }
+    op_FELL_OFF:
+        throw std::runtime_error("execution ran off the end of a function");
+
+    done:
+        flush();
+    } catch (...) {
+        flush();
+        throw;
+    }
+
+    #undef ARG
+    #undef BINARY_INT
+    #undef BINARY_FLOAT
+    #undef BRANCH_INT
+    #undef BRANCH_FLOAT
+    #undef DISPATCH
+
+    stats.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    stats.op_counts = counts;
+    stats.instructions = 0;
+
+    for (auto i : counts) {
+        stats.instructions += i;
+    }
+}
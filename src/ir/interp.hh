@@ -0,0 +1,130 @@
+#pragma once
+
+/*
+ * ir/interp.hh
+ * declares the reference interpreter for the textual stack IR
+ *
+ * assemble() turns the text written by AST::Program::generate_ir() into
+ * dense bytecode: operands are resolved to absolute word and code indices,
+ * and every opcode is specialized on its slot segment and operand type, so
+ * the dispatch loop in run() never looks at the text again.
+ *
+ * values are 32-bit words. a pointer is the byte address of a word in one
+ * flat memory (constants, then globals, then call frames) and carries a tag
+ * bit, so 'ptrto' on an array parameter yields the pointer stored in it.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace IR {
+    /* bytecode opcodes, with the names used in the per-opcode report */
+    #define IR_BYTECODE_OPS(X) \
+        X(PUSH_L, "push L")    \
+        X(PUSH_M, "push G/C")  \
+        X(PUSHV, "pushv")      \
+        X(PTRTO_L, "ptrto L")  \
+        X(PTRTO_M, "ptrto G/C") \
+        X(POP_L, "pop L")      \
+        X(POP_M, "pop G/C")    \
+        X(POPX, "popx")        \
+        X(COPY, "copy")        \
+        X(MOVE, "move")        \
+        X(LOAD_C, "pushc[]")   \
+        X(LOAD_W, "push[]")    \
+        X(STORE_C, "popc[]")   \
+        X(STORE_W, "pop[]")    \
+        X(ADD_I, "+i")         \
+        X(ADD_F, "+f")         \
+        X(SUB_I, "-i")         \
+        X(SUB_F, "-f")         \
+        X(MUL_I, "*i")         \
+        X(MUL_F, "*f")         \
+        X(DIV_I, "/i")         \
+        X(DIV_F, "/f")         \
+        X(MOD_I, "%i")         \
+        X(MOD_F, "%f")         \
+        X(NEG_I, "negi")       \
+        X(NEG_F, "negf")       \
+        X(AND, "&")            \
+        X(OR, "|")             \
+        X(FLIP, "flip")        \
+        X(INC_I, "++i")        \
+        X(INC_F, "++f")        \
+        X(DEC_I, "--i")        \
+        X(DEC_F, "--f")        \
+        X(CONVFI, "convfi")    \
+        X(CONVIF, "convif")    \
+        X(GOTO, "goto")        \
+        X(BEQ_I, "==i")        \
+        X(BEQ_F, "==f")        \
+        X(BNE_I, "!=i")        \
+        X(BNE_F, "!=f")        \
+        X(BGT_I, ">i")         \
+        X(BGT_F, ">f")         \
+        X(BGE_I, ">=i")        \
+        X(BGE_F, ">=f")        \
+        X(BLT_I, "<i")         \
+        X(BLT_F, "<f")         \
+        X(BLE_I, "<=i")        \
+        X(BLE_F, "<=f")        \
+        X(BEQZ_I, "==0i")      \
+        X(BEQZ_F, "==0f")      \
+        X(BNEZ_I, "!=0i")      \
+        X(BNEZ_F, "!=0f")      \
+        X(CALL, "call")        \
+        X(GETCHAR, "call getchar") \
+        X(PUTCHAR, "call putchar") \
+        X(RET, "ret")          \
+        X(RETV, "ret value")   \
+        X(FELL_OFF, "end of function")
+
+    struct Bytecode {
+        enum Op : int32_t {
+            #define IR_BYTECODE_ENUM(op, name) op,
+            IR_BYTECODE_OPS(IR_BYTECODE_ENUM)
+            #undef IR_BYTECODE_ENUM
+            NUM_OPS,
+        };
+
+        static const char* op_name(int op);
+
+        /* char and int operations share the 'i' opcodes, chars are full words on the stack */
+        struct Insn {
+            Op op;
+            int32_t arg; /* word index, immediate, code index or function number */
+        };
+
+        struct Function {
+            std::string name;
+            int params, locals;
+            bool returns;
+            int entry, size; /* first instruction and instruction count, -1 if the function is missing */
+        };
+
+        std::vector<Insn> code;
+        std::vector<Function> functions; /* indexed by function number, the builtins are left empty */
+        std::vector<uint32_t> constants;
+        int globals;
+        int main; /* function number of main, or -1 */
+    };
+
+    /* assemble IR text, throws std::runtime_error if it is malformed */
+    Bytecode assemble(const std::string& text);
+
+    struct RunStats {
+        uint64_t instructions;
+        double wall_ms;
+        std::vector<uint64_t> op_counts; /* indexed by Bytecode::Op */
+        int32_t exit_value;              /* return value of main */
+    };
+
+    /*
+     * call main() and run until it returns. getchar() reads from 'in' and
+     * putchar() writes to 'out'. runtime errors throw std::runtime_error
+     */
+    void run(const Bytecode& bc, FILE* in, std::ostream& out, RunStats& stats);
+}
@@ -0,0 +1,262 @@
+#include "peephole.hh"
+
+#include <unordered_map>
+#include <unordered_set>
+
+static const char* rule_names[IR::Peephole::NUM_RULES] = {
+    "store-load",
+    "drop-copy",
+    "drop-push",
+    "thread-jumps",
+    "branch-over-goto",
+    "jump-to-next",
+    "dead-code",
+    "unused-labels",
+};
+
+/* every rule rewrites 'code' in place and returns the number of rewrites */
+typedef std::vector<IR::Instruction> Code;
+
+static bool is_branch(IR::Op op) {
+    return IR::is_jump(op) && op != IR::Op::GOTO;
+}
+
+/* true if 'label' is one of the labels starting at code[i] */
+static bool labels_include(const Code& code, size_t i, int label) {
+    for (; i < code.size() && code[i].op == IR::Op::LABEL; ++i) {
+        if (code[i].value == label) return true;
+    }
+
+    return false;
+}
+
+static int store_load(Code& code) {
+    int hits = 0;
+
+    for (size_t i = 0; i + 1 < code.size(); ++i) {
+        IR::Instruction& store = code[i], &load = code[i + 1];
+
+        if (store.op == IR::Op::POP && load.op == IR::Op::PUSH && store.slot.seg == load.slot.seg && store.slot.index == load.slot.index) {
+            /* keep a copy of the value instead of reading it back */
+            load = store;
+            store = {IR::Op::COPY, 0, IR::Slot(), 0};
+            ++hits;
+        }
+    }
+
+    return hits;
+}
+
+/* drop 'first; popx' pairs where first is one of 'ops' */
+static int drop_pairs(Code& code, std::initializer_list<IR::Op> ops) {
+    Code out;
+    int hits = 0;
+
+    for (size_t i = 0; i < code.size(); ++i) {
+        bool match = false;
+        for (auto op : ops) match |= (code[i].op == op);
+
+        if (match && i + 1 < code.size() && code[i + 1].op == IR::Op::POPX) {
+            ++i;
+            ++hits;
+            continue;
+        }
+
+        out.push_back(code[i]);
+    }
+
+    code.swap(out);
+    return hits;
+}
+
+static int thread_jumps(Code& code) {
+    std::unordered_map<int, size_t> labels;
+    int hits = 0;
+
+    for (size_t i = 0; i < code.size(); ++i) {
+        if (code[i].op == IR::Op::LABEL) labels[code[i].value] = i;
+    }
+
+    /* the first instruction executed after jumping to 'label' */
+    auto destination = [&](int label) -> const IR::Instruction* {
+        size_t i = labels[label];
+        while (i < code.size() && code[i].op == IR::Op::LABEL) ++i;
+        return (i < code.size()) ? &code[i] : NULL;
+    };
+
+    for (auto& i : code) {
+        if (!IR::is_jump(i.op)) continue;
+
+        /* follow goto chains. jumps into a goto cycle are left alone, they loop forever either way */
+        int target = i.value;
+        std::unordered_set<int> seen = {target};
+
+        while (true) {
+            const IR::Instruction* dest = destination(target);
+            if (!dest || dest->op != IR::Op::GOTO) break;
+
+            if (!seen.insert(dest->value).second) {
+                target = i.value;
+                break;
+            }
+
+            target = dest->value;
+        }
+
+        if (target != i.value) {
+            i.value = target;
+            ++hits;
+        }
+
+        /* a goto to a return might as well return */
+        const IR::Instruction* dest = destination(i.value);
+        if (i.op == IR::Op::GOTO && dest && dest->op == IR::Op::RET) {
+            i = *dest;
+            ++hits;
+        }
+    }
+
+    return hits;
+}
+
+static int branch_over_goto(Code& code) {
+    Code out;
+    int hits = 0;
+    IR::Op inverse;
+
+    for (size_t i = 0; i < code.size(); ++i) {
+        IR::Instruction ins = code[i];
+
+        if (is_branch(ins.op) && i + 1 < code.size() && code[i + 1].op == IR::Op::GOTO &&
+            labels_include(code, i + 2, ins.value) && IR::invert_branch(ins.op, ins.type, inverse)) {
+            ins.op = inverse;
+            ins.value = code[++i].value;
+            ++hits;
+        }
+
+        out.push_back(ins);
+    }
+
+    code.swap(out);
+    return hits;
+}
+
+static int jump_to_next(Code& code) {
+    Code out;
+    int hits = 0;
+
+    for (size_t i = 0; i < code.size(); ++i) {
+        if (code[i].op == IR::Op::GOTO && labels_include(code, i + 1, code[i].value)) {
+            ++hits;
+            continue;
+        }
+
+        out.push_back(code[i]);
+    }
+
+    code.swap(out);
+    return hits;
+}
+
+static int dead_code(Code& code) {
+    Code out;
+    int hits = 0;
+    bool reachable = true;
+
+    for (auto& i : code) {
+        /* labels can be jumped to, and the directives are not code */
+        if (i.op == IR::Op::LABEL || i.op == IR::Op::END_FUNC) reachable = true;
+
+        if (!reachable) {
+            ++hits;
+            continue;
+        }
+
+        out.push_back(i);
+        if (i.op == IR::Op::GOTO || i.op == IR::Op::RET) reachable = false;
+    }
+
+    code.swap(out);
+    return hits;
+}
+
+static int unused_labels(Code& code) {
+    std::unordered_set<int> used;
+    Code out;
+    int hits = 0;
+
+    for (auto& i : code) {
+        if (IR::is_jump(i.op)) used.insert(i.value);
+    }
+
+    for (auto& i : code) {
+        if (i.op == IR::Op::LABEL && !used.count(i.value)) {
+            ++hits;
+            continue;
+        }
+
+        out.push_back(i);
+    }
+
+    code.swap(out);
+    return hits;
+}
+
+IR::Peephole::Peephole() {
+    for (auto& i : enabled) i = true;
+}
+
+const char* IR::Peephole::rule_name(int rule) {
+    return rule_names[rule];
+}
+
+bool IR::Peephole::select(const std::string& names) {
+    bool chosen[NUM_RULES] = {false};
+    size_t start = 0;
+
+    while (start <= names.size()) {
+        size_t end = names.find(',', start);
+        if (end == std::string::npos) end = names.size();
+
+        std::string name = names.substr(start, end - start);
+        int rule = 0;
+
+        while (rule < NUM_RULES && name != rule_names[rule]) ++rule;
+        if (rule == NUM_RULES) return false;
+
+        chosen[rule] = true;
+        start = end + 1;
+    }
+
+    for (int i = 0; i < NUM_RULES; ++i) {
+        enabled[i] = chosen[i];
+    }
+
+    return true;
+}
+
+void IR::Peephole::run(Buffer& body, std::vector<int>& hits) const {
+    hits.resize(NUM_RULES, 0);
+
+    /* rules enable each other (threading a jump can leave a label unused, ...), so repeat until nothing changes */
+    int changes;
+
+    do {
+        int n[NUM_RULES] = {0};
+
+        if (enabled[DEAD_CODE])        n[DEAD_CODE] = dead_code(body.code);
+        if (enabled[THREAD_JUMPS])     n[THREAD_JUMPS] = thread_jumps(body.code);
+        if (enabled[BRANCH_OVER_GOTO]) n[BRANCH_OVER_GOTO] = branch_over_goto(body.code);
+        if (enabled[JUMP_TO_NEXT])     n[JUMP_TO_NEXT] = jump_to_next(body.code);
+        if (enabled[STORE_LOAD])       n[STORE_LOAD] = store_load(body.code);
+        if (enabled[DROP_COPY])        n[DROP_COPY] = drop_pairs(body.code, {Op::COPY});
+        if (enabled[DROP_PUSH])        n[DROP_PUSH] = drop_pairs(body.code, {Op::PUSH, Op::PUSHV, Op::PTRTO});
+        if (enabled[UNUSED_LABELS])    n[UNUSED_LABELS] = unused_labels(body.code);
+
+        changes = 0;
+        for (int i = 0; i < NUM_RULES; ++i) {
+            hits[i] += n[i];
+            changes += n[i];
+        }
+    } while (changes);
+}
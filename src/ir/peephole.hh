@@ -0,0 +1,46 @@
+#pragma once
+
+/*
+ * ir/peephole.hh
+ * declares the peephole optimizer which rewrites short instruction sequences
+ *
+ * the optimizer works on the buffer of a single function, after code
+ * generation and before the buffers are merged. every rule can be turned
+ * off on its own, and the number of times each rule fired is counted so we
+ * can see which ones are worth keeping.
+ */
+
+#include <string>
+#include <vector>
+
+#include "buffer.hh"
+
+namespace IR {
+    class Peephole {
+    public:
+        enum Rule {
+            STORE_LOAD,       /* pop X; push X      -> copy; pop X */
+            DROP_COPY,        /* copy; popx         -> nothing */
+            DROP_PUSH,        /* push X; popx       -> nothing */
+            THREAD_JUMPS,     /* jump to a goto     -> jump to its target, goto to a ret -> ret */
+            BRANCH_OVER_GOTO, /* b L1; goto L2; L1: -> !b L2; L1: */
+            JUMP_TO_NEXT,     /* goto L; L:         -> L: */
+            DEAD_CODE,        /* code after goto/ret up to the next label */
+            UNUSED_LABELS,    /* labels no jump refers to */
+            NUM_RULES,
+        };
+
+        /* all rules start out enabled */
+        Peephole();
+
+        static const char* rule_name(int rule);
+
+        /* enable exactly the rules in a comma separated list of names, false if a name is unknown */
+        bool select(const std::string& names);
+
+        /* optimize the body of one function until no rule applies, adding to hits[rule] */
+        void run(Buffer& body, std::vector<int>& hits) const;
+
+        bool enabled[NUM_RULES];
+    };
+}
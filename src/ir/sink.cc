@@ -0,0 +1,18 @@
+#include "sink.hh"
+
+IR::Sink::Sink(std::ostream& out) : out(out) {}
+
+IR::Sink::~Sink() {
+    flush();
+}
+
+void IR::Sink::write(const Buffer& b) {
+    b.serialize(text);
+}
+
+void IR::Sink::flush() {
+    out.write(text.data(), text.size());
+
+    /* keep the capacity for the next function */
+    text.clear();
+}
@@ -0,0 +1,35 @@
+#pragma once
+
+/*
+ * ir/sink.hh
+ * declares the buffered sink which streams serialized IR to an output stream
+ *
+ * code generation hands every finished function to the sink, which
+ * serializes it into a reusable text buffer and passes the text on at each
+ * flush, so the whole program never has to be held as text at once.
+ */
+
+#include <ostream>
+#include <string>
+
+#include "buffer.hh"
+
+namespace IR {
+    class Sink {
+    public:
+        explicit Sink(std::ostream& out);
+
+        /* anything still buffered is written out */
+        ~Sink();
+
+        /* serialize the records of b */
+        void write(const Buffer& b);
+
+        /* pass the buffered text on to the stream */
+        void flush();
+
+    private:
+        std::ostream& out;
+        std::string text;
+    };
+}
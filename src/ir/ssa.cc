@@ -0,0 +1,1122 @@
+#include "ssa.hh"
+
+#include <algorithm>
+#include <cstdint>
+#include <unordered_set>
+
+/* values cheap enough to push again wherever they are needed */
+static bool is_constant(const IR::Instruction& i) {
+    return i.op == IR::Op::PUSHV || i.op == IR::Op::PTRTO || (i.op == IR::Op::PUSH && i.slot.seg == IR::Segment::CONSTANT);
+}
+
+/* instructions which have to run even if nothing uses their result */
+static bool has_side_effect(IR::Op op) {
+    switch (op) {
+    case IR::Op::POP:
+    case IR::Op::POP_INDEX:
+    case IR::Op::CALL:
+    case IR::Op::RET:
+    case IR::Op::DIV: /* integer division by zero traps */
+    case IR::Op::MOD:
+        return true;
+    default:
+        return false;
+    }
+}
+
+/* the number of values an instruction takes from the stack and whether it leaves one, -1 if it is not handled */
+static int operands(const IR::Instruction& i, const std::vector<IR::Signature>& signatures, bool returns, bool& result) {
+    result = true;
+
+    switch (i.op) {
+    case IR::Op::PUSH:
+    case IR::Op::PUSHV:
+    case IR::Op::PTRTO:
+        return 0;
+    case IR::Op::NEG:
+    case IR::Op::FLIP:
+    case IR::Op::INC:
+    case IR::Op::DEC:
+    case IR::Op::CONVFI:
+    case IR::Op::CONVIF:
+        return 1;
+    case IR::Op::PUSH_INDEX:
+    case IR::Op::ADD:
+    case IR::Op::SUB:
+    case IR::Op::MUL:
+    case IR::Op::DIV:
+    case IR::Op::MOD:
+    case IR::Op::AND:
+    case IR::Op::OR:
+        return 2;
+    case IR::Op::POP:
+        result = false;
+        return 1;
+    case IR::Op::POP_INDEX:
+        result = false;
+        return 3;
+    case IR::Op::RET:
+        result = false;
+        return returns ? 1 : 0;
+    case IR::Op::CALL:
+        if (i.value < 0 || i.value >= (int) signatures.size()) return -1;
+        result = signatures[i.value].returns;
+        return signatures[i.value].params;
+    default:
+        return -1;
+    }
+}
+
+IR::SSA::SSA(const Buffer& body) : promoted(0), cfg(body), num_locals(0), returns(false) {
+    for (auto& i : body.code) {
+        if (i.op == Op::LOCALS) num_locals = i.value;
+        if (i.op == Op::RETURN) returns = (i.value != 0);
+    }
+
+    /* a local can be promoted if the body pushes and pops it, but never takes its address */
+    std::vector<bool> address_taken(num_locals, false);
+    promotable.assign(num_locals, false);
+
+    for (auto& i : body.code) {
+        if (i.slot.seg != Segment::LOCAL || i.slot.index < 0 || i.slot.index >= num_locals) continue;
+
+        if (i.op == Op::PTRTO) address_taken[i.slot.index] = true;
+        if (i.op == Op::PUSH || i.op == Op::POP) promotable[i.slot.index] = true;
+    }
+
+    for (int k = 0; k < num_locals; ++k) {
+        promotable[k] = promotable[k] && !address_taken[k];
+        if (promotable[k]) ++promoted;
+    }
+
+    entry_values.assign(num_locals, -1);
+}
+
+int IR::SSA::make_value(Kind kind, const Instruction& ins, int block, int pos) {
+    Value v;
+    v.kind = kind;
+    v.ins = ins;
+    v.block = block;
+    v.pos = pos;
+    v.var = -1;
+    v.result = true;
+    v.live = true;
+
+    values.push_back(v);
+    return values.size() - 1;
+}
+
+int IR::SSA::entry_value(int slot) {
+    if (entry_values[slot] == -1) {
+        Instruction load = {Op::PUSH, 0, Slot(Segment::LOCAL, slot), 0};
+        entry_values[slot] = make_value(ENTRY, load, 0, -1);
+    }
+
+    return entry_values[slot];
+}
+
+bool IR::SSA::build(const std::vector<Signature>& signatures) {
+    cfg.remove_unreachable();
+    if (cfg.blocks.empty()) return false;
+
+    /* phi arguments from outside the function need a block of their own when the entry block starts a loop */
+    bool entry_has_preds = false;
+
+    for (auto& b : cfg.blocks) {
+        if (!b.removed && (b.next == 0 || (b.branches && b.taken == 0))) entry_has_preds = true;
+    }
+
+    std::vector<int> index(cfg.blocks.size(), -1);
+
+    auto add_block = [&](int c) {
+        Block b;
+        b.cfg = c;
+        b.depth = -1;
+        b.size = (c == -1) ? 0 : cfg.blocks[c].code.size();
+        b.branches = (c != -1) && cfg.blocks[c].branches;
+        if (b.branches) b.branch = cfg.blocks[c].branch;
+        b.taken = b.next = -1;
+        blocks.push_back(b);
+    };
+
+    if (entry_has_preds) add_block(-1);
+
+    for (size_t c = 0; c < cfg.blocks.size(); ++c) {
+        if (cfg.blocks[c].removed) continue;
+        index[c] = blocks.size();
+        add_block(c);
+    }
+
+    for (auto& b : blocks) {
+        if (b.cfg == -1) {
+            b.next = 1;
+            continue;
+        }
+
+        const CFG::Block& c = cfg.blocks[b.cfg];
+        if (c.branches) b.taken = index[c.taken];
+        if (c.next != -1) b.next = index[c.next];
+    }
+
+    for (size_t b = 0; b < blocks.size(); ++b) {
+        if (blocks[b].branches) blocks[blocks[b].taken].preds.push_back(b);
+        if (blocks[b].next != -1) blocks[blocks[b].next].preds.push_back(b);
+    }
+
+    /*
+     * 1. run every block on a stack of values. variables are the promoted
+     * slots, then the positions of the operand stack on entry. a variable
+     * read before the block stores it gets a placeholder, resolved in 2.
+     */
+    std::vector<std::vector<int>> defs(blocks.size());
+    std::vector<int> pending;
+
+    auto placeholder = [&](int b, int var) -> int {
+        int v = make_value(PHI, Instruction(), b, -1);
+        values[v].var = var;
+        pending.push_back(v);
+        return v;
+    };
+
+    auto read = [&](int b, int slot) -> int {
+        if (defs[b][slot] == -1) defs[b][slot] = placeholder(b, slot);
+        return defs[b][slot];
+    };
+
+    struct Entry {
+        int value, anchor;
+    };
+
+    /* in breadth first order, so the stack depth on entry is known */
+    std::vector<int> work = {0};
+    blocks[0].depth = 0;
+
+    for (size_t w = 0; w < work.size(); ++w) {
+        int b = work[w];
+        Block& block = blocks[b];
+        std::vector<Entry> stack;
+
+        defs[b].assign(num_locals, -1);
+
+        for (int p = 0; p < block.depth; ++p) {
+            stack.push_back({placeholder(b, num_locals + p), p});
+        }
+
+        for (int k = 0; k < block.size; ++k) {
+            const Instruction& i = cfg.blocks[block.cfg].code[k];
+            int pos = block.depth + k;
+
+            bool local = (i.slot.seg == Segment::LOCAL && i.slot.index >= 0 && i.slot.index < num_locals);
+
+            if (i.op == Op::PUSH && local && promotable[i.slot.index]) {
+                stack.push_back({read(b, i.slot.index), pos});
+                continue;
+            }
+
+            if (i.op == Op::POP && local && promotable[i.slot.index]) {
+                if (stack.empty()) return false;
+                defs[b][i.slot.index] = stack.back().value;
+                stack.pop_back();
+                continue;
+            }
+
+            if (i.op == Op::POPX || i.op == Op::COPY || i.op == Op::MOVE) {
+                if (stack.empty() || (i.op == Op::MOVE && (i.value < 0 || i.value >= (int) stack.size()))) return false;
+
+                Entry top = stack.back();
+
+                if (i.op == Op::POPX) {
+                    stack.pop_back();
+                } else if (i.op == Op::COPY) {
+                    stack.push_back({top.value, pos});
+                } else {
+                    stack.pop_back();
+                    stack.insert(stack.end() - i.value, top);
+                }
+
+                continue;
+            }
+
+            bool result;
+            int n = operands(i, signatures, returns, result);
+            if (n < 0 || n > (int) stack.size()) return false;
+
+            int v = make_value(INSTRUCTION, i, b, pos);
+            values[v].result = result;
+
+            for (size_t s = stack.size() - n; s < stack.size(); ++s) {
+                values[v].args.push_back(stack[s].value);
+                values[v].anchors.push_back(stack[s].anchor);
+            }
+
+            stack.resize(stack.size() - n);
+            block.code.push_back(v);
+
+            if (result) stack.push_back({v, pos});
+        }
+
+        if (block.branches) {
+            size_t n = (block.branch.op == Op::BEQZ || block.branch.op == Op::BNEZ) ? 1 : 2;
+            if (n > stack.size()) return false;
+
+            for (size_t s = stack.size() - n; s < stack.size(); ++s) {
+                block.branch_args.push_back(stack[s].value);
+                block.branch_anchors.push_back(stack[s].anchor);
+            }
+
+            stack.resize(stack.size() - n);
+        }
+
+        for (auto& e : stack) {
+            block.exit_stack.push_back(e.value);
+            block.exit_anchors.push_back(e.anchor);
+        }
+
+        /* successors start with whatever is left on the stack */
+        for (int s : {block.branches ? block.taken : -1, block.next}) {
+            if (s == -1) continue;
+
+            if (blocks[s].depth == -1) {
+                blocks[s].depth = stack.size();
+                work.push_back(s);
+            } else if (blocks[s].depth != (int) stack.size()) {
+                return false;
+            }
+        }
+    }
+
+    /* 2. resolve the placeholders, making phis where more than one edge comes in */
+    std::vector<int> replaced;
+
+    auto find = [&](int v) -> int {
+        while (v < (int) replaced.size() && replaced[v] != -1) v = replaced[v];
+        return v;
+    };
+
+    auto replace = [&](int v, int by) {
+        if (replaced.size() < values.size()) replaced.resize(values.size(), -1);
+        replaced[v] = by;
+    };
+
+    auto exit_value = [&](int b, int var) -> int {
+        if (var >= num_locals) return blocks[b].exit_stack[var - num_locals];
+        return read(b, var);
+    };
+
+    for (size_t k = 0; k < pending.size(); ++k) {
+        int ph = pending[k], b = values[ph].block, var = values[ph].var;
+        const std::vector<int>& preds = blocks[b].preds;
+
+        if (preds.empty()) {
+            if (var >= num_locals) return false;
+            replace(ph, entry_value(var));
+        } else if (preds.size() == 1) {
+            replace(ph, exit_value(preds[0], var));
+        } else {
+            std::vector<int> args;
+            for (int p : preds) args.push_back(exit_value(p, var));
+
+            values[ph].args = args;
+            blocks[b].phis.push_back(ph);
+        }
+    }
+
+    /* a phi whose arguments are all one value (or itself) is that value */
+    bool changed = true;
+
+    while (changed) {
+        changed = false;
+
+        for (auto& b : blocks) {
+            for (int p : b.phis) {
+                if (find(p) != p) continue;
+
+                int same = -1;
+                bool trivial = true;
+
+                for (int a : values[p].args) {
+                    a = find(a);
+                    if (a == p || a == same) continue;
+
+                    if (same != -1) {
+                        trivial = false;
+                        break;
+                    }
+
+                    same = a;
+                }
+
+                if (!trivial) continue;
+                if (same == -1) return false;
+
+                replace(p, same);
+                changed = true;
+            }
+        }
+    }
+
+    for (auto& v : values) {
+        for (auto& a : v.args) a = find(a);
+    }
+
+    for (auto& b : blocks) {
+        std::vector<int> phis;
+
+        for (int p : b.phis) {
+            if (find(p) == p) phis.push_back(p);
+        }
+
+        b.phis.swap(phis);
+        for (auto& a : b.branch_args) a = find(a);
+        for (auto& a : b.exit_stack) a = find(a);
+    }
+
+    /* homes hold 32 bit words, a pointer has to be made again where it is used */
+    for (auto& b : blocks) {
+        for (int p : b.phis) {
+            for (int a : values[p].args) {
+                if (values[a].kind == INSTRUCTION && values[a].ins.op == Op::PTRTO) return false;
+            }
+        }
+    }
+
+    return true;
+}
+
+int IR::SSA::remove_dead_code() {
+    std::vector<int> work;
+    int removed = 0;
+
+    for (auto& v : values) v.live = false;
+
+    auto mark = [&](int v) {
+        if (values[v].live) return;
+        values[v].live = true;
+        work.push_back(v);
+    };
+
+    for (auto& b : blocks) {
+        for (int v : b.code) {
+            if (has_side_effect(values[v].ins.op)) mark(v);
+        }
+
+        for (int v : b.branch_args) mark(v);
+    }
+
+    while (!work.empty()) {
+        int v = work.back();
+        work.pop_back();
+
+        for (int a : values[v].args) mark(a);
+    }
+
+    for (auto& b : blocks) {
+        std::vector<int> code, phis;
+
+        for (int v : b.code) {
+            if (values[v].live) code.push_back(v);
+            else ++removed;
+        }
+
+        for (int p : b.phis) {
+            if (values[p].live) phis.push_back(p);
+        }
+
+        b.code.swap(code);
+        b.phis.swap(phis);
+    }
+
+    return removed;
+}
+
+bool IR::SSA::write(Buffer& body) {
+    int nv = values.size(), nb = blocks.size();
+
+    auto constant = [&](int v) {
+        return values[v].kind == INSTRUCTION && is_constant(values[v].ins);
+    };
+
+    auto successors = [&](int b) {
+        std::vector<int> s;
+        if (blocks[b].branches) s.push_back(blocks[b].taken);
+        if (blocks[b].next != -1) s.push_back(blocks[b].next);
+        return s;
+    };
+
+    /*
+     * 1. liveness of the values which might share a home: phis, their
+     * arguments and the values of the promoted locals on entry
+     */
+    std::vector<int> dense(nv, -1), candidates;
+
+    auto candidate = [&](int v) {
+        if (dense[v] != -1 || constant(v)) return;
+        dense[v] = candidates.size();
+        candidates.push_back(v);
+    };
+
+    for (auto& b : blocks) {
+        for (int p : b.phis) {
+            candidate(p);
+            for (int a : values[p].args) candidate(a);
+        }
+    }
+
+    for (int e : entry_values) {
+        if (e != -1 && values[e].live) candidate(e);
+    }
+
+    typedef std::vector<uint64_t> Bits;
+    size_t words = (candidates.size() + 63) / 64;
+
+    auto set = [](Bits& bits, int i) { bits[i / 64] |= (uint64_t) 1 << (i % 64); };
+    auto clear = [](Bits& bits, int i) { bits[i / 64] &= ~((uint64_t) 1 << (i % 64)); };
+    auto test = [](const Bits& bits, int i) { return (bits[i / 64] >> (i % 64)) & 1; };
+
+    std::vector<Bits> gen(nb, Bits(words)), kill(nb, Bits(words)), phi_out(nb, Bits(words));
+    std::vector<Bits> live_in(nb, Bits(words)), live_out(nb, Bits(words));
+
+    for (int b = 0; b < nb; ++b) {
+        auto use = [&](int a) {
+            if (dense[a] != -1 && values[a].block != b) set(gen[b], dense[a]);
+        };
+
+        for (int v : blocks[b].code) {
+            for (int a : values[v].args) use(a);
+            if (dense[v] != -1) set(kill[b], dense[v]);
+        }
+
+        for (int a : blocks[b].branch_args) use(a);
+
+        for (int p : blocks[b].phis) {
+            set(kill[b], dense[p]);
+
+            for (size_t k = 0; k < blocks[b].preds.size(); ++k) {
+                int a = values[p].args[k];
+                if (dense[a] != -1) set(phi_out[blocks[b].preds[k]], dense[a]);
+            }
+        }
+    }
+
+    for (int e : entry_values) {
+        if (e != -1 && dense[e] != -1) set(kill[0], dense[e]);
+    }
+
+    for (bool changed = true; changed;) {
+        changed = false;
+
+        for (int b = nb - 1; b >= 0; --b) {
+            Bits out = phi_out[b], in(words);
+
+            for (int s : successors(b)) {
+                for (size_t k = 0; k < words; ++k) out[k] |= live_in[s][k];
+            }
+
+            for (size_t k = 0; k < words; ++k) in[k] = gen[b][k] | (out[k] & ~kill[b][k]);
+
+            if (in != live_in[b]) {
+                live_in[b] = in;
+                changed = true;
+            }
+
+            live_out[b] = out;
+        }
+    }
+
+    /* two values interfere if one is live where the other is made */
+    std::unordered_set<uint64_t> interference;
+
+    auto interferes = [&](int x, int y) {
+        if (x > y) std::swap(x, y);
+        return interference.count((uint64_t) x << 32 | (uint64_t) y) != 0;
+    };
+
+    auto made_while_live = [&](const Bits& live, int d) {
+        for (size_t k = 0; k < words; ++k) {
+            for (uint64_t bits = live[k]; bits; bits &= bits - 1) {
+                int u = k * 64 + __builtin_ctzll(bits);
+                if (u != d) interference.insert((uint64_t) std::min(u, d) << 32 | (uint64_t) std::max(u, d));
+            }
+        }
+    };
+
+    for (int b = 0; b < nb; ++b) {
+        Bits live = live_out[b];
+
+        for (int a : blocks[b].branch_args) {
+            if (dense[a] != -1) set(live, dense[a]);
+        }
+
+        for (auto v = blocks[b].code.rbegin(); v != blocks[b].code.rend(); ++v) {
+            if (dense[*v] != -1) {
+                made_while_live(live, dense[*v]);
+                clear(live, dense[*v]);
+            }
+
+            for (int a : values[*v].args) {
+                if (dense[a] != -1) set(live, dense[a]);
+            }
+        }
+
+        for (int p : blocks[b].phis) made_while_live(live, dense[p]);
+
+        if (b == 0) {
+            for (int e : entry_values) {
+                if (e != -1 && dense[e] != -1) made_while_live(live, dense[e]);
+            }
+        }
+    }
+
+    /*
+     * 2. a phi for a stack entry stays on the stack, as in the original
+     * code, when every predecessor falls through to its block and its only
+     * use is in that block. the others get the home of their arguments
+     * where their lifetimes allow it
+     */
+    std::vector<bool> on_stack(nv, false);
+    std::vector<int> use_count(nv, 0), use_block(nv, -1);
+
+    auto count_use = [&](int a, int b) {
+        if (use_count[a]++ == 0) use_block[a] = b;
+    };
+
+    for (int b = 0; b < nb; ++b) {
+        for (int v : blocks[b].code) {
+            for (int a : values[v].args) count_use(a, b);
+        }
+
+        for (int a : blocks[b].branch_args) count_use(a, b);
+
+        for (int p : blocks[b].phis) {
+            for (size_t k = 0; k < blocks[b].preds.size(); ++k) {
+                int from = blocks[b].preds[k];
+                count_use(values[p].args[k], blocks[from].branches ? -1 : from);
+            }
+        }
+    }
+
+    for (int b = 0; b < nb; ++b) {
+        bool falls_through = true;
+
+        for (int from : blocks[b].preds) {
+            if (blocks[from].branches) falls_through = false;
+        }
+
+        for (int p : blocks[b].phis) {
+            const Value& phi = values[p];
+            on_stack[p] = falls_through && phi.var >= num_locals && use_count[p] == 1 && use_block[p] == b
+                && std::find(phi.args.begin(), phi.args.end(), p) == phi.args.end();
+        }
+    }
+
+    std::vector<int> leader(nv);
+    std::vector<std::vector<int>> members(nv);
+
+    for (int v = 0; v < nv; ++v) {
+        leader[v] = v;
+        if (dense[v] != -1) members[v].push_back(v);
+    }
+
+    auto find_class = [&](int v) {
+        while (leader[v] != v) v = leader[v] = leader[leader[v]];
+        return v;
+    };
+
+    for (auto& b : blocks) {
+        for (int p : b.phis) {
+            if (on_stack[p]) continue;
+
+            for (int a : values[p].args) {
+                if (dense[a] == -1 || on_stack[a]) continue;
+
+                int x = find_class(p), y = find_class(a);
+                if (x == y) continue;
+
+                bool apart = true;
+                int entries = 0;
+
+                for (int m : members[x]) {
+                    if (values[m].kind == ENTRY) ++entries;
+
+                    for (int n : members[y]) {
+                        if (interferes(dense[m], dense[n])) apart = false;
+                    }
+                }
+
+                for (int n : members[y]) {
+                    if (values[n].kind == ENTRY) ++entries;
+                }
+
+                if (!apart || entries > 1) continue;
+
+                leader[y] = x;
+                members[x].insert(members[x].end(), members[y].begin(), members[y].end());
+                members[y].clear();
+            }
+        }
+    }
+
+    /*
+     * 3. the copies into the homes of phis. they go at the end of the block
+     * before its branch, unless the branch's other successor still needs
+     * what they overwrite: then the edge gets a block of its own
+     */
+    struct Copy {
+        int phi, src, anchor;
+    };
+
+    struct Split {
+        int from;
+        bool taken;
+        int to;
+        std::vector<Copy> copies;
+    };
+
+    auto edge_copies = [&](int b, int s) {
+        std::vector<Copy> copies;
+        const std::vector<int>& preds = blocks[s].preds;
+        size_t k = std::find(preds.begin(), preds.end(), b) - preds.begin();
+
+        for (int p : blocks[s].phis) {
+            int a = values[p].args[k], var = values[p].var;
+            if (find_class(a) == find_class(p)) continue;
+
+            int anchor = (var >= num_locals) ? blocks[b].exit_anchors[var - num_locals] : -1;
+            copies.push_back({p, a, anchor});
+        }
+
+        /* the ones left on the stack go under the others, bottom first */
+        std::stable_sort(copies.begin(), copies.end(), [&](const Copy& x, const Copy& y) {
+            if (on_stack[x.phi] != on_stack[y.phi]) return (bool) on_stack[x.phi];
+            return on_stack[x.phi] && values[x.phi].var < values[y.phi].var;
+        });
+
+        return copies;
+    };
+
+    auto kept_for = [&](const std::vector<Copy>& copies, int other) {
+        for (auto& c : copies) {
+            for (int m : members[find_class(c.phi)]) {
+                if (test(live_in[other], dense[m])) return true;
+            }
+        }
+
+        return false;
+    };
+
+    std::vector<std::vector<Copy>> block_copies(nb);
+    std::vector<Split> splits;
+
+    for (int b = 0; b < nb; ++b) {
+        const Block& block = blocks[b];
+
+        if (!block.branches || block.taken == block.next) {
+            if (block.next != -1) block_copies[b] = edge_copies(b, block.next);
+            continue;
+        }
+
+        std::vector<Copy> taken = edge_copies(b, block.taken), next = edge_copies(b, block.next);
+        if (taken.empty() && next.empty()) continue;
+
+        bool together = !kept_for(taken, block.next) && !kept_for(next, block.taken);
+        std::vector<Copy> both = taken;
+
+        /* a home both edges set, to the same value, is set once */
+        for (auto& n : next) {
+            bool again = false;
+
+            for (auto& t : taken) {
+                if (find_class(t.phi) != find_class(n.phi)) continue;
+                if (t.src == n.src) again = true;
+                else together = false;
+            }
+
+            if (!again) both.push_back(n);
+        }
+
+        if (together) {
+            block_copies[b] = both;
+        } else {
+            if (!taken.empty()) splits.push_back({b, true, block.taken, taken});
+            if (!next.empty()) splits.push_back({b, false, block.next, next});
+        }
+    }
+
+    /*
+     * 4. every operand is a use. a use has an anchor where the original
+     * code pushed it, which is where the value is pushed again if it is
+     * not already on the stack, or it is 'late' and pushed just before it
+     * is needed. the blocks are scheduled first, then the split edges
+     */
+    struct Use {
+        int value, anchor;
+        bool late;
+    };
+
+    int units = nb + splits.size();
+    std::vector<Use> uses;
+    std::vector<int> use_unit;
+    std::vector<std::vector<int>> value_uses(nv);
+    std::vector<int> first_use(nv, -1);
+    std::vector<std::vector<int>> branch_uses(nb), copy_uses(units);
+
+    auto make_use = [&](int v, int anchor, int unit) {
+        uses.push_back({v, anchor, anchor < 0});
+        use_unit.push_back(unit);
+        value_uses[v].push_back(uses.size() - 1);
+        return (int) uses.size() - 1;
+    };
+
+    for (int b = 0; b < nb; ++b) {
+        for (int v : blocks[b].code) {
+            first_use[v] = uses.size();
+            for (size_t k = 0; k < values[v].args.size(); ++k) make_use(values[v].args[k], values[v].anchors[k], b);
+        }
+
+        for (auto& c : block_copies[b]) copy_uses[b].push_back(make_use(c.src, c.anchor, b));
+
+        for (size_t k = 0; k < blocks[b].branch_args.size(); ++k) {
+            branch_uses[b].push_back(make_use(blocks[b].branch_args[k], blocks[b].branch_anchors[k], b));
+        }
+    }
+
+    for (size_t s = 0; s < splits.size(); ++s) {
+        for (auto& c : splits[s].copies) copy_uses[nb + s].push_back(make_use(c.src, -1, nb + s));
+    }
+
+    enum Place {
+        STACK, /* left on the stack for its only use */
+        HOME,  /* popped into its home, pushed from there */
+        REMAT, /* made again for every use */
+        DROP,  /* nothing uses it */
+        NONE,  /* leaves no value */
+    };
+
+    std::vector<char> place(nv, NONE);
+
+    for (int v = 0; v < nv; ++v) {
+        const Value& value = values[v];
+        if (!value.live || !value.result) continue;
+
+        bool local = (value_uses[v].size() == 1 && use_unit[value_uses[v][0]] == value.block);
+
+        if (on_stack[v]) place[v] = STACK;
+        else if (value.kind != INSTRUCTION) place[v] = HOME;
+        else if (constant(v)) place[v] = local ? STACK : REMAT;
+        else if (dense[v] != -1 && members[find_class(v)].size() > 1) place[v] = HOME;
+        else if (value_uses[v].empty()) place[v] = DROP;
+        else place[v] = local ? STACK : HOME;
+    }
+
+    /* where each block's instructions are and which use each stack entry belongs to */
+    std::vector<std::vector<int>> def_at(nb), anchored(nb);
+
+    for (int b = 0; b < nb; ++b) {
+        def_at[b].assign(blocks[b].depth + blocks[b].size, -1);
+        anchored[b].assign(blocks[b].depth + blocks[b].size, -1);
+
+        for (int v : blocks[b].code) def_at[b][values[v].pos] = v;
+    }
+
+    for (size_t u = 0; u < uses.size(); ++u) {
+        if (uses[u].anchor < 0) continue;
+
+        int& a = anchored[use_unit[u]][uses[u].anchor];
+        if (a != -1) return false;
+        a = u;
+    }
+
+    std::vector<int> slot(nv, -1);
+
+    auto home = [&](int v) {
+        return Slot(Segment::LOCAL, slot[find_class(v)]);
+    };
+
+    /*
+     * 5. schedule a block, or the copies of a split edge, onto a model of
+     * the stack holding uses. a use which is not on top of the stack when
+     * it is needed becomes late (and its value gets a home if it was to
+     * stay on the stack), so simulating again until nothing changes gives
+     * a schedule that works. 'out' is NULL while simulating
+     */
+    auto schedule = [&](int unit, std::vector<Instruction>* out, bool& changed) -> bool {
+        std::vector<int> model;
+
+        auto emit = [&](Op op, char type, Slot s, int value) {
+            if (out) out->push_back({op, type, s, value});
+        };
+
+        auto push = [&](int u) {
+            int v = uses[u].value;
+
+            if (place[v] == REMAT) {
+                const Instruction& i = values[v].ins;
+                emit(i.op, i.type, i.slot, i.value);
+            } else {
+                emit(Op::PUSH, 0, home(v), 0);
+            }
+
+            model.push_back(u);
+        };
+
+        auto consume = [&](const std::vector<int>& list, bool push_late) -> bool {
+            if (push_late) {
+                for (int u : list) {
+                    if (uses[u].late) push(u);
+                }
+            }
+
+            size_t n = list.size();
+            bool on_top = (model.size() >= n);
+
+            for (size_t k = 0; on_top && k < n; ++k) {
+                on_top = std::find(list.begin(), list.end(), model[model.size() - n + k]) != list.end();
+            }
+
+            if (!on_top) {
+                if (out) return false;
+
+                /* push all of them late next time */
+                for (int u : list) {
+                    auto it = std::find(model.begin(), model.end(), u);
+                    if (it != model.end()) model.erase(it);
+
+                    if (uses[u].late) continue;
+
+                    int v = uses[u].value;
+                    uses[u].late = true;
+                    if (place[v] == STACK) place[v] = constant(v) ? REMAT : HOME;
+                    on_stack[v] = false;
+                    changed = true;
+                }
+
+                return true;
+            }
+
+            /* the right uses, maybe in the wrong order: move each one from the top to its place */
+            std::vector<int> untaken(model.end() - n, model.end()), taken;
+            size_t same = 0;
+
+            while (same < n && untaken[same] == list[same]) ++same;
+
+            if (same < n) {
+                untaken.erase(untaken.begin(), untaken.begin() + same);
+
+                auto rank = [&](int u) { return std::find(list.begin(), list.end(), u) - list.begin(); };
+
+                while (!untaken.empty()) {
+                    int x = untaken.back();
+                    untaken.pop_back();
+
+                    size_t j = 0;
+                    while (j < taken.size() && rank(taken[j]) < rank(x)) ++j;
+
+                    int under = untaken.size() + taken.size() - j;
+                    if (under > 0) emit(Op::MOVE, 0, Slot(), under);
+
+                    taken.insert(taken.begin() + j, x);
+                }
+            }
+
+            model.resize(model.size() - n);
+            return true;
+        };
+
+        auto copy = [&](const std::vector<Copy>& copies) -> bool {
+            if (copies.empty()) return true;
+            if (!consume(copy_uses[unit], true)) return false;
+
+            for (auto c = copies.rbegin(); c != copies.rend(); ++c) {
+                if (!on_stack[c->phi]) emit(Op::POP, 0, home(c->phi), 0);
+            }
+
+            return true;
+        };
+
+        if (unit >= nb) {
+            if (!copy(splits[unit - nb].copies)) return false;
+            return model.empty();
+        }
+
+        const Block& block = blocks[unit];
+        std::vector<int> entering;
+
+        /* what the predecessors left on the stack */
+        for (int p : block.phis) {
+            if (on_stack[p]) entering.push_back(p);
+        }
+
+        std::sort(entering.begin(), entering.end(), [&](int x, int y) { return values[x].var < values[y].var; });
+        for (int p : entering) model.push_back(value_uses[p][0]);
+
+        for (int pos = 0; pos < block.depth + block.size; ++pos) {
+            int v = def_at[unit][pos], a = anchored[unit][pos];
+            bool pushed = false;
+
+            if (v != -1 && place[v] != REMAT) {
+                const Value& value = values[v];
+                std::vector<int> args(value.args.size());
+
+                for (size_t k = 0; k < args.size(); ++k) args[k] = first_use[v] + k;
+                if (!consume(args, true)) return false;
+
+                emit(value.ins.op, value.ins.type, value.ins.slot, value.ins.value);
+
+                switch (place[v]) {
+                case STACK:
+                    model.push_back(value_uses[v][0]);
+                    pushed = true;
+                    break;
+                case HOME:
+                    /* the original code used it right away */
+                    if (a != -1 && !uses[a].late) {
+                        emit(Op::COPY, 0, Slot(), 0);
+                        model.push_back(a);
+                        pushed = true;
+                    }
+
+                    emit(Op::POP, 0, home(v), 0);
+                    break;
+                case DROP:
+                    emit(Op::POPX, 0, Slot(), 0);
+                    break;
+                default:
+                    break;
+                }
+            }
+
+            if (a != -1 && !pushed && !uses[a].late && place[uses[a].value] != STACK) push(a);
+        }
+
+        /* the branch reads its operands before the copies overwrite anything */
+        for (int u : branch_uses[unit]) {
+            if (uses[u].late) push(u);
+        }
+
+        if (!copy(block_copies[unit])) return false;
+        if (!consume(branch_uses[unit], false)) return false;
+
+        return model.empty();
+    };
+
+    for (int u = 0; u < units; ++u) {
+        bool changed = true;
+
+        for (size_t rounds = 0; changed; ++rounds) {
+            changed = false;
+            if (rounds > uses.size() || !schedule(u, NULL, changed)) return false;
+        }
+    }
+
+    /* 6. homes: a promoted local keeps its slot for its value on entry, the other slots are free again */
+    std::vector<int> free_slots;
+    int locals = num_locals;
+
+    for (int e : entry_values) {
+        if (e != -1 && values[e].live) slot[find_class(e)] = values[e].ins.slot.index;
+    }
+
+    for (int k = 0; k < num_locals; ++k) {
+        if (promotable[k] && (entry_values[k] == -1 || !values[entry_values[k]].live)) free_slots.push_back(k);
+    }
+
+    std::reverse(free_slots.begin(), free_slots.end());
+
+    for (int v = 0; v < nv; ++v) {
+        if (place[v] != HOME || slot[find_class(v)] != -1) continue;
+
+        if (free_slots.empty()) {
+            slot[find_class(v)] = locals++;
+        } else {
+            slot[find_class(v)] = free_slots.back();
+            free_slots.pop_back();
+        }
+    }
+
+    /* 7. write the blocks, each split edge of a fall through right after its block and the others at the end */
+    std::vector<std::vector<Instruction>> code(units);
+
+    for (int u = 0; u < units; ++u) {
+        bool changed = false;
+        if (!schedule(u, &code[u], changed)) return false;
+    }
+
+    std::vector<int> at(units);
+    int count = 0;
+
+    for (int b = 0; b < nb; ++b) {
+        at[b] = count++;
+
+        for (size_t s = 0; s < splits.size(); ++s) {
+            if (splits[s].from == b && !splits[s].taken) at[nb + s] = count++;
+        }
+    }
+
+    for (size_t s = 0; s < splits.size(); ++s) {
+        if (splits[s].taken) at[nb + s] = count++;
+    }
+
+    std::vector<CFG::Block> laid_out(count);
+
+    for (int b = 0; b < nb; ++b) {
+        const Block& block = blocks[b];
+        CFG::Block& o = laid_out[at[b]];
+
+        o.label = (block.cfg == -1) ? -1 : cfg.blocks[block.cfg].label;
+        o.code.swap(code[b]);
+        o.branches = block.branches;
+        o.branch = block.branch;
+        o.taken = block.branches ? at[block.taken] : -1;
+        o.next = (block.next != -1) ? at[block.next] : -1;
+        o.removed = false;
+    }
+
+    for (size_t s = 0; s < splits.size(); ++s) {
+        CFG::Block& from = laid_out[at[splits[s].from]];
+        CFG::Block& o = laid_out[at[nb + s]];
+
+        if (splits[s].taken) from.taken = at[nb + s];
+        else from.next = at[nb + s];
+
+        o.label = -1;
+        o.code.swap(code[nb + s]);
+        o.branches = false;
+        o.taken = -1;
+        o.next = at[splits[s].to];
+        o.removed = false;
+    }
+
+    cfg.blocks.swap(laid_out);
+
+    Buffer written;
+    written.code.reserve(body.code.size());
+    cfg.write(written);
+
+    for (auto& i : written.code) {
+        if (i.op == Op::LOCALS) i.value = locals;
+    }
+
+    std::swap(body.code, written.code);
+    std::swap(body.strings, written.strings);
+    return true;
+}
+
+void IR::promote_locals(Buffer& body, const std::vector<Signature>& signatures, SSACounts& counts) {
+    SSA ssa(body);
+
+    /* a body the translation can't follow is left as it is */
+    if (!ssa.build(signatures)) {
+        ++counts.skipped;
+        return;
+    }
+
+    int removed = ssa.remove_dead_code();
+
+    if (!ssa.write(body)) {
+        ++counts.skipped;
+        return;
+    }
+
+    counts.promoted += ssa.promoted;
+    counts.removed += removed;
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+/*
+ * ir/ssa.hh
+ * declares the SSA form of a single function body
+ *
+ * the stack code of a function is turned into three-address values, one
+ * per instruction, whose operands are other values instead of stack
+ * entries. locals the body only reaches with push and pop are promoted:
+ * a load is replaced by the value last stored, with phi values where
+ * control flow joins, so copies disappear and stores nobody reads can be
+ * dropped. locals whose address is taken (arrays, and scalars passed on
+ * with an address expression) stay in memory.
+ *
+ * writing the function back schedules the values onto the operand stack
+ * again, in the order of the original code. a value used once in the
+ * block that makes it stays on the stack until it is used, every other
+ * value gets a home slot it is popped into and pushed from. phi values
+ * share a home with their arguments when their lifetimes do not overlap,
+ * which leaves a loop variable in a single slot.
+ */
+
+#include <vector>
+
+#include "buffer.hh"
+#include "cfg.hh"
+
+namespace IR {
+    /* what a call to a function number takes from the stack and leaves on it */
+    struct Signature {
+        int params;
+        bool returns;
+    };
+
+    class SSA {
+    public:
+        enum Kind {
+            INSTRUCTION, /* 'ins' applied to 'args' */
+            PHI,         /* one argument for each entry in the preds of 'block' */
+            ENTRY,       /* what the promoted local 'ins.slot' holds when the function is entered */
+        };
+
+        struct Value {
+            Kind kind;
+            Instruction ins;
+            std::vector<int> args;    /* bottom of the stack first */
+            std::vector<int> anchors; /* where in the block each argument was pushed */
+            int block, pos;           /* 'pos' counts the entry stack, then the instructions */
+            int var;                  /* variable a phi merges, see SSA::build */
+            bool result;              /* false for stores, returns and calls to void functions */
+            bool live;
+        };
+
+        struct Block {
+            int cfg;                           /* the block in the CFG, -1 for an added entry block */
+            std::vector<int> preds;            /* once for every edge, in the order of the phi arguments */
+            std::vector<int> phis, code;
+            int depth, size;                   /* operand stack depth on entry, instructions */
+            bool branches;
+            Instruction branch;
+            std::vector<int> branch_args, branch_anchors;
+            int taken, next;
+            std::vector<int> exit_stack, exit_anchors; /* values left on the operand stack */
+        };
+
+        explicit SSA(const Buffer& body);
+
+        /* translate the body, false if it uses the stack in a way the translation does not follow */
+        bool build(const std::vector<Signature>& signatures);
+
+        /* drop the values nothing with a side effect depends on, returns the number dropped */
+        int remove_dead_code();
+
+        /* schedule the values back onto the stack, false if that failed and 'body' was left alone */
+        bool write(Buffer& body);
+
+        std::vector<Value> values;
+        std::vector<Block> blocks; /* the entry block first, it has no predecessors */
+        int promoted;              /* locals turned into values */
+
+    private:
+        CFG cfg;
+        int num_locals;
+        bool returns;
+        std::vector<bool> promotable;
+        std::vector<int> entry_values; /* by slot, -1 until first needed */
+
+        int make_value(Kind kind, const Instruction& ins, int block, int pos);
+        int entry_value(int slot);
+    };
+
+    struct SSACounts {
+        int promoted, removed, skipped;
+    };
+
+    /* build the SSA form of a function body, drop its dead code and write it back */
+    void promote_locals(Buffer& body, const std::vector<Signature>& signatures, SSACounts& counts);
+}
@@ -0,0 +1,629 @@
+#include "x86_64.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <map>
+#include <sstream>
+
+/* builtin function numbers, as registered by AST::Program::Program */
+static const int BUILTIN_GETCHAR = 0;
+static const int BUILTIN_PUTCHAR = 1;
+
+/* operand stack positions live in callee-saved registers, so they survive calls */
+static const int NUM_TEMP_REGS = 5;
+static const char* const temp_regs64[NUM_TEMP_REGS] = {"%rbx", "%r12", "%r13", "%r14", "%r15"};
+static const char* const temp_regs32[NUM_TEMP_REGS] = {"%ebx", "%r12d", "%r13d", "%r14d", "%r15d"};
+
+static const int NUM_ARG_REGS = 6;
+static const char* const arg_regs64[NUM_ARG_REGS] = {"%rdi", "%rsi", "%rdx", "%rcx", "%r8", "%r9"};
+
+static const int UNKNOWN_DEPTH = -1;
+
+namespace {
+    struct FunctionInfo {
+        std::string name;
+        int params;
+        bool returns;
+    };
+
+    class FunctionLowering {
+    public:
+        FunctionLowering(std::ostream& out, const IR::Buffer& program, size_t begin, size_t end,
+                         const std::map<int, FunctionInfo>& functions, const std::vector<bool>& pointer_params)
+            : out(out), program(program), begin(begin), end(end), functions(functions), pointer_params(pointer_params) {}
+
+        void lower();
+
+    private:
+        std::ostream& out;
+        const IR::Buffer& program;
+        size_t begin, end; /* body instructions, after the .locals directive */
+        const std::map<int, FunctionInfo>& functions;
+        const std::vector<bool>& pointer_params;
+
+        int number, params, locals;
+        bool returns;
+        std::string name;
+
+        /* operand stack depth before every instruction of the body */
+        std::vector<int> depth;
+        int max_depth;
+
+        /* frame layout, offsets from %rbp */
+        int local_base, save_base, spill_base, frame_size, used_regs;
+
+        void compute_depths();
+        void layout_frame();
+
+        void ins(const std::string& text) { out << "\t" << text << "\n"; }
+
+        std::string label(int n) { return ".L" + std::to_string(number) + "_" + std::to_string(n); }
+        std::string offset(int off) { return std::to_string(off) + "(%rbp)"; }
+
+        bool in_reg(int d) { return d < NUM_TEMP_REGS; }
+        std::string q(int d) { return in_reg(d) ? temp_regs64[d] : offset(spill_base - 8 * (d - NUM_TEMP_REGS + 1)); }
+        std::string l(int d) { return in_reg(d) ? temp_regs32[d] : q(d); }
+
+        std::string slot(const IR::Slot& s);
+
+        void move64(const std::string& src, const std::string& dst);
+        void load32(const std::string& src, int d);
+        void binary_int(const std::string& op, int d);
+        void binary_float(const std::string& op, int d);
+        void compare_int(int d);
+        void compare_float(int a, int b);
+        void epilogue();
+
+        void instruction(const IR::Instruction& i, int d);
+    };
+}
+
+/* stack effect of an instruction, and whether execution can continue after it */
+static int stack_effect(const IR::Instruction& i, const std::map<int, FunctionInfo>& functions, bool& falls_through) {
+    falls_through = true;
+
+    switch (i.op) {
+    case IR::Op::PUSH:
+    case IR::Op::PUSHV:
+    case IR::Op::PTRTO:
+    case IR::Op::COPY:
+        return 1;
+    case IR::Op::POP:
+    case IR::Op::POPX:
+    case IR::Op::PUSH_INDEX:
+    case IR::Op::ADD:
+    case IR::Op::SUB:
+    case IR::Op::MUL:
+    case IR::Op::DIV:
+    case IR::Op::MOD:
+    case IR::Op::AND:
+    case IR::Op::OR:
+    case IR::Op::BEQZ:
+    case IR::Op::BNEZ:
+        return -1;
+    case IR::Op::POP_INDEX:
+        return -3;
+    case IR::Op::BEQ:
+    case IR::Op::BNE:
+    case IR::Op::BGT:
+    case IR::Op::BGE:
+    case IR::Op::BLT:
+    case IR::Op::BLE:
+        return -2;
+    case IR::Op::GOTO:
+        falls_through = false;
+        return 0;
+    case IR::Op::RET:
+        falls_through = false;
+        return 0;
+    case IR::Op::CALL:
+        {
+            if (i.value == BUILTIN_GETCHAR) return 1;
+            if (i.value == BUILTIN_PUTCHAR) return 0;
+
+            auto it = functions.find(i.value);
+            if (it == functions.end()) throw std::runtime_error("call to undefined function " + std::to_string(i.value));
+            return (it->second.returns ? 1 : 0) - it->second.params;
+        }
+    default:
+        /* labels, move and the unary operations */
+        return 0;
+    }
+}
+
+void FunctionLowering::compute_depths() {
+    std::map<int, size_t> labels;
+
+    for (size_t i = begin; i < end; ++i) {
+        if (program.code[i].op == IR::Op::LABEL) labels[program.code[i].value] = i;
+    }
+
+    /* follow every path from the entry. unreachable code keeps an unknown depth and is not emitted */
+    depth.assign(end - begin, UNKNOWN_DEPTH);
+    max_depth = 0;
+
+    std::vector<std::pair<size_t, int>> work = {{begin, 0}};
+
+    while (!work.empty()) {
+        size_t i = work.back().first;
+        int d = work.back().second;
+        work.pop_back();
+
+        for (; i < end; ++i) {
+            int& known = depth[i - begin];
+
+            if (known != UNKNOWN_DEPTH) {
+                if (known != d) throw std::runtime_error("inconsistent stack depth in function " + name);
+                break;
+            }
+
+            known = d;
+
+            const IR::Instruction& ins = program.code[i];
+            bool falls_through;
+            int after = d + stack_effect(ins, functions, falls_through);
+
+            /* ret pops the return value */
+            int needed = (ins.op == IR::Op::RET && returns) ? 1 : 0;
+            if (after < needed) throw std::runtime_error("operand stack underflow in function " + name);
+
+            max_depth = std::max(max_depth, std::max(d, after));
+
+            if (IR::is_jump(ins.op)) {
+                auto it = labels.find(ins.value);
+                if (it == labels.end()) throw std::runtime_error("undefined label in function " + name);
+                work.push_back({it->second, after});
+            }
+
+            if (!falls_through) break;
+            d = after;
+        }
+    }
+}
+
+void FunctionLowering::layout_frame() {
+    /*
+     * parameters get 8 byte homes, since array parameters hold pointers.
+     * the other locals are 4 byte words in ascending order, like the IR expects
+     * for arrays, followed by the saved registers and the spilled stack positions
+     */
+    int words = locals - params;
+    int word_bytes = (4 * words + 7) & ~7;
+
+    used_regs = std::min(max_depth, NUM_TEMP_REGS);
+    local_base = -(8 * params + word_bytes);
+    save_base = local_base;
+    spill_base = save_base - 8 * used_regs;
+
+    int spills = std::max(0, max_depth - NUM_TEMP_REGS);
+    frame_size = (-(spill_base - 8 * spills) + 15) & ~15;
+}
+
+std::string FunctionLowering::slot(const IR::Slot& s) {
+    switch (s.seg) {
+    case IR::Segment::LOCAL:
+        if (s.index < params) return offset(-8 * (s.index + 1));
+        return offset(local_base + 4 * (s.index - params));
+    case IR::Segment::GLOBAL:
+        return ".Lglobals+" + std::to_string(4 * s.index) + "(%rip)";
+    case IR::Segment::CONSTANT:
+        return ".Lconstants+" + std::to_string(4 * s.index) + "(%rip)";
+    default:
+        throw std::runtime_error("invalid slot in function " + name);
+    }
+}
+
+void FunctionLowering::move64(const std::string& src, const std::string& dst) {
+    if (src == dst) return;
+
+    if (src[0] != '%' && dst[0] != '%') {
+        ins("movq " + src + ", %r11");
+        ins("movq %r11, " + dst);
+    } else {
+        ins("movq " + src + ", " + dst);
+    }
+}
+
+/* load a 32 bit word into stack position d */
+void FunctionLowering::load32(const std::string& src, int d) {
+    if (in_reg(d)) {
+        ins("movl " + src + ", " + l(d));
+    } else {
+        ins("movl " + src + ", %eax");
+        ins("movl %eax, " + l(d));
+    }
+}
+
+/* positions d-2 and d-1 are replaced by 'd-2 op d-1' */
+void FunctionLowering::binary_int(const std::string& op, int d) {
+    if (in_reg(d - 2)) {
+        ins(op + " " + l(d - 1) + ", " + l(d - 2));
+    } else {
+        ins("movl " + l(d - 2) + ", %eax");
+        ins(op + " " + l(d - 1) + ", %eax");
+        ins("movl %eax, " + l(d - 2));
+    }
+}
+
+void FunctionLowering::binary_float(const std::string& op, int d) {
+    ins("movd " + l(d - 2) + ", %xmm0");
+    ins("movd " + l(d - 1) + ", %xmm1");
+    ins(op + " %xmm1, %xmm0");
+    ins("movd %xmm0, " + l(d - 2));
+}
+
+/* set the flags for 'd-2 compared to d-1' */
+void FunctionLowering::compare_int(int d) {
+    if (in_reg(d - 2) || in_reg(d - 1)) {
+        ins("cmpl " + l(d - 1) + ", " + l(d - 2));
+    } else {
+        ins("movl " + l(d - 2) + ", %eax");
+        ins("cmpl " + l(d - 1) + ", %eax");
+    }
+}
+
+/* set the flags for 'a compared to b', unordered if either is NaN */
+void FunctionLowering::compare_float(int a, int b) {
+    ins("movd " + l(a) + ", %xmm0");
+    ins("movd " + l(b) + ", %xmm1");
+    ins("ucomiss %xmm1, %xmm0");
+}
+
+void FunctionLowering::epilogue() {
+    for (int r = 0; r < used_regs; ++r) {
+        ins("movq " + offset(save_base - 8 * (r + 1)) + ", " + temp_regs64[r]);
+    }
+
+    ins("leave");
+    ins("ret");
+}
+
+void FunctionLowering::instruction(const IR::Instruction& i, int d) {
+    bool is_float = (i.type == 'f');
+
+    switch (i.op) {
+    case IR::Op::LABEL:
+        out << label(i.value) << ":\n";
+        break;
+    case IR::Op::PUSH:
+        load32(slot(i.slot), d);
+        break;
+    case IR::Op::PUSHV:
+        ins("movl $" + std::to_string(i.value) + ", " + l(d));
+        break;
+    case IR::Op::PTRTO:
+        if (i.slot.seg == IR::Segment::LOCAL && i.slot.index < (int) pointer_params.size() && pointer_params[i.slot.index]) {
+            /* an array parameter already holds a pointer */
+            move64(slot(i.slot), q(d));
+        } else if (in_reg(d)) {
+            ins("leaq " + slot(i.slot) + ", " + q(d));
+        } else {
+            ins("leaq " + slot(i.slot) + ", %rax");
+            ins("movq %rax, " + q(d));
+        }
+        break;
+    case IR::Op::POP:
+        if (in_reg(d - 1)) {
+            ins("movl " + l(d - 1) + ", " + slot(i.slot));
+        } else {
+            ins("movl " + l(d - 1) + ", %eax");
+            ins("movl %eax, " + slot(i.slot));
+        }
+        break;
+    case IR::Op::POPX:
+        break;
+    case IR::Op::COPY:
+        move64(q(d - 1), q(d));
+        break;
+    case IR::Op::MOVE:
+        {
+            /* the top value moves under the n values below it */
+            int n = i.value;
+            if (n <= 0) break;
+
+            ins("movq " + q(d - 1) + ", %rax");
+            for (int k = d - 2; k >= d - 1 - n; --k) move64(q(k), q(k + 1));
+            ins("movq %rax, " + q(d - 1 - n));
+        }
+        break;
+    case IR::Op::PUSH_INDEX:
+        /* index at d-2, pointer at d-1 */
+        ins("movq " + q(d - 1) + ", %rax");
+        ins("movslq " + l(d - 2) + ", %rcx");
+
+        if (i.type == 'c') ins("movsbl (%rax,%rcx), %edx");
+        else ins("movl (%rax,%rcx,4), %edx");
+
+        ins("movl %edx, " + l(d - 2));
+        break;
+    case IR::Op::POP_INDEX:
+        /* index at d-3, pointer at d-2, value at d-1 */
+        ins("movq " + q(d - 2) + ", %rax");
+        ins("movslq " + l(d - 3) + ", %rcx");
+        ins("movl " + l(d - 1) + ", %edx");
+
+        if (i.type == 'c') ins("movb %dl, (%rax,%rcx)");
+        else ins("movl %edx, (%rax,%rcx,4)");
+        break;
+    case IR::Op::ADD:
+        if (is_float) binary_float("addss", d);
+        else binary_int("addl", d);
+        break;
+    case IR::Op::SUB:
+        if (is_float) binary_float("subss", d);
+        else binary_int("subl", d);
+        break;
+    case IR::Op::MUL:
+        if (is_float) {
+            binary_float("mulss", d);
+        } else {
+            /* imul needs a register destination */
+            ins("movl " + l(d - 2) + ", %eax");
+            ins("imull " + l(d - 1) + ", %eax");
+            ins("movl %eax, " + l(d - 2));
+        }
+        break;
+    case IR::Op::DIV:
+    case IR::Op::MOD:
+        if (is_float && i.op == IR::Op::DIV) {
+            binary_float("divss", d);
+        } else if (is_float) {
+            ins("movd " + l(d - 2) + ", %xmm0");
+            ins("movd " + l(d - 1) + ", %xmm1");
+            ins("call fmodf@PLT");
+            ins("movd %xmm0, " + l(d - 2));
+        } else {
+            /* idiv traps on INT_MIN / -1, which wraps around in the IR */
+            bool div = (i.op == IR::Op::DIV);
+
+            ins("movl " + l(d - 2) + ", %eax");
+            ins("movl " + l(d - 1) + ", %ecx");
+            ins("cmpl $-1, %ecx");
+            ins("jne 1f");
+            ins(div ? "negl %eax" : "xorl %eax, %eax");
+            ins("jmp 2f");
+            out << "1:\n";
+            ins("cltd");
+            ins("idivl %ecx");
+            if (!div) ins("movl %edx, %eax");
+            out << "2:\n";
+            ins("movl %eax, " + l(d - 2));
+        }
+        break;
+    case IR::Op::NEG:
+        if (is_float) ins("xorl $0x80000000, " + l(d - 1));
+        else ins("negl " + l(d - 1));
+        break;
+    case IR::Op::AND:
+        binary_int("andl", d);
+        break;
+    case IR::Op::OR:
+        binary_int("orl", d);
+        break;
+    case IR::Op::FLIP:
+        ins("notl " + l(d - 1));
+        break;
+    case IR::Op::INC:
+    case IR::Op::DEC:
+        if (is_float) {
+            ins("movd " + l(d - 1) + ", %xmm0");
+            ins("movl $0x3f800000, %eax"); /* 1.0f */
+            ins("movd %eax, %xmm1");
+            ins(i.op == IR::Op::INC ? "addss %xmm1, %xmm0" : "subss %xmm1, %xmm0");
+            ins("movd %xmm0, " + l(d - 1));
+        } else {
+            ins((i.op == IR::Op::INC ? "incl " : "decl ") + l(d - 1));
+        }
+        break;
+    case IR::Op::CONVFI:
+        /* out of range values give INT_MIN */
+        ins("movd " + l(d - 1) + ", %xmm0");
+        ins("cvttss2si %xmm0, %eax");
+        ins("movl %eax, " + l(d - 1));
+        break;
+    case IR::Op::CONVIF:
+        ins("cvtsi2ssl " + l(d - 1) + ", %xmm0");
+        ins("movd %xmm0, " + l(d - 1));
+        break;
+    case IR::Op::GOTO:
+        ins("jmp " + label(i.value));
+        break;
+    case IR::Op::BEQ:
+    case IR::Op::BNE:
+    case IR::Op::BGT:
+    case IR::Op::BGE:
+    case IR::Op::BLT:
+    case IR::Op::BLE:
+        if (!is_float) {
+            static const std::map<IR::Op, std::string> jumps = {
+                {IR::Op::BEQ, "je"}, {IR::Op::BNE, "jne"}, {IR::Op::BGT, "jg"},
+                {IR::Op::BGE, "jge"}, {IR::Op::BLT, "jl"}, {IR::Op::BLE, "jle"},
+            };
+
+            compare_int(d);
+            ins(jumps.at(i.op) + " " + label(i.value));
+        } else if (i.op == IR::Op::BEQ) {
+            /* equal and ordered */
+            compare_float(d - 2, d - 1);
+            ins("jp 1f");
+            ins("je " + label(i.value));
+            out << "1:\n";
+        } else if (i.op == IR::Op::BNE) {
+            compare_float(d - 2, d - 1);
+            ins("jp " + label(i.value));
+            ins("jne " + label(i.value));
+        } else {
+            /* 'above' is false for unordered operands, so swap them for < and <= */
+            bool swap = (i.op == IR::Op::BLT || i.op == IR::Op::BLE);
+            bool equal = (i.op == IR::Op::BGE || i.op == IR::Op::BLE);
+
+            compare_float(swap ? d - 1 : d - 2, swap ? d - 2 : d - 1);
+            ins((equal ? "jae " : "ja ") + label(i.value));
+        }
+        break;
+    case IR::Op::BEQZ:
+    case IR::Op::BNEZ:
+        /* -0.0 is zero too */
+        if (is_float) ins("testl $0x7fffffff, " + l(d - 1));
+        else if (in_reg(d - 1)) ins("testl " + l(d - 1) + ", " + l(d - 1));
+        else ins("cmpl $0, " + l(d - 1));
+
+        ins((i.op == IR::Op::BEQZ ? "je " : "jne ") + label(i.value));
+        break;
+    case IR::Op::CALL:
+        if (i.value == BUILTIN_GETCHAR) {
+            ins("call getchar@PLT");
+            ins("movl %eax, " + l(d));
+        } else if (i.value == BUILTIN_PUTCHAR) {
+            /* the argument stays on the stack as the return value */
+            ins("movl " + l(d - 1) + ", %edi");
+            ins("call putchar@PLT");
+        } else {
+            const FunctionInfo& f = functions.at(i.value);
+            int first = d - f.params;
+
+            /* arguments past the sixth go on the machine stack, which stays 16 byte aligned */
+            int stack_args = std::max(0, f.params - NUM_ARG_REGS);
+            int padding = (stack_args % 2) ? 8 : 0;
+
+            if (padding) ins("subq $8, %rsp");
+            for (int k = f.params - 1; k >= NUM_ARG_REGS; --k) ins("pushq " + q(first + k));
+
+            for (int k = 0; k < std::min(f.params, NUM_ARG_REGS); ++k) {
+                ins(std::string("movq ") + q(first + k) + ", " + arg_regs64[k]);
+            }
+
+            ins("call " + f.name);
+            if (stack_args) ins("addq $" + std::to_string(8 * stack_args + padding) + ", %rsp");
+            if (f.returns) ins("movl %eax, " + l(first));
+        }
+        break;
+    case IR::Op::RET:
+        if (returns) ins("movl " + l(d - 1) + ", %eax");
+        epilogue();
+        break;
+    default:
+        break;
+    }
+}
+
+void FunctionLowering::lower() {
+    /* the header directives sit right before the body */
+    for (size_t i = begin - 4; i < begin; ++i) {
+        const IR::Instruction& d = program.code[i];
+
+        switch (d.op) {
+        case IR::Op::FUNC:   number = d.value; name = program.strings[d.slot.index]; break;
+        case IR::Op::PARAMS: params = d.value; break;
+        case IR::Op::RETURN: returns = (d.value != 0); break;
+        case IR::Op::LOCALS: locals = std::max(d.value, params); break;
+        default: break;
+        }
+    }
+
+    compute_depths();
+    layout_frame();
+
+    out << "\n\t.p2align 4\n";
+    if (name == "main") out << "\t.globl main\n";
+    out << "\t.type " << name << ", @function\n";
+    out << name << ":\n";
+
+    ins("pushq %rbp");
+    ins("movq %rsp, %rbp");
+    if (frame_size) ins("subq $" + std::to_string(frame_size) + ", %rsp");
+
+    for (int r = 0; r < used_regs; ++r) {
+        ins(std::string("movq ") + temp_regs64[r] + ", " + offset(save_base - 8 * (r + 1)));
+    }
+
+    /* parameters go to their homes, the ones past the sixth were passed on the stack */
+    for (int k = 0; k < params; ++k) {
+        if (k < NUM_ARG_REGS) {
+            ins(std::string("movq ") + arg_regs64[k] + ", " + offset(-8 * (k + 1)));
+        } else {
+            move64(offset(16 + 8 * (k - NUM_ARG_REGS)), offset(-8 * (k + 1)));
+        }
+    }
+
+    /* locals start out zeroed */
+    int local_qwords = -local_base / 8 - params;
+
+    if (local_qwords > 8) {
+        ins("leaq " + offset(local_base) + ", %rdi");
+        ins("movl $" + std::to_string(local_qwords) + ", %ecx");
+        ins("xorl %eax, %eax");
+        ins("rep stosq");
+    } else {
+        for (int k = 0; k < local_qwords; ++k) ins("movq $0, " + offset(local_base + 8 * k));
+    }
+
+    for (size_t i = begin; i < end; ++i) {
+        int d = depth[i - begin];
+
+        if (program.code[i].op == IR::Op::LABEL) instruction(program.code[i], 0);
+        else if (d != UNKNOWN_DEPTH) instruction(program.code[i], d);
+    }
+
+    out << "\t.size " << name << ", .-" << name << "\n";
+}
+
+std::string IR::lower_x86_64(const Buffer& program, const std::vector<std::vector<bool>>& pointer_params) {
+    std::ostringstream out;
+    std::map<int, FunctionInfo> functions;
+    std::vector<uint32_t> constants;
+    int globals = 0;
+
+    /* collect the directives first, calls can go to functions defined later */
+    for (size_t i = 0; i < program.code.size(); ++i) {
+        const Instruction& d = program.code[i];
+
+        switch (d.op) {
+        case Op::COMMENT:
+            out << "# " << program.strings[d.slot.index] << "\n";
+            break;
+        case Op::WORD:
+            constants.push_back(d.value);
+            break;
+        case Op::GLOBALS:
+            globals = d.value;
+            break;
+        case Op::FUNC:
+            functions[d.value] = {program.strings[d.slot.index], program.code[i + 1].value, program.code[i + 2].value != 0};
+            break;
+        default:
+            break;
+        }
+    }
+
+    out << "\t.text\n";
+
+    for (size_t i = 0; i < program.code.size(); ++i) {
+        if (program.code[i].op != Op::FUNC) continue;
+
+        size_t end = i;
+        while (program.code[end].op != Op::END_FUNC) ++end;
+
+        static const std::vector<bool> no_pointers;
+        int number = program.code[i].value;
+        const std::vector<bool>& pointers = (number < (int) pointer_params.size()) ? pointer_params[number] : no_pointers;
+
+        /* .FUNC, .params, .return and .locals come first */
+        FunctionLowering(out, program, i + 4, end, functions, pointers).lower();
+        i = end;
+    }
+
+    /* globals are zeroed data, the constants are read only */
+    out << "\n\t.data\n\t.p2align 2\n.Lglobals:\n";
+    out << "\t.zero " << std::max(4 * globals, 4) << "\n";
+
+    out << "\n\t.section .rodata\n\t.p2align 2\n.Lconstants:\n";
+    for (auto w : constants) {
+        char word[16];
+        snprintf(word, sizeof word, "0x%08x", w);
+        out << "\t.long " << word << "\n";
+    }
+
+    out << "\n\t.section .note.GNU-stack,\"\",@progbits\n";
+    return out.str();
+}
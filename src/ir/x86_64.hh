@@ -0,0 +1,30 @@
+#pragma once
+
+/*
+ * ir/x86_64.hh
+ * declares the x86-64 backend, which lowers the IR to GNU assembler text
+ *
+ * the backend translates the instruction buffer of each function. the depth
+ * of the operand stack is known at every instruction, so stack positions are
+ * assigned to fixed callee-saved registers and only deep expressions spill to
+ * the frame. the output follows the System V ABI for integer and pointer
+ * arguments, so it links against libc, which provides getchar() and putchar().
+ * floats are passed between generated functions as their bit patterns.
+ */
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "buffer.hh"
+
+namespace IR {
+    /*
+     * lower a whole program buffer (directives, constants and functions, as
+     * built by AST::Program::generate_buffer) to assembly.
+     * pointer_params[f][k] is true if parameter k of function number f is an
+     * array, so its slot holds a pointer instead of a value.
+     * throws std::runtime_error if the stack depth of the IR is inconsistent
+     */
+    std::string lower_x86_64(const Buffer& program, const std::vector<std::vector<bool>>& pointer_params);
+}
@@ -1,13 +1,39 @@
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+#include "cache.hh"
 #include "driver.hh"
+#include "util.hh"
 
 #define MODE_LEXER 1
 #define MODE_PARSE 2
 #define MODE_TYPES 4
 #define MODE_GENIR 8
+#define MODE_RUN   16
+#define MODE_DISASM 32
 
 int usage(char** argv);
+int compile(driver& d, const std::string& file, int mode);
+void report_memory(driver& d);
+void report_run(driver& d);
+void report_stats(driver& d);
+int generate_cached(driver& d, const std::string& file);
+void list_passes();
 
 bool opt_verbose = false;
+int opt_codegen_jobs = 1;
+int opt_jobs = 1;
+std::string opt_target = "ir";
+std::string opt_emit = "text";
+std::ostream* output = &std::cout;
+bool opt_deterministic = false;
+bool opt_time_passes = false;
+std::string opt_stats; /* "", "text" or "json" */
+util::Cache* opt_cache = NULL;
+PassManager opt_passes;
 
 int main(int argc, char** argv) {
     int i, mode = 0;
@@ -17,7 +43,137 @@ int main(int argc, char** argv) {
         if (arg == "-p" || arg == "--parse")   { mode |= MODE_PARSE; continue; }
         if (arg == "-t" || arg == "--type")    { mode |= MODE_TYPES; continue; }
         if (arg == "-i" || arg == "--ir")      { mode |= MODE_GENIR; continue; }
+        if (arg == "-r" || arg == "--run")     { mode |= MODE_RUN; continue; }
+        if (arg == "-d" || arg == "--disassemble") { mode |= MODE_DISASM; continue; }
         if (arg == "-v" || arg == "--verbose") { opt_verbose = true; continue; }
+        if (arg == "-O0")                      { opt_passes.set_level(0); continue; }
+        if (arg == "-O1")                      { opt_passes.set_level(1); continue; }
+        if (arg == "-O2")                      { opt_passes.set_level(2); continue; }
+        if (arg == "--deterministic")          { opt_deterministic = true; continue; }
+        if (arg == "--time-passes")            { opt_time_passes = true; continue; }
+        if (arg == "--stats")                  { opt_stats = "text"; continue; }
+
+        if (arg.compare(0, 8, "--stats=") == 0) {
+            /* counters as text or as one JSON object per file */
+            opt_stats = arg.substr(8);
+
+            if (opt_stats != "text" && opt_stats != "json") {
+                std::cerr << "error: unknown stats format " << opt_stats << "\n";
+                return usage(argv);
+            }
+
+            continue;
+        }
+
+        if (arg.compare(0, 8, "--cache=") == 0) {
+            /* reuse -i output for unchanged sources, implies --deterministic */
+            static util::Cache cache(arg.substr(8));
+            opt_cache = &cache;
+            opt_deterministic = true;
+            continue;
+        }
+
+        if (arg.compare(0, 11, "--peephole=") == 0) {
+            /* pick the rules of the peephole pass */
+            if (!opt_passes.peephole.select(arg.substr(11))) {
+                std::cerr << "error: unknown peephole rule in " << arg << "\n";
+                return usage(argv);
+            }
+
+            continue;
+        }
+
+        if (arg.compare(0, 9, "--passes=") == 0) {
+            /* run exactly these passes, in this order, instead of the -O preset */
+            std::string error;
+
+            if (!opt_passes.select(arg.substr(9), error)) {
+                std::cerr << "error: unknown pass " << error << ", the passes are:\n";
+                list_passes();
+                return usage(argv);
+            }
+
+            continue;
+        }
+
+        if (arg.compare(0, 14, "--print-after=") == 0) {
+            /* write the program to stderr after a pass runs */
+            opt_passes.print_after = PassManager::find(arg.substr(14));
+
+            if (opt_passes.print_after == PassManager::NUM_PASSES) {
+                std::cerr << "error: unknown pass " << arg.substr(14) << ", the passes are:\n";
+                list_passes();
+                return usage(argv);
+            }
+
+            continue;
+        }
+
+        if (arg.compare(0, 9, "--target=") == 0) {
+            /* what -i generates */
+            opt_target = arg.substr(9);
+
+            if (opt_target != "ir" && opt_target != "x86-64") {
+                std::cerr << "error: unknown target " << opt_target << "\n";
+                return usage(argv);
+            }
+
+            continue;
+        }
+
+        if (arg.compare(0, 7, "--emit=") == 0) {
+            /* text or binary stack IR */
+            opt_emit = arg.substr(7);
+
+            if (opt_emit != "text" && opt_emit != "bin") {
+                std::cerr << "error: unknown IR format " << opt_emit << "\n";
+                return usage(argv);
+            }
+
+            continue;
+        }
+
+        if (arg == "-j") {
+            /* threads for per-function code generation */
+            if (i + 1 >= argc || atoi(argv[i + 1]) < 1) {
+                std::cerr << "error: -j expects a positive thread count\n";
+                return usage(argv);
+            }
+
+            opt_codegen_jobs = atoi(argv[++i]);
+            continue;
+        }
+
+        if (arg == "-o") {
+            /* write the output to a file instead of stdout */
+            if (i + 1 >= argc) {
+                std::cerr << "error: -o expects a file name\n";
+                return usage(argv);
+            }
+
+            static std::ofstream file;
+            file.open(argv[++i], std::ios::binary);
+
+            if (!file) {
+                std::cerr << "error: cannot open " << argv[i] << " for writing\n";
+                return EXIT_FAILURE;
+            }
+
+            output = &file;
+            continue;
+        }
+
+        if (arg == "--jobs") {
+            /* number of files compiled at once */
+            if (i + 1 >= argc || atoi(argv[i + 1]) < 1) {
+                std::cerr << "error: --jobs expects a positive file count\n";
+                return usage(argv);
+            }
+
+            opt_jobs = atoi(argv[++i]);
+            continue;
+        }
+
         if (arg == "--")                       { ++i; break; }
 
         if (arg[0] == '-') {
@@ -31,40 +187,224 @@ int main(int argc, char** argv) {
 
     switch (mode) {
     case MODE_LEXER:
-        for (; i < argc; ++i) {
-            if (driver().scan(argv[i])) return 1;
-        }
-        return 0;
     case MODE_PARSE:
-        for (; i < argc; ++i) {
-            driver d;
-            if (d.parse(argv[i])) return 1;
-            d.result->write();
-        }
-        return 0;
     case MODE_TYPES:
-        for (; i < argc; ++i) {
+    case MODE_GENIR:
+    case MODE_RUN:
+    case MODE_DISASM:
+        break;
+    default:
+        std::cerr << "error: invalid execution mode. cannot continue.\n";
+        return usage(argv);
+    }
+
+    if (mode == MODE_RUN && opt_target != "ir") {
+        std::cerr << "error: --run only executes the stack IR\n";
+        return usage(argv);
+    }
+
+    if (opt_emit == "bin" && opt_target != "ir") {
+        std::cerr << "error: --emit=bin only applies to the stack IR\n";
+        return usage(argv);
+    }
+
+    std::vector<std::string> files(argv + i, argv + argc);
+
+    if (opt_jobs <= 1) {
+        for (auto& f : files) {
             driver d;
-            if (d.parse(argv[i])) return 1;
-            if (d.check_types(true)) return 1;
+            d.out = output;
+            if (opt_verbose || !opt_stats.empty()) util::reset_peak_rss();
+            if (compile(d, f, mode)) return 1;
         }
+
         return 0;
+    }
+
+    /*
+     * compile files concurrently. each driver writes into its own buffers,
+     * which are printed in command-line order, stopping at the first failure
+     * just like a serial run
+     */
+    struct Output {
+        std::ostringstream out, err;
+        int status;
+    };
+
+    std::vector<Output> outputs(files.size());
+
+    util::parallel_for(files.size(), opt_jobs, [&](int k) {
+        driver d;
+        d.out = &outputs[k].out;
+        d.err = &outputs[k].err;
+        outputs[k].status = compile(d, files[k], mode);
+    });
+
+    for (auto& o : outputs) {
+        *output << o.out.str();
+        std::cerr << o.err.str();
+        if (o.status) return 1;
+    }
+
+    return 0;
+}
+
+int compile(driver& d, const std::string& file, int mode) {
+    switch (mode) {
+    case MODE_LEXER:
+        if (d.scan(file)) return 1;
+        break;
+    case MODE_PARSE:
+        if (d.parse(file)) return 1;
+        d.result->write(*d.out);
+        break;
+    case MODE_TYPES:
+        if (d.parse(file)) return 1;
+        if (d.check_types(true)) return 1;
+        break;
     case MODE_GENIR:
-        for (; i < argc; ++i) {
-            driver d;
-            if (d.parse(argv[i])) return 1;
-            if (d.check_types(false)) return 1;
-            if (d.generate_ir()) return 1;
-            std::cout << "; generated code for " << argv[i] << "\n" << d.ir_result;
+        d.codegen_jobs = opt_codegen_jobs;
+        d.passes = opt_passes;
+        d.target = opt_target;
+        d.emit = opt_emit;
+        d.deterministic = opt_deterministic;
+
+        if (opt_cache) {
+            if (generate_cached(d, file)) return 1;
+            break;
         }
-        return 0;
-    default:
-        std::cerr << "error: invalid execution mode. cannot continue.\n";
-        return usage(argv);
+
+        if (d.parse(file)) return 1;
+        if (d.check_types(false)) return 1;
+        if (d.optimize()) return 1;
+        if (d.emit != "bin") *d.out << ((d.target == "ir") ? ";" : "#") << " generated code for " << file << "\n";
+        if (d.generate_ir(*d.out)) return 1;
+        break;
+    case MODE_DISASM:
+        if (d.disassemble(file)) return 1;
+        break;
+    case MODE_RUN:
+        if (d.parse(file)) return 1;
+        if (d.check_types(false)) return 1;
+        d.codegen_jobs = opt_codegen_jobs;
+        d.passes = opt_passes;
+        if (d.optimize()) return 1;
+        if (d.run_ir()) return 1;
+        report_run(d);
+        break;
+    }
+
+    if (opt_verbose) report_memory(d);
+    if (opt_time_passes || !opt_stats.empty()) report_stats(d);
+    return 0;
+}
+
+int generate_cached(driver& d, const std::string& file) {
+    std::string key, output;
+    d.file = file;
+
+    bool hit = opt_cache->make_key(file, d.options_key(), key) && opt_cache->lookup(key, output);
+
+    if (opt_verbose) *d.err << "; " << file << ": cache " << (hit ? "hit" : "miss") << "\n";
+
+    if (!hit) {
+        /* keep the output to store it, an unreadable source fails in parse() */
+        std::ostringstream ir;
+
+        if (d.parse(file)) return 1;
+        if (d.check_types(false)) return 1;
+        if (d.optimize()) return 1;
+        if (d.generate_ir(ir)) return 1;
+
+        output = ir.str();
+        if (!key.empty()) opt_cache->store(key, output);
+    }
+
+    if (d.emit != "bin") *d.out << ((d.target == "ir") ? ";" : "#") << " generated code for " << file << "\n";
+    *d.out << output;
+    return 0;
+}
+
+void report_memory(driver& d) {
+    /* memory report goes to stderr so it never mixes with the output */
+    *d.err << "; " << d.file << ": " << d.arena.objects() << " AST objects, ";
+    *d.err << d.arena.bytes_used() << " bytes in arena (" << d.arena.bytes_reserved() << " reserved), ";
+    *d.err << "peak RSS " << util::peak_rss_kb() << " kB\n";
+
+    if (d.result && d.result->expressions_folded) {
+        *d.err << "; " << d.file << ": " << d.result->expressions_folded << " expressions folded\n";
+    }
+
+    if (d.result && d.passes.runs(PassManager::PEEPHOLE)) {
+        *d.err << "; " << d.file << ": peephole";
+
+        for (int i = 0; i < IR::Peephole::NUM_RULES; ++i) {
+            if (!d.passes.peephole.enabled[i]) continue;
+            *d.err << " " << IR::Peephole::rule_name(i) << "=" << d.result->pass_results.peephole_hits[i];
+        }
+
+        *d.err << "\n";
+    }
+
+    if (d.result && d.passes.runs(PassManager::SSA)) {
+        const IR::SSACounts& ssa = d.result->pass_results.ssa;
+        *d.err << "; " << d.file << ": " << ssa.promoted << " locals promoted, " << ssa.removed << " dead values removed";
+        if (ssa.skipped) *d.err << ", " << ssa.skipped << " functions left alone";
+        *d.err << "\n";
+    }
+
+    if (d.result && d.result->constants_requested) {
+        *d.err << "; " << d.file << ": " << d.result->constants_emitted << " constant words (";
+        *d.err << d.result->constants_requested << " before sharing)\n";
+    }
+}
+
+void report_run(driver& d) {
+    const IR::RunStats& s = d.run_stats;
+
+    *d.err << "; " << d.file << ": main returned " << s.exit_value << ", " << s.instructions << " instructions in ";
+    *d.err << s.wall_ms << " ms";
+    if (s.wall_ms > 0) *d.err << " (" << s.instructions / s.wall_ms / 1000.0 << " M/s)";
+    *d.err << "\n";
+
+    /* most executed opcodes first */
+    std::vector<int> ops;
+    for (int i = 0; i < IR::Bytecode::NUM_OPS; ++i) {
+        if (s.op_counts[i]) ops.push_back(i);
+    }
+
+    std::stable_sort(ops.begin(), ops.end(), [&](int a, int b) { return s.op_counts[a] > s.op_counts[b]; });
+
+    for (int op : ops) {
+        char line[128];
+        snprintf(line, sizeof line, ";   %-16s %12llu  %5.1f%%\n", IR::Bytecode::op_name(op),
+                 (unsigned long long) s.op_counts[op], 100.0 * s.op_counts[op] / s.instructions);
+        *d.err << line;
+    }
+}
+
+void report_stats(driver& d) {
+    d.collect_stats();
+
+    /* JSON holds the phase times too, so it is the only thing printed */
+    if (opt_stats == "json") {
+        d.stats.write_json(*d.err, d.file);
+        return;
+    }
+
+    if (opt_time_passes) d.stats.write_times(*d.err, d.file);
+    if (opt_stats == "text") d.stats.write_counters(*d.err, d.file);
+}
+
+void list_passes() {
+    for (auto& p : PassManager::passes) {
+        char line[128];
+        snprintf(line, sizeof line, "\t%-18s %-4s %s\n", p.name, (p.kind == PassManager::AST_PASS) ? "AST" : "IR", p.description);
+        std::cerr << line;
     }
 }
 
 int usage(char** argv) {
-    std::cout << "usage:\n\t" << *argv << " [-v] {-l,-p,-i} <filename> (...)\n";
+    std::cout << "usage:\n\t" << *argv << " [-v] [-O0,-O1,-O2] [--passes=list] [--print-after=pass] [--peephole=rules] [--deterministic] [--cache=dir] [--time-passes] [--stats[=text,json]] [--target=ir,x86-64] [--emit=text,bin] [-o file] [-j threads] [--jobs files] {-l,-p,-t,-i,-r,-d} <filename> (...)\n";
     return EXIT_FAILURE;
 }
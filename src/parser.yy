@@ -14,6 +14,7 @@
 /* forward-declare parse driver */
 %code requires {
     #include <string>
+    #include "intern.hh"
     #include "ast.hh"
     class driver;
 }
@@ -82,8 +83,8 @@
 ;
 
 /* semantic tokens */
-%token <std::string> TYPE       "type"
-%token <std::string> IDENT      "identifier"
+%token <AST::Type> TYPE       "type"
+%token <util::Atom> IDENT      "identifier"
 %token <int>         INTCONST   "integer constant"
 %token <double>      REALCONST  "real constant"
 %token <std::string> STRCONST   "string literal"
@@ -120,14 +121,14 @@
 unit: program { drv.result = $1; }
 
 program:
-    %empty                         { $$ = new AST::Program(@$); }
+    %empty                         { $$ = drv.arena.make<AST::Program>(@$, drv.arena); }
     | program variable_declaration { $$ = $1; $$->push_globals($2); }
     | program function_prototype   { $$ = $1; $$->push_function($2); }
     | program function_definition  { $$ = $1; $$->push_function($2); }
     ;
 
 variable_declaration:
-    TYPE variable_names SEMI { $$ = new AST::Scope(@$, $1, $2); }
+    TYPE variable_names SEMI { $$ = drv.arena.make<AST::Scope>(@$, drv.arena, $1, $2); }
     ;
 
 variable_names:
@@ -136,29 +137,29 @@ variable_names:
     ;
 
 variable_name:
-    IDENT                              { $$ = new AST::VariableName(@1, $1); }
-    | IDENT LBRACKET INTCONST RBRACKET { $$ = new AST::VariableName(@1, $1, $3); }
+    IDENT                              { $$ = drv.arena.make<AST::VariableName>(@1, $1); }
+    | IDENT LBRACKET INTCONST RBRACKET { $$ = drv.arena.make<AST::VariableName>(@1, $1, $3); }
     ;
 
 parameter_name:
-    IDENT                     { $$ = new AST::VariableName(@1, $1); }
-    | IDENT LBRACKET RBRACKET { $$ = new AST::VariableName(@1, $1, 0); }
+    IDENT                     { $$ = drv.arena.make<AST::VariableName>(@1, $1); }
+    | IDENT LBRACKET RBRACKET { $$ = drv.arena.make<AST::VariableName>(@1, $1, 0); }
     ;
 
 formal_param:
-    TYPE parameter_name { $$ = new AST::Variable(@$, $1, $2); }
+    TYPE parameter_name { $$ = drv.arena.make<AST::Variable>(@$, $1, $2); }
     ;
 
 parameter_list:
-    %empty                              { $$ = new AST::Scope(@$); }
-    | formal_param                      { $$ = new AST::Scope(@1, $1); }
+    %empty                              { $$ = drv.arena.make<AST::Scope>(@$); }
+    | formal_param                      { $$ = drv.arena.make<AST::Scope>(@1, $1); }
     | parameter_list COMMA formal_param { $$ = $1; $$->push_variable($3); }
     ;
 
 function_locals:
-    %empty                                 { $$ = new AST::Scope(@$); }
+    %empty                                 { $$ = drv.arena.make<AST::Scope>(@$); }
     | variable_declaration                 { $$ = $1; }
-    | function_locals variable_declaration { $$ = new AST::Scope(@$, $1, $2); }
+    | function_locals variable_declaration { $$ = $1; $$->merge_scope($2); }
     ;
 
 function_body:
@@ -168,11 +169,11 @@ function_body:
     ;
 
 function_prototype:
-    TYPE IDENT LPAR parameter_list RPAR SEMI { $$ = new AST::Function(@2, $1, $2, $4); }
+    TYPE IDENT LPAR parameter_list RPAR SEMI { $$ = drv.arena.make<AST::Function>(@2, $1, $2, $4); }
     ;
 
 function_definition:
-    TYPE IDENT LPAR parameter_list RPAR LBRACE function_locals function_body RBRACE { $$ = new AST::Function(@2, $1, $2, $4, $7, $8); }
+    TYPE IDENT LPAR parameter_list RPAR LBRACE function_locals function_body RBRACE { $$ = drv.arena.make<AST::Function>(@2, drv.arena, $1, $2, $4, $7, $8); }
     ;
 
 control_body:
@@ -191,15 +192,15 @@ statement_list:
     ;
 
 statement:
-    expression SEMI                      { $$ = new AST::ExpressionStatement(@1, $1); }
-    | BREAK SEMI                           { $$ = new AST::BreakStatement(@1); }
-    | CONTINUE SEMI                        { $$ = new AST::ContinueStatement(@1); }
-    | RETURN optional_expression SEMI      { $$ = new AST::ReturnStatement(@1, $2); }
-    | IF LPAR expression RPAR control_body                   { $$ = new AST::IfStatement(@1, $3, $5); }
-    | IF LPAR expression RPAR control_body ELSE control_body { $$ = new AST::IfStatement(@1, $3, $5, $7); }
-    | FOR LPAR optional_expression SEMI optional_expression SEMI optional_expression RPAR control_body { $$ = new AST::ForStatement(@1, $3, $5, $7, $9); }
-    | WHILE LPAR expression RPAR control_body { $$ = new AST::WhileStatement(@1, $3, $5); }
-    | DO control_body WHILE LPAR expression RPAR SEMI { $$ = new AST::DoWhileStatement(@1, $5, $2); }
+    expression SEMI                      { $$ = drv.arena.make<AST::ExpressionStatement>(@1, $1); }
+    | BREAK SEMI                           { $$ = drv.arena.make<AST::BreakStatement>(@1); }
+    | CONTINUE SEMI                        { $$ = drv.arena.make<AST::ContinueStatement>(@1); }
+    | RETURN optional_expression SEMI      { $$ = drv.arena.make<AST::ReturnStatement>(@1, $2); }
+    | IF LPAR expression RPAR control_body                   { $$ = drv.arena.make<AST::IfStatement>(@1, $3, $5); }
+    | IF LPAR expression RPAR control_body ELSE control_body { $$ = drv.arena.make<AST::IfStatement>(@1, $3, $5, $7); }
+    | FOR LPAR optional_expression SEMI optional_expression SEMI optional_expression RPAR control_body { $$ = drv.arena.make<AST::ForStatement>(@1, $3, $5, $7, $9); }
+    | WHILE LPAR expression RPAR control_body { $$ = drv.arena.make<AST::WhileStatement>(@1, $3, $5); }
+    | DO control_body WHILE LPAR expression RPAR SEMI { $$ = drv.arena.make<AST::DoWhileStatement>(@1, $5, $2); }
     ;
 
 optional_expression:
@@ -245,8 +246,8 @@ assignment_op:
     ;
 
 l_value:
-    IDENT                                { $$ = new AST::LValue(@1, $1, NULL); }
-    | IDENT LBRACKET expression RBRACKET { $$ = new AST::LValue(@1, $1, $3); }
+    IDENT                                { $$ = drv.arena.make<AST::LValue>(@1, $1); }
+    | IDENT LBRACKET expression RBRACKET { $$ = drv.arena.make<AST::LValue>(@1, $1, $3); }
     ;
 
 argument_list:
@@ -256,25 +257,25 @@ argument_list:
     ;
 
 expression:
-    INTCONST                                       { $$ = new AST::IntConst(@1, $1); }
-    | REALCONST                                    { $$ = new AST::RealConst(@1, $1); }
-    | STRCONST                                     { $$ = new AST::StrConst(@1, $1); }
-    | CHARCONST                                    { $$ = new AST::CharConst(@1, $1); }
-    | IDENT                                        { $$ = new AST::IdentifierExpression(@1, $1); }
-    | IDENT LBRACKET expression RBRACKET           { $$ = new AST::IndexExpression(@$, $1, $3); }
-    | IDENT LPAR argument_list RPAR                { $$ = new AST::CallExpression(@$, $1, $3); }
-    | l_value assignment_op expression             { $$ = new AST::AssignmentExpression(@$, $1, $2, $3); }
-    | inc_dec_op l_value                           { $$ = new AST::IncDecExpression(@$, $2, $1, true); }
-    | l_value inc_dec_op                           { $$ = new AST::IncDecExpression(@$, $1, $2, false); }
-    | unary_op expression                          { $$ = new AST::UnaryOpExpression(@$, $2, $1); }
-    | expression binary_op expression              { $$ = new AST::BinaryOpExpression(@$, $1, $3, $2); }
-    | expression QUEST expression COLON expression { $$ = new AST::TernaryOpExpression(@$, $1, $3, $5); }
-    | LPAR TYPE RPAR expression                    { $$ = new AST::CastExpression(@$, $2, $4); }
+    INTCONST                                       { $$ = drv.arena.make<AST::IntConst>(@1, $1); }
+    | REALCONST                                    { $$ = drv.arena.make<AST::RealConst>(@1, $1); }
+    | STRCONST                                     { $$ = drv.arena.make<AST::StrConst>(@1, $1); }
+    | CHARCONST                                    { $$ = drv.arena.make<AST::CharConst>(@1, $1); }
+    | IDENT                                        { $$ = drv.arena.make<AST::IdentifierExpression>(@1, $1); }
+    | IDENT LBRACKET expression RBRACKET           { $$ = drv.arena.make<AST::IndexExpression>(@$, $1, $3); }
+    | IDENT LPAR argument_list RPAR                { $$ = drv.arena.make<AST::CallExpression>(@$, $1, $3); }
+    | l_value assignment_op expression             { $$ = drv.arena.make<AST::AssignmentExpression>(@$, $1, $2, $3); }
+    | inc_dec_op l_value                           { $$ = drv.arena.make<AST::IncDecExpression>(@$, $2, $1, true); }
+    | l_value inc_dec_op                           { $$ = drv.arena.make<AST::IncDecExpression>(@$, $1, $2, false); }
+    | unary_op expression                          { $$ = drv.arena.make<AST::UnaryOpExpression>(@$, $2, $1); }
+    | expression binary_op expression              { $$ = drv.arena.make<AST::BinaryOpExpression>(@$, $1, $3, $2); }
+    | expression QUEST expression COLON expression { $$ = drv.arena.make<AST::TernaryOpExpression>(@$, $1, $3, $5); }
+    | LPAR TYPE RPAR expression                    { $$ = drv.arena.make<AST::CastExpression>(@$, $2, $4); }
     | LPAR expression RPAR                         { $$ = $2; }
     ;
 
 %%
 
 void yy::parser::error(const location_type& l, const std::string& m) {
-    std::cerr << "Error in " << *(l.begin.filename) << " line " << l.begin.line << "\n\t" << m << "\n";
+    *drv.err << "Error in " << *(l.begin.filename) << " line " << l.begin.line << "\n\t" << m << "\n";
 }
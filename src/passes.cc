@@ -0,0 +1,161 @@
+#include "passes.hh"
+#include "ast/program.hh"
+
+#include <chrono>
+#include <ctime>
+
+const PassManager::Pass PassManager::passes[PassManager::NUM_PASSES] = {
+    {"fold",              AST_PASS, "fold constant expressions"},
+    {"cfg",               IR_PASS,  "drop unreachable blocks, thread jumps and merge blocks"},
+    {"ssa",               IR_PASS,  "promote locals to SSA values, drop dead code and schedule the stack again"},
+    {"peephole",          IR_PASS,  "rewrite short instruction sequences, see --peephole"},
+    {"duplicate-returns", IR_PASS,  "copy short blocks ending in ret over the jumps to them"},
+};
+
+/* pipelines for -O0, -O1 and -O2 */
+static const char* presets[] = {
+    "fold,cfg",
+    "fold,cfg,peephole",
+    "fold,cfg,ssa,duplicate-returns,peephole",
+};
+
+/* CPU time of the calling thread, in milliseconds */
+static double thread_cpu_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+void PassResults::clear(size_t passes) {
+    cfg = IR::CFGCounts();
+    ssa = IR::SSACounts();
+    peephole_hits.assign(IR::Peephole::NUM_RULES, 0);
+    wall_ms.assign(passes, 0);
+    cpu_ms.assign(passes, 0);
+    dump.clear();
+}
+
+void PassResults::add(const PassResults& r) {
+    cfg.unreachable += r.cfg.unreachable;
+    cfg.threaded += r.cfg.threaded;
+    cfg.merged += r.cfg.merged;
+    cfg.duplicated += r.cfg.duplicated;
+
+    ssa.promoted += r.ssa.promoted;
+    ssa.removed += r.ssa.removed;
+    ssa.skipped += r.ssa.skipped;
+
+    for (size_t i = 0; i < r.peephole_hits.size(); ++i) peephole_hits[i] += r.peephole_hits[i];
+
+    for (size_t i = 0; i < r.wall_ms.size(); ++i) {
+        wall_ms[i] += r.wall_ms[i];
+        cpu_ms[i] += r.cpu_ms[i];
+    }
+}
+
+PassManager::Id PassManager::find(const std::string& name) {
+    int i = 0;
+    while (i < NUM_PASSES && name != passes[i].name) ++i;
+    return (Id) i;
+}
+
+PassManager::PassManager() : print_after(NUM_PASSES), dump(NULL) {
+    set_level(0);
+}
+
+bool PassManager::set_level(int level) {
+    std::string error;
+
+    if (level < 0 || level >= (int) (sizeof presets / sizeof *presets)) return false;
+    return select(presets[level], error);
+}
+
+bool PassManager::select(const std::string& names, std::string& error) {
+    std::vector<Id> chosen;
+    size_t start = 0;
+
+    /* an empty list runs nothing */
+    while (!names.empty() && start <= names.size()) {
+        size_t end = names.find(',', start);
+        if (end == std::string::npos) end = names.size();
+
+        std::string name = names.substr(start, end - start);
+        Id pass = find(name);
+
+        if (pass == NUM_PASSES) {
+            error = name;
+            return false;
+        }
+
+        chosen.push_back(pass);
+        start = end + 1;
+    }
+
+    pipeline = chosen;
+    return true;
+}
+
+bool PassManager::runs(Id pass) const {
+    for (Id i : pipeline) {
+        if (i == pass) return true;
+    }
+
+    return false;
+}
+
+std::string PassManager::str() const {
+    std::string out;
+
+    for (size_t i = 0; i < pipeline.size(); ++i) {
+        if (i) out += ",";
+        out += passes[pipeline[i]].name;
+    }
+
+    return out;
+}
+
+void PassManager::run_ast(AST::Program& program, util::Stats& stats) const {
+    for (Id i : pipeline) {
+        if (passes[i].kind != AST_PASS) continue;
+
+        {
+            util::Stats::Timer timer(stats, passes[i].name);
+            if (i == FOLD) program.fold_constants();
+        }
+
+        if (print_after == i && dump) {
+            *dump << "; after " << passes[i].name << "\n";
+            program.write(*dump);
+        }
+    }
+}
+
+void PassManager::run_ir(IR::Buffer& body, const std::vector<int>& const_map, const std::vector<IR::Signature>& signatures, PassResults& results) const {
+    typedef std::chrono::steady_clock clock;
+
+    for (size_t k = 0; k < pipeline.size(); ++k) {
+        Id i = pipeline[k];
+        if (passes[i].kind != IR_PASS) continue;
+
+        auto wall_start = clock::now();
+        double cpu_start = thread_cpu_ms();
+
+        switch (i) {
+        case CFG:               IR::simplify_cfg(body, results.cfg); break;
+        case SSA:               IR::promote_locals(body, signatures, results.ssa); break;
+        case PEEPHOLE:          peephole.run(body, results.peephole_hits); break;
+        case DUPLICATE_RETURNS: IR::duplicate_returns(body, results.cfg); break;
+        default:                break;
+        }
+
+        results.wall_ms[k] += std::chrono::duration<double, std::milli>(clock::now() - wall_start).count();
+        results.cpu_ms[k] += thread_cpu_ms() - cpu_start;
+
+        if (print_after == i) {
+            /* with the constants the function will really use */
+            IR::Buffer mapped;
+            mapped.append(body, const_map);
+            results.dump += "; after " + std::string(passes[i].name) + "\n" + mapped.str();
+        }
+    }
+}
@@ -0,0 +1,95 @@
+#pragma once
+
+/*
+ * passes.hh
+ * declares the optimization passes and the pipeline which runs them
+ *
+ * AST passes run on the whole program after type checking. IR passes run
+ * on the body of each function as soon as it is generated, on the thread
+ * that generated it. a pipeline is a list of passes in the order they run,
+ * a pass can appear in it more than once. -O0, -O1 and -O2 pick a preset
+ * and --passes=a,b,c builds one by hand.
+ */
+
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "ir/cfg.hh"
+#include "ir/peephole.hh"
+#include "ir/ssa.hh"
+#include "stats.hh"
+
+namespace AST {
+    class Program;
+}
+
+/* what the IR passes did to some functions */
+struct PassResults {
+    IR::CFGCounts cfg;
+    IR::SSACounts ssa;
+    std::vector<int> peephole_hits;        /* by IR::Peephole rule */
+    std::vector<double> wall_ms, cpu_ms;   /* by position in the pipeline */
+    std::string dump;                      /* --print-after output */
+
+    /* start over for a pipeline of 'passes' passes */
+    void clear(size_t passes);
+
+    /* add everything but the dump of 'r' */
+    void add(const PassResults& r);
+};
+
+class PassManager {
+public:
+    enum Kind { AST_PASS, IR_PASS };
+
+    struct Pass {
+        const char* name;
+        Kind kind;
+        const char* description;
+    };
+
+    enum Id {
+        FOLD,              /* AST: fold constant expressions */
+        CFG,               /* IR: see IR::simplify_cfg */
+        SSA,               /* IR: see IR::promote_locals */
+        PEEPHOLE,          /* IR: see IR::Peephole */
+        DUPLICATE_RETURNS, /* IR: see IR::duplicate_returns */
+        NUM_PASSES,
+    };
+
+    static const Pass passes[NUM_PASSES];
+
+    /* a pass by name, NUM_PASSES if there is none */
+    static Id find(const std::string& name);
+
+    /* the -O0 pipeline */
+    PassManager();
+
+    /* use the preset for -O<level>, false if there is none */
+    bool set_level(int level);
+
+    /* use exactly the comma separated list of passes, false with the unknown name in 'error' */
+    bool select(const std::string& names, std::string& error);
+
+    /* true if the pipeline runs 'pass' */
+    bool runs(Id pass) const;
+
+    /* the pipeline as a comma separated list */
+    std::string str() const;
+
+    /* run the AST passes in order, timing each one in 'stats' */
+    void run_ast(AST::Program& program, util::Stats& stats) const;
+
+    /* run the IR passes in order on the body of one function, adding to 'results' */
+    void run_ir(IR::Buffer& body, const std::vector<int>& const_map, const std::vector<IR::Signature>& signatures, PassResults& results) const;
+
+    std::vector<Id> pipeline;
+
+    /* rules used by the peephole pass */
+    IR::Peephole peephole;
+
+    /* pass whose output is written to 'dump' after it runs, or NUM_PASSES for none */
+    Id print_after;
+    std::ostream* dump;
+};
@@ -13,7 +13,7 @@
 #include "parser.hh"
 %}
 
-%option noyywrap nounput noinput batch debug
+%option noyywrap nounput noinput batch debug reentrant
 
 /* helper functions to construct attributed tokens */
 %{
@@ -97,8 +97,8 @@ type      (void|char|int|float)
 "++"       return yy::parser::make_INCR(loc);
 "--"       return yy::parser::make_DECR(loc);
 
-{type}     return yy::parser::make_TYPE(yytext, loc);
-{id}       return yy::parser::make_IDENT(yytext, loc);
+{type}     return yy::parser::make_TYPE(AST::types::from_name(yytext), loc);
+{id}       return yy::parser::make_IDENT(util::intern(yytext, yyleng), loc);
 
 {intconst}  return yy::parser::make_INTCONST(atoi(yytext), loc);
 {realconst} return yy::parser::make_REALCONST(atof(yytext), loc);
@@ -144,16 +144,29 @@ yy::parser::symbol_type make_CHARCONST(const std::string& s, const yy::parser::l
     return yy::parser::make_CHARCONST(s[1], loc);
 }
 
-void driver::scan_begin() {
-    yy_flex_debug = trace_scanning;
-    if (file.empty() || file == "-") {
-        yyin = stdin;
-    } else if (!(yyin = fopen(file.c_str(), "r"))) {
-        std::cerr << "error: cannot open " << file << ": " << strerror(errno) << "\n";
-        exit(EXIT_FAILURE);
+bool driver::scan_begin() {
+    FILE* in = stdin;
+
+    if (!file.empty() && file != "-" && !(in = fopen(file.c_str(), "r"))) {
+        *err << "error: cannot open " << file << ": " << strerror(errno) << "\n";
+        return false;
     }
+
+    /* all scanner state lives in 'scanner', so drivers can run on separate threads */
+    yylex_init(&scanner);
+    yyset_debug(trace_scanning, scanner);
+    yyset_in(in, scanner);
+    return true;
 }
 
 void driver::scan_end() {
-    fclose(yyin);
+    FILE* in = yyget_in(scanner);
+    if (in != stdin) fclose(in);
+
+    yylex_destroy(scanner);
+    scanner = NULL;
+}
+
+const char* driver::scan_text() {
+    return yyget_text(scanner);
 }
@@ -0,0 +1,123 @@
+#include "stats.hh"
+
+#include <cstdio>
+#include <ctime>
+
+/* CPU time of the process, in milliseconds */
+static double cpu_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+static std::string json_string(const std::string& s) {
+    std::string out = "\"";
+
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if ((unsigned char) c < 0x20) {
+            char buf[8];
+            snprintf(buf, sizeof buf, "\\u%04x", c);
+            out += buf;
+        } else {
+            out += c;
+        }
+    }
+
+    return out + "\"";
+}
+
+util::Stats::Timer::Timer(Stats& stats, const char* phase)
+    : stats(stats), phase(phase), wall_start(std::chrono::steady_clock::now()), cpu_start(cpu_ms()) {}
+
+util::Stats::Timer::~Timer() {
+    double wall = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - wall_start).count();
+    stats.add(phase, wall, cpu_ms() - cpu_start);
+}
+
+void util::Stats::add(const std::string& phase, double wall, double cpu) {
+    for (auto& i : phases) {
+        if (i.name == phase) {
+            i.wall_ms += wall;
+            i.cpu_ms += cpu;
+            return;
+        }
+    }
+
+    phases.push_back({phase, wall, cpu});
+}
+
+void util::Stats::set(const std::string& name, uint64_t value, const std::string& group) {
+    for (auto& i : counters) {
+        if (i.group == group && i.name == name) {
+            i.value = value;
+            return;
+        }
+    }
+
+    counters.push_back({group, name, value});
+}
+
+void util::Stats::write_times(std::ostream& out, const std::string& file) const {
+    char line[128];
+    double wall = 0, cpu = 0;
+
+    out << "; " << file << ": time per phase\n";
+    out << ";   phase                 wall ms      cpu ms\n";
+
+    for (auto& i : phases) {
+        snprintf(line, sizeof line, ";   %-18s %10.3f  %10.3f\n", i.name.c_str(), i.wall_ms, i.cpu_ms);
+        out << line;
+        wall += i.wall_ms;
+        cpu += i.cpu_ms;
+    }
+
+    snprintf(line, sizeof line, ";   %-18s %10.3f  %10.3f\n", "total", wall, cpu);
+    out << line;
+}
+
+void util::Stats::write_counters(std::ostream& out, const std::string& file) const {
+    char line[160];
+    std::string group;
+
+    for (auto& i : counters) {
+        if (i.group != group) {
+            group = i.group;
+            out << "; " << file << ": " << group << "\n";
+        }
+
+        snprintf(line, sizeof line, ";   %-32s %12llu\n", i.name.c_str(), (unsigned long long) i.value);
+        out << line;
+    }
+}
+
+void util::Stats::write_json(std::ostream& out, const std::string& file) const {
+    char num[64];
+
+    out << "{\"file\": " << json_string(file) << ", \"phases\": {";
+
+    for (size_t i = 0; i < phases.size(); ++i) {
+        snprintf(num, sizeof num, "{\"wall_ms\": %.3f, \"cpu_ms\": %.3f}", phases[i].wall_ms, phases[i].cpu_ms);
+        out << (i ? ", " : "") << json_string(phases[i].name) << ": " << num;
+    }
+
+    out << "}";
+
+    /* counters are grouped into one object per group */
+    std::string group;
+
+    for (auto& i : counters) {
+        if (i.group != group) {
+            out << (group.empty() ? "" : "}") << ", " << json_string(i.group) << ": {";
+            group = i.group;
+        } else {
+            out << ", ";
+        }
+
+        out << json_string(i.name) << ": " << i.value;
+    }
+
+    out << (group.empty() ? "" : "}") << "}\n";
+}
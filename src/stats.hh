@@ -0,0 +1,64 @@
+#pragma once
+
+/*
+ * stats.hh
+ * declares the per-driver statistics behind --time-passes and --stats
+ *
+ * phases are timed with a scoped Timer, which records wall time and the CPU
+ * time of the whole process (so threads started with -j are included).
+ * counters are plain named numbers filled in after a compile.
+ */
+
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+namespace util {
+    class Stats {
+    public:
+        struct Phase {
+            std::string name;
+            double wall_ms, cpu_ms;
+        };
+
+        /* adds the time from construction to destruction to a phase */
+        class Timer {
+        public:
+            Timer(Stats& stats, const char* phase);
+            ~Timer();
+
+        private:
+            Timer(const Timer&);
+            Timer& operator=(const Timer&);
+
+            Stats& stats;
+            const char* phase;
+            std::chrono::steady_clock::time_point wall_start;
+            double cpu_start;
+        };
+
+        /* add time to a phase, which is created the first time */
+        void add(const std::string& phase, double wall_ms, double cpu_ms);
+
+        /* set a counter, in the group "counters" or e.g. "nodes" */
+        void set(const std::string& name, uint64_t value, const std::string& group = "counters");
+
+        /* human-readable tables, one line per phase or counter */
+        void write_times(std::ostream& out, const std::string& file) const;
+        void write_counters(std::ostream& out, const std::string& file) const;
+
+        /* everything as one JSON object on a single line */
+        void write_json(std::ostream& out, const std::string& file) const;
+
+        std::vector<Phase> phases; /* in the order they first ran */
+
+        struct Counter {
+            std::string group, name;
+            uint64_t value;
+        };
+
+        std::vector<Counter> counters; /* in the order they were set */
+    };
+}
@@ -1,5 +1,17 @@
 #include "util.hh"
 
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <exception>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
 typedef yy::parser::token token;
 
 std::string util::symbol_type_name(yy::parser::symbol_type& t) {
@@ -109,3 +121,100 @@ std::string util::symbol_type_name(yy::parser::symbol_type& t) {
         return "UNKNOWN";
     }
 }
+
+long util::peak_rss_kb() {
+    /* prefer the high water mark from procfs, as it can be reset between files */
+    FILE* f = fopen("/proc/self/status", "r");
+
+    if (f) {
+        char line[256];
+        long kb = -1;
+
+        while (fgets(line, sizeof line, f)) {
+            if (!strncmp(line, "VmHWM:", 6)) {
+                kb = atol(line + 6);
+                break;
+            }
+        }
+
+        fclose(f);
+        if (kb >= 0) return kb;
+    }
+
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+void util::reset_peak_rss() {
+    /* writing 5 to clear_refs resets VmHWM on linux, elsewhere this does nothing */
+    FILE* f = fopen("/proc/self/clear_refs", "w");
+    if (!f) return;
+    fputs("5", f);
+    fclose(f);
+}
+
+void util::parallel_for(int count, int jobs, const std::function<void(int)>& fn) {
+    if (jobs > count) jobs = count;
+
+    if (jobs <= 1) {
+        for (int i = 0; i < count; ++i) fn(i);
+        return;
+    }
+
+    std::vector<std::exception_ptr> errors(count);
+    std::atomic<int> next(0);
+
+    auto worker = [&]() {
+        for (int i = next++; i < count; i = next++) {
+            try {
+                fn(i);
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        }
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < jobs; ++i) threads.emplace_back(worker);
+    worker();
+
+    for (auto& t : threads) t.join();
+
+    for (auto& e : errors) {
+        if (e) std::rethrow_exception(e);
+    }
+}
+
+util::MappedFile::MappedFile() : data(NULL), size(0) {}
+
+util::MappedFile::~MappedFile() {
+    if (size) munmap(const_cast<void*>(data), size);
+}
+
+bool util::MappedFile::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+        close(fd);
+        return false;
+    }
+
+    /* an empty file can't be mapped, but it is still a valid (empty) file */
+    if (st.st_size > 0) {
+        void* p = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (p == MAP_FAILED) {
+            close(fd);
+            return false;
+        }
+
+        data = p;
+        size = st.st_size;
+    }
+
+    close(fd);
+    return true;
+}
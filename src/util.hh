@@ -4,8 +4,40 @@
  * utility functions
  */
 
+#include <functional>
+
 #include "parser.hh"
 
 namespace util {
     std::string symbol_type_name(yy::parser::symbol_type& t);
+
+    /* peak resident set size of the process, in kilobytes */
+    long peak_rss_kb();
+
+    /* restart peak RSS tracking where the OS supports it */
+    void reset_peak_rss();
+
+    /*
+     * run fn(0) .. fn(count - 1) on up to 'jobs' threads.
+     * if any calls throw, the exception from the lowest index is rethrown once
+     * every call has finished, so errors come out the same way as a serial run
+     */
+    void parallel_for(int count, int jobs, const std::function<void(int)>& fn);
+
+    /* a whole file mapped read-only, unmapped when destroyed */
+    class MappedFile {
+    public:
+        MappedFile();
+        ~MappedFile();
+
+        /* false with errno set if the file can't be opened or mapped */
+        bool open(const std::string& path);
+
+        const void* data;
+        size_t size;
+
+    private:
+        MappedFile(const MappedFile&);
+        MappedFile& operator=(const MappedFile&);
+    };
 }
@@ -0,0 +1,11 @@
+#pragma once
+
+/*
+ * version.hh
+ * the compiler version, which is part of every cache key
+ *
+ * bump it whenever the generated code changes for the same input and
+ * options, so stale cache entries are never reused.
+ */
+
+#define COMPILER_VERSION "4.6"